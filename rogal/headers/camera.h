@@ -3,15 +3,19 @@
 
 typedef struct {
 	vec2_t position;
+	vec2_t last_position; //position at the start of the simulation tick (for render interpolation)
 } camera_t;
 
 void set_camera_position(vec2_t position);
 void offset_camera_position(vec2_t offset);
 void init_camera(void);
+void store_camera_position(void);
 
+void load_camera_matrices(void);
 void set_camera_for_ui(void);
 void unset_camera_for_ui(void);
 
 vec2_t *get_camera_offset(void);
 vec2_t *viewport_to_world_pos(vec2_t view_pos, int is_local);
-void world_to_screen_coordinates(vec2_t world_pos, int *x, int *y);
\ No newline at end of file
+void world_to_screen_coordinates(vec2_t world_pos, int *x, int *y);
+void screen_to_world_coordinates(int x, int y, vec2_t out);
\ No newline at end of file
@@ -9,15 +9,16 @@
 ---------*/
 
 //map dimensions and generation macros
-#define MAP_SIZE			35
-#define MAP_OFFSET			MAP_SIZE / 2
+#define MIN_MAP_SIZE		35	//size of the first levels
+#define MAX_MAP_SIZE		511	//size of the deepest levels (MIN_MAP_SIZE + n * MAP_SIZE_PER_LEVEL, so it stays odd and centered)
+#define MAP_SIZE_PER_LEVEL	4	//how much the map grows with each level
 
 #define MAP_SAFE_ZONE		3
 
 #define MIN_FEATURE_SIZE	3
 #define MAX_FEATURE_SIZE	4
 
-#define MAP_BUDGET			300
+#define MAP_BUDGET			300	//amount of non-empty tiles on a MIN_MAP_SIZE map (scales with the map area)
 
 //map tile types
 #define TILE_EMPTY			0
@@ -29,10 +30,55 @@
 #define TILE_LOCK_DOOR		6
 #define TILE_CHEST			7
 
-extern int map_contents[MAP_SIZE][MAP_SIZE]; //for mobs and items (non-tile elements)
-extern sprite_t *sprite_map[MAP_SIZE][MAP_SIZE];
+#define TILE_TYPE_COUNT		8
 
-void generate_map(void);
+//index of a tile in the map arrays (the arrays are map_size * map_size, stored column by column)
+#define MapIndex(x, y) ((x) * map_size + (y))
+
+extern int map_size;	//width and height of the current map
+extern int map_offset;	//tile coordinates of the world origin
+
+//state of a map tile sprite that is kept while the sprite doesn't exist (see chunks.c)
+typedef struct tile_state {
+	unsigned char	rotation;
+	unsigned char	frame;			//current animation frame
+	unsigned char	visibility;
+	unsigned char	flags;			//TILE_STATE_...
+} tile_state_t;
+
+#define TILE_STATE_USED		1	//door opened or chest looted
+#define TILE_STATE_ARMOR	2	//chest gives armor
+
+extern int *map_contents; //for mobs and items (non-tile elements)
+extern sprite_t **sprite_map; //tile sprites (NULL where the chunk is not loaded)
+extern int *collision_map; //collision masks of the tile sprites
+extern tile_state_t *tile_states;
+
+int is_inside_map(int x, int y);
+int get_map_contents(int x, int y);
+sprite_t *get_map_sprite(int x, int y);
+int get_collision_mask(int x, int y);
+int get_map_tile(int x, int y);
+int get_tile_visibility(int x, int y);
+int is_tile_used(int x, int y);
+
+void generate_map(unsigned int seed, int level);
+void pregenerate_map(int level, unsigned int seed);
+void wait_pregenerated_map(int level, unsigned int seed);
+void set_tile_collision_mask(sprite_t *s, int collision_mask);
+
+sprite_t *build_tile_sprite(int x, int y);
+void release_tile_sprite(int x, int y);
+
+/*---------
+	 CHUNKS
+---------*/
+
+#define CHUNK_SIZE		16	//width and height of a map chunk (in tiles)
+
+void init_map_chunks(void);
+void clear_map_chunks(void);
+void update_map_chunks(void);
 
 /*---------
 	  ITEMS
@@ -56,7 +102,7 @@ typedef struct {
 
 extern item_t map_items[MAX_ITEMS + 1];
 
-void init_items(void);
+void init_items(unsigned int seed);
 item_t *new_item(void);
 void weapon_pickup_action(sprite_t *s);
 
@@ -64,7 +110,7 @@ void weapon_pickup_action(sprite_t *s);
 	   MOBS
 ---------*/
 
-#define MAX_MOBS		11 //maximum amount of mobs per level
+#define MAX_MOBS		11 //amount of mobs generated on a MIN_MAP_SIZE map (the mob store itself grows as needed)
 
 //base values for mob generation
 #define MIN_MOB_DAMAGE	1
@@ -76,29 +122,56 @@ void weapon_pickup_action(sprite_t *s);
 #define MIN_MOB_ARMOR	0
 #define MAX_MOB_ARMOR	1
 
-typedef struct mob {
-	sprite_t		*sprite[3];
-	sprite_t		*attack_sprite;
+//mob handles stay valid while the mob is alive, the store index of a mob changes when other mobs die
+typedef unsigned int mob_handle_t;
 
-	int				type;
-	int				look_direction;
+#define MOB_NONE		0 //handle of no mob
+#define MOB_SLOT_BITS	20 //lower bits of a handle are the slot, upper bits are the slot generation
+#define MOB_SLOT_MASK	((1u << MOB_SLOT_BITS) - 1)
 
-	player_stats_t	stats;
+//render data of a mob (only touched when the mob is drawn)
+typedef struct mob_render {
+	sprite_t		*sprite[3];
+	sprite_t		*attack_sprite;
 
 	//mob stats display
 	text_t			*health_text;
 	text_t			*armor_text;
 	sprite_t		*text_background;
-} mob_t;
+} mob_render_t;
+
+//all alive mobs, each field is a separate array indexed by 0..count-1
+typedef struct mob_store {
+	int				count;
+	int				capacity;
+
+	//per turn data
+	int				*type;
+	int				*look_direction;
+	int				*tile_x, *tile_y;		//tile on the occupancy map
+	player_stats_t	*stats;
+	int				*attacks_player;		//1 => this mob attacks the player
+
+	//movement
+	vec2_t			*lerp_starts;			//movement start
+	vec2_t			*lerp_ends;				//and movement end
+	int				*lerp_max_msecs;		//how many miliseconds should the move take
+	int				*lerp_msecs;			//how many miliseconds this move already took
+
+	mob_render_t	*render;
+	mob_handle_t	*handle;
+} mob_store_t;
 
 extern int is_mob_move;
-extern mob_t mobs[MAX_MOBS];
+extern mob_store_t mob_store;
 
-void init_mobs(void);
-mob_t *find_mob(vec2_t position);
-void mob_die(mob_t *mob);
+void init_mobs(unsigned int seed);
+mob_handle_t find_mob(vec2_t position);
+int mob_index(mob_handle_t handle);
+void mob_die(mob_handle_t handle);
 void mobs_move(void);
-void mob_receive_damage(mob_t *mob, int damage);
+int get_turn_count(void);
+void mob_receive_damage(mob_handle_t handle, int damage);
 
 int alive_mobs_count(void);
 
@@ -128,7 +201,7 @@ MAP CONTENTS
 extern int is_player_move;
 extern int is_player_dead;
 
-void attack_mob(mob_t *mob);
+void attack_mob(mob_handle_t handle);
 void player_receive_damage(int damage);
 
 void add_health(int hp);
@@ -149,16 +222,78 @@ void player_next_level(void);
 void keyboard_press_event(unsigned char key, int x, int y);
 void special_press_event(int key, int x, int y);
 void mouse_click_event(int button, int state, int x, int y);
+void world_click_event(int button, int state, vec2_t position);
+void on_player_action(sprite_t *s, int mouse_key);
 void logic_frame(int);
 
 extern int is_ingame;
 extern int is_paused;
 extern int is_options;
+extern int is_instant_turns;
 
 void init_game(void);
+void start_run(unsigned int seed, int level);
 
 void next_level_action(sprite_t *s);
 int get_current_level(void);
+unsigned int get_level_seed(int level);
+
+/*---------
+	 REPLAY
+---------*/
+
+//replay event types
+#define REPLAY_RUN		1	//a new run started (seed and level)
+#define REPLAY_KEYBOARD	2
+#define REPLAY_SPECIAL	3
+#define REPLAY_MOUSE	4
+
+//recording
+int start_recording(const char *filename);
+void stop_recording(void);
+void record_run_start(unsigned int seed, int level);
+void record_keyboard_event(unsigned char key, int x, int y);	//GLUT input callbacks
+void record_special_event(int key, int x, int y);
+void record_mouse_event(int button, int state, int x, int y);
+
+//replay
+int start_replay(const char *filename, int fast);
+void stop_replay(void);
+int is_replaying(void);
+int is_fast_replay(void);
+int get_replayed_event_count(void);
+unsigned int new_run_seed(void);		//recorded seed during a replay, otherwise from the clock
+void play_replay_events(void);			//called after every simulation tick
+void run_fast_replay(double msec);
+
+/*---------
+ SIMULATION
+---------*/
+
+//direction of a player action on the player's own tile (other directions are ROTATION_...)
+#define ACTION_HERE		-1
+
+void start_simulation(unsigned int seed, int level);
+int apply_player_action(int direction, int mouse_key);
+void run_simulation_ticks(int ticks);
+int run_simulation_until_idle(int max_ticks);
+int is_simulation_idle(void);
+
+/*---------
+		BOT
+---------*/
+
+int bot_play_turn(void);	//plays one turn through the simulation interface, 0 => level can't be continued
+
+/*---------
+PATHFINDING
+---------*/
+
+void resize_flow_field(void);
+void update_flow_field(int x, int y);
+void invalidate_flow_field(void);
+void flow_field_tile_opened(int x, int y);
+int flow_field_directions(int x, int y, int directions[4]);
 
 /*---------
 	OBJECTS
@@ -173,5 +308,14 @@ void chest_action(sprite_t *s);
 ---------*/
 
 void recalculate_sprites_visibility(void);
+void reset_visibility(void);
+void resize_visibility_map(void);
+
+//field of view
+void resize_fov_map(void);
+void calculate_fov(int x, int y, float radius);
+const int *get_visible_tiles(int *count);
+int is_tile_visible(int x, int y);
+int is_position_visible(vec2_t position);
 
 #endif // !GAME_H
\ No newline at end of file
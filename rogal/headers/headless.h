@@ -0,0 +1,25 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+/*
+* The headless build (make headless) doesn't include GLUT, but the game logic
+* still receives input as GLUT events. These are the GLUT input codes it uses
+* (same values as in glut.h).
+*/
+
+//mouse buttons
+#define GLUT_LEFT_BUTTON	0
+#define GLUT_MIDDLE_BUTTON	1
+#define GLUT_RIGHT_BUTTON	2
+
+//mouse button states
+#define GLUT_DOWN			0
+#define GLUT_UP				1
+
+//special keys
+#define GLUT_KEY_LEFT		100
+#define GLUT_KEY_UP			101
+#define GLUT_KEY_RIGHT		102
+#define GLUT_KEY_DOWN		103
+
+#endif // !HEADLESS_H
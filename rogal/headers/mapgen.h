@@ -0,0 +1,66 @@
+#ifndef MAPGEN_H
+#define MAPGEN_H
+
+#include "game.h"
+
+//generation phases (see map_generator_t phase_msec)
+#define MAPGEN_PHASE_FEATURES		0	//rooms and hallways
+#define MAPGEN_PHASE_LOCKED_ROOM	1
+#define MAPGEN_PHASE_DOORS			2	//fixing and removing doors
+#define MAPGEN_PHASE_WATER			3
+#define MAPGEN_PHASE_EXIT			4
+#define MAPGEN_PHASE_CONTENTS		5	//items and mobs
+
+#define MAPGEN_PHASE_COUNT			6
+
+/*
+* The map generator context. It owns all data of a single generation (the tile
+* and contents grids, counters and its random state), so generators don't share
+* anything and the same seed always creates the same map.
+*/
+typedef struct map_generator {
+	unsigned int	seed;
+	int				level;
+	rng_t			rng;
+
+	//dimensions
+	int				size;					//width and height of the grids
+	int				offset;					//tile coordinates of the world origin
+	int				budget;					//amount of non-empty tiles to create
+
+	//grids (size * size, see GenIndex)
+	int				*tiles;					//TILE_...
+	int				*contents;				//MAP_... (mobs and items)
+
+	//counters (kept up to date by set_gen_tile)
+	int				tile_counts[TILE_TYPE_COUNT];
+
+	//lists of the floor and door tiles (as GenIndex) for picking random tiles
+	int				*floor_tiles;
+	int				*door_tiles;
+	int				*tile_list_index;		//position of each floor or door tile in its list
+	int				capacity;				//allocated grid size (size * size)
+
+	int				is_failed;				//marks the generation as failed
+	int				has_lock_room;
+
+	//statistics of the last generation
+	int				attempts;				//attempts it took (including the failed ones)
+	int				budget_misses;			//attempts that failed to create enough tiles
+	double			phase_msec[MAPGEN_PHASE_COUNT]; //time spent in each phase (all attempts)
+} map_generator_t;
+
+//index of a tile in the generator grids
+#define GenIndex(gen, x, y) ((x) * (gen)->size + (y))
+
+void init_map_generator(map_generator_t *gen);
+int prepare_map_generator(map_generator_t *gen, int level);
+void free_map_generator(map_generator_t *gen);
+
+int run_map_generator(map_generator_t *gen, unsigned int seed);
+void add_map_contents(map_generator_t *gen, unsigned int seed);
+
+int get_level_map_size(int level);
+int count_tiles_of_type(map_generator_t *gen, int type);
+
+#endif // !MAPGEN_H
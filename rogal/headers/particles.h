@@ -3,42 +3,63 @@
 #define PARTICLE_DEFAULT_GRAVITY	4
 #define PARTICLE_DEFAULT_MSEC		1500 //default particle lifetime
 
-typedef struct particle {
+#define MAX_PARTICLES				32768 //particle pool capacity
 
-	//particle render color
-	color3_t	color;
+//SSE2 is always available on x86-64
+#if !defined(PARTICLES_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define PARTICLES_SSE
+#endif
+
+/*
+* All particles are stored as a structure of arrays: the same property of
+* consecutive particles is kept in consecutive memory so the simulation
+* step can process several particles at once.
+*/
+typedef struct {
 
 	//position and velocity. For each frame the particle will move to (position + velocity * frametime)
-	vec2_t		velocity;
-	vec2_t		position;
+	float		position_x[MAX_PARTICLES];
+	float		position_y[MAX_PARTICLES];
+	float		velocity_x[MAX_PARTICLES];
+	float		velocity_y[MAX_PARTICLES];
 
-	int			gravity;		//gravity value for the particle. Could also be negative for effects like fire or smoke
-	float		ground_height;	//Y height of the particle "ground". If the particle's position reaches this value it means the ground was hit
+	float		gravity[MAX_PARTICLES];			//gravity value for the particle. Could also be negative for effects like fire or smoke
+	float		ground_height[MAX_PARTICLES];	//Y height of the particle "ground". If the particle's position reaches this value it means the ground was hit
 
-	int			life_msec;		//time left to live
+	int			life_msec[MAX_PARTICLES];		//time left to live
 
-	int			render_layer;	//sorting layer for the renderer
+	//particle render color
+	color3_t	color[MAX_PARTICLES];
 
-	int			visibility;		//on-off
+	int			render_layer[MAX_PARTICLES];	//sorting layer for the renderer
 
-	//"one way" linked list
-	struct particle *next;
-} particle_t;
+	int			visibility[MAX_PARTICLES];		//on-off
+
+	int			count;							//alive particles are the first "count" elements
+	int			high_water_mark;				//the highest amount of particles alive at once
+} particle_pool_t;
 
 //particle on-off toggle for options. Stops new particles from spawning
 extern int are_particles_enabled;
 
 //general functions
-particle_t *new_particle(void);
-void delete_particle(particle_t *p);
+int new_particle(void);
+void delete_particle(int index);
 void run_particles(int msec);
 void init_particles(void);
 
-particle_t *head_particle(void);
+//pool access: only the first pool->count particles are alive
+particle_pool_t *particles_pool(void);
+
+//simulation steps used by run_particles (both give bit-identical results, see tools/particletest.c)
+void integrate_particles_scalar(int start, int end, float time);
+#ifdef PARTICLES_SSE
+int integrate_particles_sse(int count, float time);
+#endif // PARTICLES_SSE
 
 //particle geneerators
 void make_walk_dust_particle(vec2_t position, float groundheight);
 void make_blood_particles(vec2_t position, float groundheight);
 void make_death_particles(vec2_t position);
 void make_pickup_particles(vec2_t position, float color_r, float color_g, float color_b);
-void make_chest_particles(vec2_t position, float color_r, float color_g, float color_b);
\ No newline at end of file
+void make_chest_particles(vec2_t position, float color_r, float color_g, float color_b);
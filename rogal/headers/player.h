@@ -16,6 +16,7 @@ extern player_t player;
 
 void init_player(void);
 void walk_to_tile(vec2_t position, float dist);
+void end_walk(void);
 int direction_to_tile(vec2_t tile_pos);
 void face_direction(int direction);
-void attack_animation(int stop);
\ No newline at end of file
+void attack_animation(int value);
\ No newline at end of file
@@ -2,4 +2,15 @@
 
 //raycast
 sprite_t *screen_to_world_raycast(int x, int y, int raycast_mask);
-int sprite_ray_intersection(vec2_t start, vec2_t end, int raycast_mask, vec2_t *point);
\ No newline at end of file
+sprite_t *world_raycast(vec2_t position, int raycast_mask);
+sprite_t *position_raycast(vec2_t position, int raycast_mask);	//UI and world layers
+int sprite_ray_intersection(vec2_t start, vec2_t end, int raycast_mask, vec2_t *point);
+
+//picking
+#define PICK_NONE	0	//sprite is not registered for picking
+#define PICK_UI		-1	//sprite is on the UI pick list
+
+void register_pick_sprite(sprite_t *s);		//registers a world sprite on the map tile under its position
+void register_ui_pick_sprite(sprite_t *s);	//registers a UI sprite
+void unregister_pick_sprite(sprite_t *s);
+void resize_pick_map(void);					//reallocates the pick lists for the current map size
\ No newline at end of file
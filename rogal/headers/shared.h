@@ -16,6 +16,8 @@
 
 #define LINUX
 
+#include <pthread.h>
+
 #endif // _MSC_VER 
 
 //basic includes
@@ -27,7 +29,7 @@
 //unused macro marks variable as unused by purpose
 #define UNUSED_VARIABLE(x) ((void)x)
 
-//random
+//random (cosmetic effects only, anything that has to be reproducible uses rng_t)
 #define Random(min_val, max_val) ((min_val) + rand() % (((max_val) - (min_val)) + 1))
 #define RandomBool Random(0, 1)
 
@@ -48,15 +50,44 @@ static inline int r_roundf(float number)
 	   TIME
 ---------*/
 
-//actual passed time between two last logic frames
+//simulated time passed between two last logic frames (always TICK_MSEC)
 extern int frame_msec;
 
 #define LOGIC_MSEC	frame_msec
 #define LOGIC_SEC	0.001f * LOGIC_MSEC
 
-//tick milliseconds passed to each glut timer function
+//length of a fixed simulation tick, all game time advances in ticks (see scheduler.c)
 #define TICK_MSEC	10
 
+//the most ticks simulated for a single frame (after a stall the game slows down instead of freezing)
+#define MAX_FRAME_TICKS	25
+
+//sprites moving further than this in a single tick are teleported, not interpolated
+#define MAX_INTERPOLATION_DISTANCE	1.f
+
+//simulation scheduler
+void schedule_task(void (*task)(int value), int delay_msec, int value); //runs the task after delay_msec of simulated time
+void advance_simulation(double real_msec);	//runs all ticks up to the given real time
+void run_simulation_tick(void);
+unsigned int get_simulation_msec(void);
+float get_render_interpolation(void);		//fraction of the next tick that has already passed in real time
+
+//high resolution clock for measurements (doesn't need GLUT)
+double get_time_msec(void);
+
+//game systems measured by the profiler (see timer.c)
+#define PROFILE_VISIBILITY	0	//field of view and sprite visibility
+#define PROFILE_AI			1	//mob decisions and paths
+#define PROFILE_GENERATION	2	//creating levels (the part on the main thread)
+#define PROFILE_PARTICLES	3
+
+#define PROFILE_COUNT		4
+
+void enable_profiling(int enabled);
+double profile_start(void);
+void profile_end(int section, double start);
+double get_profile_msec(int section);
+
 /*---------
 	   MATH
 ---------*/
@@ -163,6 +194,53 @@ void d_printf(int type, const char *format, ...);
 void d_spacer(void); //adds a spacer to separate debug messages
 void out_of_memory_error(const char *caller); //displays a memory error and kills the program
 
+/*---------
+	 RANDOM
+---------*/
+
+//seeded random number generator state (xoshiro128**), every generator owns its own state
+typedef struct rng {
+	unsigned int state[4];
+} rng_t;
+
+//separate random streams derived from a single seed
+#define RNG_STREAM_MAP		1
+#define RNG_STREAM_CONTENTS	2
+#define RNG_STREAM_TILES	3
+#define RNG_STREAM_MOBS		4
+#define RNG_STREAM_ITEMS	5
+#define RNG_STREAM_AI		6
+
+void rng_seed(rng_t *rng, unsigned int seed, unsigned int stream);
+unsigned int rng_next(rng_t *rng);
+int rng_range(rng_t *rng, int min_val, int max_val); //inclusive range like Random
+unsigned int rng_hash(unsigned int a, unsigned int b); //mixes two numbers into a seed
+
+#define RngBool(rng) rng_range(rng, 0, 1)
+
+/*---------
+	WORKERS
+---------*/
+
+//a background thread running a single job
+typedef struct worker {
+#ifdef WIN32
+	HANDLE			thread;
+#else
+	pthread_t		thread;
+	pthread_mutex_t	lock;		//guards is_done
+#endif
+	int				is_running;	//started and not waited for yet
+	int				is_done;	//the job has returned
+
+	void			(*job)(void *arg);
+	void			*arg;
+} worker_t;
+
+int start_worker(worker_t *w, void (*job)(void *arg), void *arg); //returns 0 if the thread couldn't be created
+int is_worker_done(worker_t *w);
+void wait_worker(worker_t *w);
+
 /*---------
 	SPRITES
 ---------*/
@@ -178,15 +256,17 @@ void out_of_memory_error(const char *caller); //displays a memory error and kill
 typedef struct sprite {
 	//general
 	vec2_t			position;			//world position of that sprite
+	vec2_t			last_position;		//position at the start of the simulation tick (for render interpolation)
+	int				has_last_position;	//0 => created during this tick, nothing to interpolate from
 	float			scale_x;
 	float			scale_y;
 	int				rotation;			//rotation defined by ROTATION_...
 
 	//rendering
-	unsigned int	tex_id;				//opengl texture id
+	unsigned int	tex_id;				//texture handle (atlas region index, 0 = none)
 	color3_t		color;
 
-	unsigned int	render_layer;		//for rendering order
+	unsigned int	render_layer;		//for rendering order (set with set_sprite_render_layer)
 	int				skip_render;		//skip rendering this sprite?
 
 	//vis
@@ -195,10 +275,14 @@ typedef struct sprite {
 	//raycast
 	int				collision_mask;		//collision type mask
 
-	//linked list
+	//render layer linked list
 	struct sprite	*previous;
 	struct sprite	*next;
 
+	//mouse picking (see raycast.c)
+	struct sprite	*pick_next;			//next sprite registered in the same pick list
+	int				pick_cell;			//pick list of this sprite (PICK_NONE when not registered)
+
 	//animation data
 	int				framecount;			//frames on this sprite
 	int				current_frame;		//current frame to display
@@ -213,9 +297,12 @@ typedef struct sprite {
 	void			*object_data;
 } sprite_t;
 
-sprite_t *sprite_head(void);		//first sprite in the linked list
-sprite_t *new_sprite(void);			//allocates and returns a new sprite
-void delete_sprite(sprite_t *s);	//frees the sprite
+sprite_t *sprite_layer_head(unsigned layer);				//first sprite in the layer's linked list
+sprite_t *new_sprite(void);									//takes a new sprite from the sprite pool
+void delete_sprite(sprite_t *s);							//returns the sprite to the pool
+void set_sprite_render_layer(sprite_t *s, unsigned layer);	//moves the sprite to another layer's list
+void store_sprite_positions(void);							//saves the positions at the start of a simulation tick
+void get_sprite_render_position(sprite_t *s, float interpolation, vec2_t out); //position between the last and the current tick
 
 /*---------
 	 PLAYER
@@ -303,6 +390,8 @@ int get_texture_render_layer(texname name);
 #define RENDER_LAYER_UI_BG			8
 #define RENDER_LAYER_UI				9
 
+#define RENDER_LAYER_COUNT			10
+
 /*---------
  COLLISIONS
 ---------*/
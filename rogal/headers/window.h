@@ -10,6 +10,7 @@
 typedef struct {
 	float	scale;				//world scale
 	float	ratio;				//aspect ratio
+	mat4_t	projection;			//projection matrix (column-major)
 
 	int		width, height;		//window dimensions
 	char	*name;				//window name
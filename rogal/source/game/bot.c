@@ -0,0 +1,355 @@
+/*
+* This file contains the autoplay bot.
+*
+* The bot plays the game the way a player does: every action goes through
+* apply_player_action() and on_player_action(), so it runs the same turn logic
+* (mob AI, visibility, items, level changes) as the keyboard and the mouse. It
+* only knows the tiles the player has discovered.
+*
+* On each turn the bot:
+*	- attacks an adjacent mob
+*	- picks up a useful item it stands on
+*	- otherwise walks towards the nearest target found by a breadth first search
+*	  over the discovered tiles: useful items, unopened chests and doors and
+*	  unexplored edges of the map (walkable tiles next to hidden ones)
+*	- takes the exit (next_level_action) once there's nothing left to explore or
+*	  it spent too many turns on the level
+*
+* The search arrays are stamped instead of cleared, so a search only costs the
+* tiles it reaches.
+*/
+
+#include "game.h"
+#include "player.h"
+#include <string.h>
+
+#ifdef HEADLESS
+#include "headless.h"
+#else
+#include <GL/glut.h>
+#endif // HEADLESS
+
+//turns spent exploring a level (per map tile width) before heading to the exit
+#define BOT_EXPLORE_TURNS	4
+
+//turns after which the bot gives up on a level
+#define BOT_MAX_LEVEL_TURNS	5000
+
+//search target types
+#define TARGET_NONE		0
+#define TARGET_WALK		1	//walk onto the target (items, unexplored edges)
+#define TARGET_USE		2	//use the target from next to it (doors, chests, the exit)
+
+//tile offsets of the ROTATION_... directions (see simulate_mouse_click)
+static const int direction_x[4] = { 1, 0, -1, 0 };
+static const int direction_y[4] = { 0, 1, 0, -1 };
+
+//search state (map_size * map_size, as MapIndex)
+static unsigned int *search_stamp;	//equals current_stamp when the tile was reached by the current search
+static int *first_step;				//direction of the first step towards the tile
+static int *search_queue;
+static unsigned int current_stamp;
+static int search_capacity;
+
+//level state
+static unsigned char *visited;		//tiles the player stood on
+static unsigned int level_seed;		//seed of the level the state belongs to
+static int level_turns;
+
+//useful items on the map (as MapIndex)
+static int item_tiles[MAX_ITEMS + 1];
+static int item_tile_count;
+
+/*
+* Fits the bot arrays to the current map and resets them on a new level.
+*/
+int prepare_bot(void) {
+
+	int count = map_size * map_size;
+	unsigned int seed = get_level_seed(get_current_level());
+
+	if (count > search_capacity) {
+
+		free(search_stamp);
+		free(first_step);
+		free(search_queue);
+		free(visited);
+
+		search_stamp = calloc((size_t)count, sizeof(unsigned int));
+		first_step = malloc(sizeof(int) * count);
+		search_queue = malloc(sizeof(int) * count);
+		visited = calloc((size_t)count, sizeof(unsigned char));
+		search_capacity = count;
+		current_stamp = 0;
+
+		if (!search_stamp || !first_step || !search_queue || !visited) {
+
+			out_of_memory_error(__func__);
+			search_capacity = 0;
+			return 0;
+		}
+	}
+
+	if (seed != level_seed) {
+
+		memset(visited, 0, (size_t)count);
+		level_seed = seed;
+		level_turns = 0;
+	}
+
+	return 1;
+}
+
+/*
+* Returns 1 if the player would gain something by picking up the item.
+*/
+int is_useful_item(item_t *item) {
+
+	if (!item->sprite || item->sprite->collision_mask != COLLISION_ITEM || item->sprite->visibility == VIS_HIDDEN) {
+
+		//picked up or not seen yet
+		return 0;
+	}
+
+	if (item->item_category == ITEM_CATEGORY_WEAPON) {
+
+		return !player.weapon || item->modifier_value > player.weapon->modifier_value;
+	}
+
+	return 1;
+}
+
+/*
+* Finds the tiles of the useful items.
+*/
+void find_item_tiles(void) {
+
+	sprite_t *s;
+
+	item_tile_count = 0;
+
+	for (int i = 0; i < MAX_ITEMS + 1; i++) {
+
+		if (is_useful_item(&map_items[i])) {
+
+			s = map_items[i].sprite;
+			item_tiles[item_tile_count++] = MapIndex((int)floorf(s->position[VEC_X] + map_offset + 0.5f), (int)floorf(s->position[VEC_Y] + map_offset + 0.5f));
+		}
+	}
+}
+
+/*
+* Returns 1 if a useful item lies on the tile.
+*/
+int has_useful_item(int index) {
+
+	for (int i = 0; i < item_tile_count; i++) {
+
+		if (item_tiles[i] == index) {
+
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+* Returns 1 if the door can be opened by the player now.
+*/
+int is_closed_door(int x, int y) {
+
+	int tile = get_map_tile(x, y);
+
+	return (tile == TILE_DOOR || (tile == TILE_LOCK_DOOR && !alive_mobs_count())) && !(get_collision_mask(x, y) & COLLISION_FLOOR);
+}
+
+/*
+* Returns the target type of a discovered tile.
+*/
+int get_target_type(int x, int y, int is_exit) {
+
+	int tile = get_map_tile(x, y);
+
+	if (is_exit) {
+
+		return tile == TILE_EXIT ? TARGET_USE : TARGET_NONE;
+	}
+
+	if (is_closed_door(x, y) || (tile == TILE_CHEST && !is_tile_used(x, y))) {
+
+		return TARGET_USE;
+	}
+
+	if (has_useful_item(MapIndex(x, y))) {
+
+		return TARGET_WALK;
+	}
+
+	//walkable tile on the edge of the explored area
+	if ((get_collision_mask(x, y) & COLLISION_FLOOR) && !visited[MapIndex(x, y)]) {
+
+		for (int i = 0; i < 4; i++) {
+
+			if (get_map_tile(x + direction_x[i], y + direction_y[i]) != TILE_EMPTY &&
+				get_tile_visibility(x + direction_x[i], y + direction_y[i]) == VIS_HIDDEN) {
+
+				return TARGET_WALK;
+			}
+		}
+	}
+
+	return TARGET_NONE;
+}
+
+/*
+* Searches the discovered tiles for the nearest target. Returns the target type and
+* sets the direction of the first step (ACTION_HERE if the target is the player's tile)
+* and the distance in tiles.
+*/
+int find_target(int start_x, int start_y, int is_exit, int *direction, int *distance) {
+
+	int head = 0, tail = 0;
+	int index, x, y, next_x, next_y, next, type;
+	int steps = 0, level_end = 1;
+
+	current_stamp++;
+
+	index = MapIndex(start_x, start_y);
+	search_stamp[index] = current_stamp;
+	first_step[index] = ACTION_HERE;
+	search_queue[tail++] = index;
+
+	while (head < tail) {
+
+		//count the distance of the search rings
+		if (head == level_end) {
+
+			steps++;
+			level_end = tail;
+		}
+
+		index = search_queue[head++];
+		x = index / map_size;
+		y = index % map_size;
+
+		type = get_target_type(x, y, is_exit);
+
+		if (type != TARGET_NONE) {
+
+			*direction = first_step[index];
+			*distance = steps;
+			return type;
+		}
+
+		//closed doors are opened before going through
+		if (!(get_collision_mask(x, y) & COLLISION_FLOOR)) {
+
+			continue;
+		}
+
+		for (int i = 0; i < 4; i++) {
+
+			next_x = x + direction_x[i];
+			next_y = y + direction_y[i];
+
+			if (!is_inside_map(next_x, next_y)) {
+
+				continue;
+			}
+
+			next = MapIndex(next_x, next_y);
+
+			if (search_stamp[next] == current_stamp || get_tile_visibility(next_x, next_y) == VIS_HIDDEN ||
+				!((get_collision_mask(next_x, next_y) & COLLISION_FLOOR) || is_closed_door(next_x, next_y))) {
+
+				continue;
+			}
+
+			search_stamp[next] = current_stamp;
+			first_step[next] = first_step[index] == ACTION_HERE ? i : first_step[index];
+			search_queue[tail++] = next;
+		}
+	}
+
+	return TARGET_NONE;
+}
+
+/*
+* Plays a single turn. Returns 0 if the bot has nothing left to do on this level
+* (no reachable target or too many turns spent), otherwise the turn was played.
+*/
+int bot_play_turn(void) {
+
+	vec2_t position;
+	int x, y, type, direction, distance;
+	int is_exit;
+
+	if (!is_ingame || is_player_dead || !is_simulation_idle() || !prepare_bot()) {
+
+		return 0;
+	}
+
+	if (++level_turns > BOT_MAX_LEVEL_TURNS) {
+
+		return 0;
+	}
+
+	x = (int)floorf(player.sprite[0]->position[VEC_X] + map_offset + 0.5f);
+	y = (int)floorf(player.sprite[0]->position[VEC_Y] + map_offset + 0.5f);
+	visited[MapIndex(x, y)] = 1;
+
+	//fight adjacent mobs
+	for (int i = 0; i < 4; i++) {
+
+		Vec2Copy(player.sprite[0]->position, position);
+		position[VEC_X] += SPRITE_SIZE * 2 * direction_x[i];
+		position[VEC_Y] += SPRITE_SIZE * 2 * direction_y[i];
+
+		if (find_mob(position) != MOB_NONE) {
+
+			return apply_player_action(i, GLUT_LEFT_BUTTON);
+		}
+	}
+
+	find_item_tiles();
+
+	//pick up the item under the player
+	if (has_useful_item(MapIndex(x, y))) {
+
+		return apply_player_action(ACTION_HERE, GLUT_LEFT_BUTTON);
+	}
+
+	//explore, then leave
+	is_exit = level_turns > BOT_EXPLORE_TURNS * map_size;
+	type = find_target(x, y, is_exit, &direction, &distance);
+
+	if (type == TARGET_NONE && !is_exit) {
+
+		//explored everything
+		type = find_target(x, y, 1, &direction, &distance);
+	}
+	else if (type == TARGET_NONE)
+	{
+		//the exit wasn't found yet
+		type = find_target(x, y, 0, &direction, &distance);
+	}
+
+	if (type == TARGET_NONE) {
+
+		return 0;
+	}
+
+	//use the target when standing next to it (or on it)
+	if (type == TARGET_USE && distance <= 1) {
+
+		return apply_player_action(direction, GLUT_LEFT_BUTTON);
+	}
+
+	//doors on the way are opened, everything else is walked on
+	if (is_closed_door(x + direction_x[direction], y + direction_y[direction])) {
+
+		return apply_player_action(direction, GLUT_LEFT_BUTTON);
+	}
+
+	return apply_player_action(direction, GLUT_RIGHT_BUTTON);
+}
@@ -0,0 +1,232 @@
+/*
+* This file creates and releases the tile sprites of the map.
+*
+* The map is split into chunks of CHUNK_SIZE * CHUNK_SIZE tiles. Only the
+* chunks around the camera view and the player's vision have sprites, so the
+* amount of sprites (and the time spent rendering, picking and animating them)
+* depends on the visible area instead of the map size.
+*
+* When a chunk is released the state of its sprites (see tile_state_t) is
+* saved to the tile grid and the sprites are returned to the sprite pool.
+* Chunks are released one chunk further away than they are loaded, so walking
+* back and forth at a chunk border doesn't rebuild the sprites on every move.
+*/
+
+#include "game.h"
+#include "player.h"
+#include "camera.h"
+#include <stdlib.h>
+
+//chunks loaded around the view
+#define CHUNK_LOAD_MARGIN		1
+#define CHUNK_RELEASE_MARGIN	2
+
+static int chunk_count;					//chunks per map side
+static unsigned char *chunk_loaded;		//1 => the chunk has its sprites (chunk_count * chunk_count)
+
+//list of the loaded chunks (as x * chunk_count + y)
+static int *loaded_chunks;
+static int loaded_count;
+
+//chunk bounds of the last update
+static int last_min_x, last_min_y, last_max_x, last_max_y;
+
+/*
+* Creates the sprites of the chunk.
+*/
+void load_chunk(int cx, int cy) {
+
+	int max_x = min((cx + 1) * CHUNK_SIZE, map_size);
+	int max_y = min((cy + 1) * CHUNK_SIZE, map_size);
+
+	for (int x = cx * CHUNK_SIZE; x < max_x; x++) {
+		for (int y = cy * CHUNK_SIZE; y < max_y; y++) {
+
+			build_tile_sprite(x, y);
+		}
+	}
+
+	chunk_loaded[cx * chunk_count + cy] = 1;
+	loaded_chunks[loaded_count++] = cx * chunk_count + cy;
+}
+
+/*
+* Saves the state of the chunk's sprites and deletes them.
+*/
+void release_chunk(int cx, int cy) {
+
+	int max_x = min((cx + 1) * CHUNK_SIZE, map_size);
+	int max_y = min((cy + 1) * CHUNK_SIZE, map_size);
+
+	for (int x = cx * CHUNK_SIZE; x < max_x; x++) {
+		for (int y = cy * CHUNK_SIZE; y < max_y; y++) {
+
+			release_tile_sprite(x, y);
+		}
+	}
+
+	chunk_loaded[cx * chunk_count + cy] = 0;
+}
+
+/*
+* Converts a world position to chunk coordinates (clamped to the map).
+*/
+void position_to_chunk(vec2_t position, int *cx, int *cy) {
+
+	int x = (int)floorf(position[VEC_X] + map_offset + 0.5f);
+	int y = (int)floorf(position[VEC_Y] + map_offset + 0.5f);
+
+	*cx = (r_clamp(x, 0, map_size - 1)) / CHUNK_SIZE;
+	*cy = (r_clamp(y, 0, map_size - 1)) / CHUNK_SIZE;
+}
+
+/*
+* Finds the chunks covered by the camera view and the player's vision.
+*/
+void get_view_chunks(int *min_x, int *min_y, int *max_x, int *max_y) {
+
+	vec2_t corners[4];
+	int cx, cy;
+
+	//screen corners
+	screen_to_world_coordinates(0, 0, corners[0]);
+	screen_to_world_coordinates(window_props.width, window_props.height, corners[1]);
+
+	//vision around the player (the camera doesn't always follow the player)
+	Vec2Copy(player.sprite[0]->position, corners[2]);
+	Vec2Copy(player.sprite[0]->position, corners[3]);
+
+	corners[2][VEC_X] -= VIS_DISTANCE;
+	corners[2][VEC_Y] -= VIS_DISTANCE;
+	corners[3][VEC_X] += VIS_DISTANCE;
+	corners[3][VEC_Y] += VIS_DISTANCE;
+
+	*min_x = *min_y = chunk_count;
+	*max_x = *max_y = -1;
+
+	for (int i = 0; i < 4; i++) {
+
+		position_to_chunk(corners[i], &cx, &cy);
+
+		*min_x = min(*min_x, cx);
+		*min_y = min(*min_y, cy);
+		*max_x = max(*max_x, cx);
+		*max_y = max(*max_y, cy);
+	}
+}
+
+/*
+* Prepares the chunks of a new map. No sprites are created until the next update.
+*/
+void init_map_chunks(void) {
+
+	clear_map_chunks();
+
+	chunk_count = (map_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	chunk_loaded = calloc((size_t)chunk_count * chunk_count, sizeof(unsigned char));
+	loaded_chunks = malloc(sizeof(int) * chunk_count * chunk_count);
+
+	if (!chunk_loaded || !loaded_chunks) {
+
+		out_of_memory_error(__func__);
+		chunk_count = 0;
+		return;
+	}
+
+	//force the next update
+	last_max_x = last_max_y = -1;
+}
+
+/*
+* Deletes the sprites of all loaded chunks (without saving their state) and frees the chunk data.
+*/
+void clear_map_chunks(void) {
+
+	int cx, cy, max_x, max_y;
+
+	for (int i = 0; i < loaded_count; i++) {
+
+		cx = loaded_chunks[i] / chunk_count;
+		cy = loaded_chunks[i] % chunk_count;
+
+		max_x = min((cx + 1) * CHUNK_SIZE, map_size);
+		max_y = min((cy + 1) * CHUNK_SIZE, map_size);
+
+		for (int x = cx * CHUNK_SIZE; x < max_x; x++) {
+			for (int y = cy * CHUNK_SIZE; y < max_y; y++) {
+
+				if (sprite_map[MapIndex(x, y)]) {
+
+					delete_sprite(sprite_map[MapIndex(x, y)]);
+					sprite_map[MapIndex(x, y)] = NULL;
+				}
+			}
+		}
+	}
+
+	free(chunk_loaded);
+	free(loaded_chunks);
+
+	chunk_loaded = NULL;
+	loaded_chunks = NULL;
+	loaded_count = 0;
+	chunk_count = 0;
+}
+
+/*
+* Loads the chunks that came into view and releases the chunks that are far enough away.
+*/
+void update_map_chunks(void) {
+
+	int min_x, min_y, max_x, max_y;
+	int cx, cy;
+
+	if (!chunk_count || !player.sprite[0]) {
+
+		return;
+	}
+
+	get_view_chunks(&min_x, &min_y, &max_x, &max_y);
+
+	if (min_x == last_min_x && min_y == last_min_y && max_x == last_max_x && max_y == last_max_y) {
+
+		//nothing changed
+		return;
+	}
+
+	last_min_x = min_x;
+	last_min_y = min_y;
+	last_max_x = max_x;
+	last_max_y = max_y;
+
+	//release far away chunks (the last chunk of the list takes the place of a removed one)
+	for (int i = loaded_count - 1; i >= 0; i--) {
+
+		cx = loaded_chunks[i] / chunk_count;
+		cy = loaded_chunks[i] % chunk_count;
+
+		if (cx < min_x - CHUNK_RELEASE_MARGIN || cx > max_x + CHUNK_RELEASE_MARGIN ||
+			cy < min_y - CHUNK_RELEASE_MARGIN || cy > max_y + CHUNK_RELEASE_MARGIN) {
+
+			release_chunk(cx, cy);
+			loaded_chunks[i] = loaded_chunks[--loaded_count];
+		}
+	}
+
+	//load the chunks in view
+	min_x = max(min_x - CHUNK_LOAD_MARGIN, 0);
+	min_y = max(min_y - CHUNK_LOAD_MARGIN, 0);
+	max_x = min(max_x + CHUNK_LOAD_MARGIN, chunk_count - 1);
+	max_y = min(max_y + CHUNK_LOAD_MARGIN, chunk_count - 1);
+
+	for (cx = min_x; cx <= max_x; cx++) {
+		for (cy = min_y; cy <= max_y; cy++) {
+
+			if (!chunk_loaded[cx * chunk_count + cy]) {
+
+				load_chunk(cx, cy);
+			}
+		}
+	}
+}
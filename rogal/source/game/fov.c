@@ -0,0 +1,250 @@
+/*
+* This file contains the field of view calculation used by the visibility code.
+*
+* The visible tiles are found with symmetric shadowcasting: the area around the
+* player is split into four quadrants and each quadrant is scanned row by row
+* moving away from the player. Tiles that block the vision cast shadows that
+* narrow the scanned area of the next rows. A floor tile is visible when its
+* center is inside the lit area, blocking tiles are visible when any part of
+* them is lit. This makes the vision symmetric: if the player can see a tile
+* then a mob standing on that tile can see the player.
+*
+* Slopes are kept as integer fractions so the results don't depend on float
+* rounding.
+*/
+
+#include "game.h"
+#include <stdlib.h>
+
+//tiles that block the vision
+#define FOV_BLOCKING_MASK (COLLISION_WALL | COLLISION_OBSTACLE)
+
+//quadrants (direction of the rows)
+#define QUADRANT_NORTH	0
+#define QUADRANT_EAST	1
+#define QUADRANT_SOUTH	2
+#define QUADRANT_WEST	3
+
+//a slope as a fraction (denominator is always positive)
+typedef struct {
+	int num;
+	int den;
+} slope_t;
+
+//the tiles visible in the last calculation (map_size * map_size)
+static unsigned char *fov_map;
+
+//list of the visible tiles (as MapIndex) so they can be cleared without touching the whole map
+static int *visible_tiles;
+static int visible_count;
+
+//state of the current calculation
+static int origin_x, origin_y;
+static int quadrant;
+static int max_depth;
+static float radius_squared;
+
+/*
+* Divides and rounds towards negative infinity.
+*/
+int floor_div(int a, int b) {
+
+	return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+/*
+* Converts quadrant coordinates to map coordinates.
+*/
+void quadrant_to_map(int depth, int col, int *x, int *y) {
+
+	switch (quadrant)
+	{
+		case QUADRANT_NORTH:
+			*x = origin_x + col;
+			*y = origin_y + depth;
+			break;
+		case QUADRANT_EAST:
+			*x = origin_x + depth;
+			*y = origin_y + col;
+			break;
+		case QUADRANT_SOUTH:
+			*x = origin_x + col;
+			*y = origin_y - depth;
+			break;
+		default:
+			*x = origin_x - depth;
+			*y = origin_y + col;
+			break;
+	}
+}
+
+/*
+* Checks if the tile blocks the vision. Tiles outside of the map are always blocking.
+*/
+int is_fov_blocking(int depth, int col) {
+
+	int x, y;
+
+	quadrant_to_map(depth, col, &x, &y);
+
+	if (!is_inside_map(x, y)) {
+
+		return 1;
+	}
+	return (collision_map[MapIndex(x, y)] & FOV_BLOCKING_MASK) != 0;
+}
+
+/*
+* Marks the tile as visible if it's close enough to the origin.
+*/
+void reveal_tile(int depth, int col) {
+
+	int x, y;
+
+	quadrant_to_map(depth, col, &x, &y);
+
+	if (!is_inside_map(x, y)) {
+
+		return;
+	}
+
+	if ((float)(depth * depth + col * col) <= radius_squared && !fov_map[MapIndex(x, y)]) {
+
+		fov_map[MapIndex(x, y)] = 1;
+		visible_tiles[visible_count++] = MapIndex(x, y);
+	}
+}
+
+/*
+* Scans a single row of the quadrant and continues with the next rows.
+*/
+void scan_row(int depth, slope_t start, slope_t end) {
+
+	int min_col, max_col;
+	int is_blocking;
+	int was_blocking = -1; //no previous tile yet
+
+	if (depth > max_depth) {
+
+		return;
+	}
+
+	//the first and last column touched by the lit area (rounding ties towards the center)
+	min_col = floor_div(2 * depth * start.num + start.den, 2 * start.den);
+	max_col = -floor_div(-(2 * depth * end.num - end.den), 2 * end.den);
+
+	for (int col = min_col; col <= max_col; col++) {
+
+		is_blocking = is_fov_blocking(depth, col);
+
+		//walls are lit when touched, floors only when their center is lit
+		if (is_blocking ||
+			(col * start.den >= depth * start.num && col * end.den <= depth * end.num)) {
+
+			reveal_tile(depth, col);
+		}
+
+		if (was_blocking == 1 && !is_blocking) {
+
+			//a shadow ends here
+			start.num = 2 * col - 1;
+			start.den = 2 * depth;
+		}
+		else if (was_blocking == 0 && is_blocking) {
+
+			//a shadow starts here, scan the lit part before it
+			slope_t shadow_start = { 2 * col - 1, 2 * depth };
+
+			scan_row(depth + 1, start, shadow_start);
+		}
+
+		was_blocking = is_blocking;
+	}
+
+	if (was_blocking == 0) {
+
+		scan_row(depth + 1, start, end);
+	}
+}
+
+/*
+* Reallocates the visibility data for the current map size.
+*/
+void resize_fov_map(void) {
+
+	free(fov_map);
+	free(visible_tiles);
+
+	fov_map = calloc((size_t)map_size * map_size, sizeof(unsigned char));
+	visible_tiles = malloc(sizeof(int) * map_size * map_size);
+	visible_count = 0;
+
+	if (!fov_map || !visible_tiles) {
+
+		out_of_memory_error(__func__);
+	}
+}
+
+/*
+* Calculates the visible tiles around the given map tile.
+*/
+void calculate_fov(int x, int y, float radius) {
+
+	slope_t start = { -1, 1 };
+	slope_t end = { 1, 1 };
+
+	//clear the previous result
+	for (int i = 0; i < visible_count; i++) {
+
+		fov_map[visible_tiles[i]] = 0;
+	}
+	visible_count = 0;
+
+	if (!is_inside_map(x, y)) {
+
+		return;
+	}
+
+	origin_x = x;
+	origin_y = y;
+	max_depth = (int)radius;
+	radius_squared = radius * radius;
+
+	//the origin is always visible
+	fov_map[MapIndex(x, y)] = 1;
+	visible_tiles[visible_count++] = MapIndex(x, y);
+
+	for (quadrant = 0; quadrant < 4; quadrant++) {
+
+		scan_row(1, start, end);
+	}
+}
+
+/*
+* Returns the list of tiles visible in the last calculation (as MapIndex).
+*/
+const int *get_visible_tiles(int *count) {
+
+	*count = visible_count;
+	return visible_tiles;
+}
+
+/*
+* Returns 1 if the map tile was visible in the last calculation.
+*/
+int is_tile_visible(int x, int y) {
+
+	if (!is_inside_map(x, y)) {
+
+		return 0;
+	}
+	return fov_map[MapIndex(x, y)];
+}
+
+/*
+* Returns 1 if the tile under the given world position was visible in the last calculation.
+*/
+int is_position_visible(vec2_t position) {
+
+	return is_tile_visible((int)floorf(position[VEC_X] + map_offset + 0.5f), (int)floorf(position[VEC_Y] + map_offset + 0.5f));
+}
@@ -12,20 +12,31 @@
 #include "raycast.h"
 #include "ui.h"
 #include "particles.h"
-#include <GL/glut.h>
 #include "options.h"
 
+#ifdef HEADLESS
+#include "headless.h"
+#else
+#include <GL/glut.h>
+#endif // HEADLESS
+
 //game state
 int is_ingame = 0;
 int is_paused = 0;
 int is_options = 0;
 
+//turns resolve at once, without waiting for the move and attack animations (see options)
+int is_instant_turns = 0;
+
 //frametime
 int frame_msec = 0;
 
 //level counter
 int current_level = 1;
 
+//seed of the current run, every level seed is derived from it (see get_level_seed)
+unsigned int game_seed;
+
 void restart_game(void);
 
 /*
@@ -56,9 +67,9 @@ void on_player_action(sprite_t *s, int mouse_key) {
 
 		//can attack
 		face_direction(look_direction);
-		mob_t *m = find_mob(s->position);
+		mob_handle_t m = find_mob(s->position);
 
-		if (m) {
+		if (m != MOB_NONE) {
 
 			attack_mob(m);
 
@@ -111,6 +122,22 @@ void on_player_action(sprite_t *s, int mouse_key) {
 */
 void mouse_click_event(int button, int state, int x, int y) {
 
+	vec2_t position;
+
+	screen_to_world_coordinates(x, y, position);
+	world_click_event(button, state, position);
+}
+
+/*
+* Handles a mouse click at the world position. Replays and simulated clicks use it directly, so
+* they don't depend on rounding to window pixels.
+* 
+* Parameters:
+* button, state - see mouse_click_event
+* position - clicked world position
+*/
+void world_click_event(int button, int state, vec2_t position) {
+
 	//the player is dead, restart
 	if (!is_player_move && !is_mob_move && is_player_dead) {
 
@@ -125,7 +152,7 @@ void mouse_click_event(int button, int state, int x, int y) {
 	}
 
 	//find the sprite that was clicked
-	sprite_t *s = screen_to_world_raycast(x, y, COLLISION_ALL);
+	sprite_t *s = position_raycast(position, COLLISION_ALL);
 
 	//something was clicked
 	if (s) {
@@ -159,7 +186,6 @@ void mouse_click_event(int button, int state, int x, int y) {
 void simulate_mouse_click(int rotation) {
 
 	vec2_t dest;
-	int x, y;
 
 	//start at the player position
 	Vec2Copy(player.sprite[0]->position, dest);
@@ -168,11 +194,8 @@ void simulate_mouse_click(int rotation) {
 	dest[VEC_X] += (SPRITE_SIZE * 2 * !(rotation & 1)) * (rotation > 0 ? -1 : 1);
 	dest[VEC_Y] += (SPRITE_SIZE * 2 * (rotation & 1)) * (rotation > 1 ? -1 : 1);
 
-	//convert that position to screen coordinates
-	world_to_screen_coordinates(dest, &x, &y);
-
 	//run mouse click event
-	mouse_click_event(GLUT_RIGHT_BUTTON, GLUT_UP, x, y);
+	world_click_event(GLUT_RIGHT_BUTTON, GLUT_UP, dest);
 }
 
 /*
@@ -184,6 +207,9 @@ void simulate_mouse_click(int rotation) {
 */
 void keyboard_press_event(unsigned char key, int x, int y) {
 
+	UNUSED_VARIABLE(x);
+	UNUSED_VARIABLE(y);
+
 	//the player is dead, restart
 	if (!is_player_move && !is_mob_move && is_player_dead) {
 
@@ -245,11 +271,8 @@ void keyboard_press_event(unsigned char key, int x, int y) {
 
 		Vec2Copy(player.sprite[0]->position, dest);
 
-		//find screen coordinates
-		world_to_screen_coordinates(dest, &x, &y);
-
 		//run click event
-		mouse_click_event(GLUT_LEFT_BUTTON, GLUT_UP, x, y);
+		world_click_event(GLUT_LEFT_BUTTON, GLUT_UP, dest);
 	}
 
 	//WSAD simulates mouse click on a tile
@@ -319,47 +342,75 @@ void special_press_event(int key, int x, int y) {
 */
 void update_sprite_animations(void) {
 
-	sprite_t *current = sprite_head();
+	sprite_t *current;
 
-	//iterate over each sprite
-	while (current)
-	{
-		//only animate sprites that allow it
-		if (current->framecount > 1 && !current->animation_pause) {
+	//iterate over each sprite of each layer
+	for (unsigned layer = 0; layer < RENDER_LAYER_COUNT; layer++) {
 
-			if (current->frame_msec_acc >= current->frame_msec) {
+		current = sprite_layer_head(layer);
 
-				//go to next anim frame
-				current->current_frame = current->current_frame == current->framecount ? 1 : current->current_frame + 1;
-				current->frame_msec_acc = LOGIC_MSEC;
-			}
-			else
-			{
-				//just add time
-				current->frame_msec_acc += LOGIC_MSEC;
+		while (current)
+		{
+			//only animate sprites that allow it
+			if (current->framecount > 1 && !current->animation_pause) {
+
+				if (current->frame_msec_acc >= current->frame_msec) {
+
+					//go to next anim frame
+					current->current_frame = current->current_frame == current->framecount ? 1 : current->current_frame + 1;
+					current->frame_msec_acc = LOGIC_MSEC;
+				}
+				else
+				{
+					//just add time
+					current->frame_msec_acc += LOGIC_MSEC;
+				}
 			}
-		}
 
-		current = current->next;
+			current = current->next;
+		}
 	}
 }
 
 /*
-* Timed callback to run various game logic functions. Ideally executed on each frame.
+* Scheduler task to run various game logic functions. Executed on each simulation tick.
 */
 void logic_frame(int value) {
 
-	int elapsed_time = glutGet(GLUT_ELAPSED_TIME);
-	frame_msec = elapsed_time - value;
+	double start;
+
+	frame_msec = TICK_MSEC;
+
+	//create tile sprites that came into view
+	if (is_ingame) {
+
+		update_map_chunks();
+	}
 
 	//run animations
 	update_sprite_animations();
 
 	//run particles
+	start = profile_start();
 	run_particles(frame_msec);
+	profile_end(PROFILE_PARTICLES, start);
 
-	//register the next call of this callback
-	glutTimerFunc(TICK_MSEC, logic_frame, elapsed_time);
+	//run again on the next tick
+	schedule_task(logic_frame, TICK_MSEC, value);
+}
+
+/*
+* Creates the map, mobs and items of a level from the level seed.
+*/
+void generate_level(unsigned int seed, int level) {
+
+	double start = profile_start();
+
+	generate_map(seed, level); //generate new map
+	init_mobs(seed);	//reinitialize mobs
+	init_items(seed);	//reinitialize items
+
+	profile_end(PROFILE_GENERATION, start);
 }
 
 /*
@@ -371,22 +422,23 @@ void next_level_action(sprite_t *s) {
 
 	d_spacer(); //debug spacer
 
-	generate_map(); //generate new map
-	init_mobs();	//reinitialize mobs
-	init_items();	//reinitialize items
-
-	//increment level counter
+	//increment level counter (before generating, the mobs and items scale with the level)
 	current_level++;
 
+	generate_level(get_level_seed(current_level), current_level);
+
+	//start creating the map behind the exit of the new level
+	pregenerate_map(current_level + 1, get_level_seed(current_level + 1));
+
 	//prepare player for the next level
 	player_next_level();
 }
 
 /*
-* Executed when the player dies and clicks a key. Generates a new map
-* and clears player's statistics.
+* Starts a new run with the given seed at the given level. Generates the map
+* and fully reinitializes the player.
 */
-void restart_game(void) {
+void start_run(unsigned int seed, int level) {
 
 	vec2_t v;
 	Vec2Zero(v);
@@ -397,12 +449,17 @@ void restart_game(void) {
 
 	disable_message_text();
 
-	//reset level counter
-	current_level = 1;
+	//set level counter
+	current_level = level;
+
+	//new run, new levels
+	game_seed = seed;
+
+	record_run_start(seed, level);
+
+	generate_level(get_level_seed(current_level), current_level);
 
-	generate_map(); //make new map
-	init_mobs();	//reinitialize mobs
-	init_items();	//reinitialize items
+	pregenerate_map(current_level + 1, get_level_seed(current_level + 1)); //the next map is created in the background
 
 	//the player is not dead anymore
 	is_player_dead = 0;
@@ -414,6 +471,14 @@ void restart_game(void) {
 	set_camera_position(v);
 }
 
+/*
+* Executed when the player dies and clicks a key. Starts a new run from the first level.
+*/
+void restart_game(void) {
+
+	start_run(new_run_seed(), 1);
+}
+
 /*
 * Returns the current level number.
 */
@@ -422,22 +487,24 @@ int get_current_level(void) {
 	return current_level;
 }
 
+/*
+* Returns the seed used to create the given level of the current run.
+*/
+unsigned int get_level_seed(int level) {
+
+	return rng_hash(game_seed, (unsigned int)level);
+}
+
 /*
 * Runs the first initialization of the game.
 */
 void init_game(void) {
 
-	//log a debug spacer
-	d_spacer();
-
-	//initialize particles
-	init_particles();
+	unsigned int seed = new_run_seed();
 
-	generate_map(); //generate the first map
-	init_mobs();	//make mobs
-	init_items();	//make items
+	srand(seed); //for the cosmetic effects
 
-	init_player();	//initialize player
+	start_run(seed, 1);
 
 	//set ingame state
 	is_ingame = 1;
@@ -5,6 +5,7 @@
 
 #include "game.h"
 #include "player.h"
+#include "raycast.h"
 #include <string.h>
 
 //base item values
@@ -97,7 +98,7 @@ item_t *find_item_for_sprite(sprite_t *s) {
 /*
 * Randomizes an item according to the current min-max bounds.
 */
-void randomize_item(item_t *item) {
+void randomize_item(item_t *item, rng_t *rng) {
 
 	color3_t color;
 	int value = 0;
@@ -106,13 +107,13 @@ void randomize_item(item_t *item) {
 	switch (item->item_category)
 	{
 		case ITEM_CATEGORY_ARMOR:
-			value = Random(min_armor, max_armor);
+			value = rng_range(rng, min_armor, max_armor);
 			break;
 		case ITEM_CATEGORY_HEALTH:
-			value = Random(min_health, max_health);
+			value = rng_range(rng, min_health, max_health);
 			break;
 		case ITEM_CATEGORY_WEAPON:
-			value = Random(min_weapon, max_weapon);
+			value = rng_range(rng, min_weapon, max_weapon);
 			break;
 	}
 
@@ -141,16 +142,19 @@ void randomize_item(item_t *item) {
 }
 
 /*
-* Generates map items from the map contents array.
+* Generates map items from the map contents array. The seed decides the item looks and values.
 */
-void generate_items(void) {
+void generate_items(unsigned int seed) {
 
 	texname tname;
 	item_t *item;
 	sprite_t *s;
+	rng_t rng;
 	int category = 0;
 	void (*action)(sprite_t *s);
 
+	rng_seed(&rng, seed, RNG_STREAM_ITEMS);
+
 	//calculate boundaries for the current level
 	int current_level = get_current_level();
 	max_health = MAX_HEALTH_VAL + current_level / 2;
@@ -159,13 +163,13 @@ void generate_items(void) {
 	max_weapon = MAX_WEAPON_VAL + current_level / 3;
 
 	//check all contents
-	for (int x = 0; x < MAP_SIZE; x++) {
-		for (int y = 0; y < MAP_SIZE; y++) {
+	for (int x = 0; x < map_size; x++) {
+		for (int y = 0; y < map_size; y++) {
 
 			action = NULL;
 
 			//set the correct item properties
-			switch (map_contents[x][y])
+			switch (map_contents[MapIndex(x, y)])
 			{
 				case MAP_ITEM_SHIELD:
 					tname = SHIELD;
@@ -174,7 +178,7 @@ void generate_items(void) {
 					break;
 				case MAP_ITEM_SWORD:
 					category = ITEM_CATEGORY_WEAPON;
-					tname = RandomBool ? SWORD : AXE;
+					tname = RngBool(&rng) ? SWORD : AXE;
 					action = weapon_pickup_action;
 					break;
 				case MAP_ITEM_POTION_HP:
@@ -189,7 +193,7 @@ void generate_items(void) {
 
 			//get a new item
 			item = new_item();
-			item->item_type = map_contents[x][y];
+			item->item_type = map_contents[MapIndex(x, y)];
 			item->item_category = category;
 
 			//add sprite
@@ -197,11 +201,12 @@ void generate_items(void) {
 
 			s->tex_id = get_texture_id(tname);
 			s->framecount = get_texture_framecount(tname);
-			s->render_layer = get_texture_render_layer(tname);
+			set_sprite_render_layer(s, get_texture_render_layer(tname));
 			s->frame_msec = get_texture_frametime(tname);
 			s->collision_mask = COLLISION_ITEM;
-			s->position[VEC_X] = (x * SPRITE_SIZE * 2) - MAP_OFFSET;
-			s->position[VEC_Y] = (y * SPRITE_SIZE * 2) - MAP_OFFSET;
+			s->position[VEC_X] = (x * SPRITE_SIZE * 2) - map_offset;
+			s->position[VEC_Y] = (y * SPRITE_SIZE * 2) - map_offset;
+			register_pick_sprite(s);
 
 			s->animation_pause = 0;
 			s->skip_render = 0;
@@ -215,7 +220,7 @@ void generate_items(void) {
 			item->sprite = s;
 
 			//randomize the item value
-			randomize_item(item);
+			randomize_item(item, &rng);
 		}
 	}
 }
@@ -223,7 +228,7 @@ void generate_items(void) {
 /*
 * Initializes items.
 */
-void init_items(void) {
+void init_items(unsigned int seed) {
 
 	//clear all items but player's current weapon
 	for (int i = 0; i < MAX_ITEMS + 1; i++) {
@@ -241,7 +246,7 @@ void init_items(void) {
 	}
 
 	//make new items
-	generate_items();
+	generate_items(seed);
 }
 
 //ACTIONS
@@ -1,1119 +1,513 @@
 #include "game.h"
+#include "mapgen.h"
+#include "raycast.h"
 #include <string.h>
+#include <stdlib.h>
 
-sprite_t *sprite_map[MAP_SIZE][MAP_SIZE];
-int map[MAP_SIZE][MAP_SIZE];
+//dimensions of the current map
+int map_size;
+int map_offset;
 
-//the contents (items and mobs)
-int map_contents[MAP_SIZE][MAP_SIZE];
-
-//counters
-int door_count;
-int floor_count;
+//all map arrays are map_size * map_size (see MapIndex)
+sprite_t **sprite_map;
 
-//marks the generation as failed
-int is_failed;
+//the tiles and contents are the grids of the generator that created the map
+static map_generator_t level_generator;
 
-int has_lock_room;
+//the next map is created in the background while the current one is played
+#define PREGENERATED_MAPS	2	//a dropped map keeps its slot until its job finishes, the next job takes another one
 
-//creates an odd number from any number (never returns a zero)
-#define MakeOddNumber(in) ((in) = (in) % 2 ? (in) : ((in) >= 0 ? (in) + 1 : (in) - 1))
+typedef struct pregenerated_map {
+	map_generator_t	generator;
+	worker_t		worker;
+	int				level;		//requested map (level 0 => the slot is free)
+	unsigned int	seed;
+} pregenerated_map_t;
 
-//directions from tile
-#define DIR_E	1		//x++ east
-#define DIR_S	(1<<1)	//y-- south
-#define DIR_W	(1<<2)	//x-- west
-#define DIR_N	(1<<3)	//y++ north
+static pregenerated_map_t next_maps[PREGENERATED_MAPS];
+int *map;
 
-//direction axes
-#define AXIS_X (DIR_E | DIR_W)
-#define AXIS_Y (DIR_S | DIR_N)
+//collision masks of the tile sprites (used by the line of sight checks)
+int *collision_map;
 
-//direction signs
-#define DIR_NEGATIVE (DIR_S | DIR_W)
-#define DIR_POSITIVE (DIR_E | DIR_N)
+//state of the tile sprites, kept while their chunk is not loaded
+tile_state_t *tile_states;
 
-//content types
-#define CONTENT_MOB			0
-#define CONTENT_ITEM		1
+//the contents (items and mobs)
+int *map_contents;
 
 //----------
-// helper functions
+// tile sprites
 //----------
 
-//returns a direction of the content
-//the idea is that map items are bit shifted and mobs are on the lesser bits - unshifting will yeld 0 for mobs and > 0 if there's an item on the tile
-int neighbor_has_content_of_type(int x, int y, int type) {
+//creates the sprite of a map tile from the map arrays and the tile state (see chunks.c)
+sprite_t *build_tile_sprite(int x, int y) {
 
-	if (x < MAP_SIZE - 1 && ((type == CONTENT_ITEM) ? (map_contents[x + 1][y] >> MAP_ITEM_BYTE_OFFSET) : (map_contents[x + 1][y] & 0xff))) {
+	sprite_t *s;
+	texname tname;
+	tile_state_t *state;
+	int anim_pause = 0;
+	int is_object = 0;
+	void (*action)(sprite_t *s) = NULL;
 
-		return DIR_E;
+	switch (map[MapIndex(x, y)])
+	{
+		case TILE_WALL:
+			tname = WALL;
+			break;
+		case TILE_FLOOR:
+			tname = ROCK;
+			break;
+		case TILE_WATER:
+			tname = WATER;
+			break;
+		case TILE_DOOR:
+			tname = DOOR;
+			anim_pause = 1;
+			is_object = 1;
+			action = door_action;
+			break;
+		case TILE_LOCK_DOOR:
+			tname = LOCKED_DOOR;
+			anim_pause = 1;
+			is_object = 1;
+			action = locked_door_action;
+			break;
+		case TILE_EXIT:
+			tname = LEVEL_EXIT;
+			anim_pause = 1;
+			action = next_level_action;
+			break;
+		case TILE_CHEST:
+			tname = CHEST;
+			anim_pause = 1;
+			is_object = 1;
+			action = chest_action;
+			break;
+		default:
+			return NULL;
 	}
-	if (y > 0 && ((type == CONTENT_ITEM) ? (map_contents[x][y - 1] >> MAP_ITEM_BYTE_OFFSET) : (map_contents[x][y - 1] & 0xff))) {
 
-		return DIR_S;
-	}
-	if (x > 0 && ((type == CONTENT_ITEM) ? (map_contents[x - 1][y] >> MAP_ITEM_BYTE_OFFSET) : (map_contents[x - 1][y] & 0xff))) {
+	state = &tile_states[MapIndex(x, y)];
 
-		return DIR_W;
-	}
-	if (y < MAP_SIZE - 1 && ((type == CONTENT_ITEM) ? (map_contents[x][y + 1] >> MAP_ITEM_BYTE_OFFSET) : (map_contents[x][y + 1] & 0xff))) {
+	//create a new sprite
+	s = new_sprite();
 
-		return DIR_N;
-	}
-	return 0;
-}
+	s->position[VEC_X] = (float)((x * SPRITE_SIZE * 2) - map_offset); //map has an offset (the real center is at [0, 0] but
+	s->position[VEC_Y] = (float)((y * SPRITE_SIZE * 2) - map_offset); //the array can't have negative indexes)
 
-//returns a direction of the neighbor
-int has_neighbor_of_type(int x, int y, int type) {
+	s->tex_id = get_texture_id(tname);
+	s->framecount = get_texture_framecount(tname);
+	set_sprite_render_layer(s, get_texture_render_layer(tname));
+	s->frame_msec = get_texture_frametime(tname);
+	s->animation_pause = anim_pause;
+	s->collision_mask = collision_map[MapIndex(x, y)];
+	s->action = action;
+	s->rotation = state->rotation;
+	s->current_frame = state->frame;
 
-	if (x < MAP_SIZE - 1 && map[x + 1][y] == type) {
+	//opened doors and chests lie on the floor and can't be used again
+	if (is_object && (state->flags & TILE_STATE_USED)) {
 
-		return DIR_E;
+		s->action = NULL;
+		set_sprite_render_layer(s, RENDER_LAYER_FLOOR);
 	}
-	if (y > 0 && map[x][y - 1] == type) {
 
-		return DIR_S;
-	}
-	if (x > 0 && map[x - 1][y] == type) {
+	if (state->flags & TILE_STATE_ARMOR) {
 
-		return DIR_W;
+		s->object_data = malloc(sizeof(int)); //armor chest type
 	}
-	if (y < MAP_SIZE - 1&& map[x][y + 1] == type) {
-		
-		return DIR_N;
-	}
-	return 0;
-}
-
-int count_neighbors_contents(int x, int y, int content) {
 
-	int count = 0;
-
-	if (x < MAP_SIZE - 1 && map_contents[x + 1][y] == content) {
-
-		count++;
-	}
-	if (y > 0 && map_contents[x][y - 1] == content) {
+	s->visibility = state->visibility;
 
-		count++;
+	switch (s->visibility)
+	{
+		case VIS_VISIBLE:
+			Color3White(s->color);
+			break;
+		case VIS_DISCOVERED:
+			Color3LGray(s->color);
+			break;
+		default:
+			Color3Black(s->color);
+			break;
 	}
-	if (x > 0 && map_contents[x - 1][y] == content) {
 
-		count++;
-	}
-	if (y < MAP_SIZE - 1 && map_contents[x][y + 1] == content) {
+	sprite_map[MapIndex(x, y)] = s;
+	register_pick_sprite(s);
 
-		count++;
-	}
-	return count;
+	return s;
 }
 
-int count_neighbors_of_type(int x, int y, int type) {
+//saves the state of a map tile sprite and deletes the sprite (see chunks.c)
+void release_tile_sprite(int x, int y) {
 
-	int count = 0;
+	sprite_t *s = sprite_map[MapIndex(x, y)];
+	tile_state_t *state = &tile_states[MapIndex(x, y)];
 
-	if (x < MAP_SIZE - 1 && map[x + 1][y] == type) {
-
-		count++;
-	}
-	if (y > 0 && map[x][y - 1] == type) {
-
-		count++;
-	}
-	if (x > 0 && map[x - 1][y] == type) {
-
-		count++;
-	}
-	if (y < MAP_SIZE - 1 && map[x][y + 1] == type) {
+	if (!s) {
 
-		count++;
+		return;
 	}
-	return count;
-}
 
-int count_tiles_of_type(int type) {
+	state->frame = (unsigned char)s->current_frame;
 
-	int count = 0;
+	//the tile is out of sight once its sprite is released
+	state->visibility = s->visibility == VIS_HIDDEN ? VIS_HIDDEN : VIS_DISCOVERED;
 
-	for (int x = 0; x < MAP_SIZE; x++) {
-		for (int y = 0; y < MAP_SIZE; y++) {
+	state->flags = 0;
 
-			if (map[x][y] == type) {
+	if (!s->action) {
 
-				count++;
-			}
-		}
+		state->flags |= TILE_STATE_USED;
 	}
-	return count;
-}
-
-int count_tiles_of_not_type(int type) {
+	if (s->object_data) {
 
-	int count = 0;
-
-	for (int x = 0; x < MAP_SIZE; x++) {
-		for (int y = 0; y < MAP_SIZE; y++) {
-
-			if (map[x][y] != type) {
-
-				count++;
-			}
-		}
+		state->flags |= TILE_STATE_ARMOR;
 	}
-	return count;
-}
 
-//returns 1 if the given bounds overlap another room/hallway space
-int is_overlapping(int x_start, int y_start, int x_end, int y_end) {
-
-	//keep the bounds inside the map array
-	if (x_start < 0 || y_start < 0 || x_end >= MAP_SIZE || y_end >= MAP_SIZE) {
-
-		return 1;
-	}
-
-	//check every tile within bounds
-	for (int x = x_start; x <= x_end; x++) {
-		for (int y = y_start; y <= y_end; y++) {
-
-			if (map[x][y] != TILE_EMPTY && map[x][y] != TILE_WALL && map[x][y] != TILE_DOOR) { //ignore walls and doors!
-
-				return 1;
-			}
-		}
-	}
-	return 0;
+	delete_sprite(s);
+	sprite_map[MapIndex(x, y)] = NULL;
 }
 
-//----------
-// doors
-//----------
-
-void add_random_doors(int start_x, int start_y, int end_x, int end_y) {
+//sets the initial tile states and collision masks from the map array (the sprites are created by chunks.c)
+void build_tile_states(rng_t *rng) {
 
-	int coord, x, y;
-	int random_side = Random(0, 3); //make sure at least one door is created
-
-	//bounds edge is 3 units or less long?
-	int x_is_tiny = abs(start_x - end_x) < 3;
-	int y_is_tiny = abs(start_y - end_y) < 3;
-
-	//for each direction pick random entrances
-	for (int i = 0; i < 4; i++) {
+	tile_state_t *state;
+	int collision_mask;
 
-		if (RandomBool || i == random_side) {
+	//for each tile...
+	for (int x = 0; x < map_size; x++) {
+		for (int y = 0; y < map_size; y++) {
 
-			random_side = -1; //no need to force door anymore
+			state = &tile_states[MapIndex(x, y)];
+			memset(state, 0, sizeof(tile_state_t));
 
-			// a wall with length 3 can only have doors in the middle
-			if ((i < 2 && x_is_tiny) ||
-				y_is_tiny) {
+			state->frame = 1;
+			state->visibility = VIS_HIDDEN; //tiles start hidden, visibility only updates the tiles around the player
 
-				coord = (i < 2 ? start_x : start_y) + 1;
-			}
-			else
+			switch (map[MapIndex(x, y)])
 			{
-				//pick random coordinate along the edge
-				coord = (i < 2 ? start_x : start_y) + 1 + rand() % ((i < 2 ? (end_x - start_x) : (end_y - start_y)) - 1);
-			}
-
-			//set door coordinates
-			x = (i < 2 ? coord : (i % 2 ? start_x : end_x));
-			y = (i >= 2 ? coord : (i % 2 ? start_y : end_y));
-
-			if (map[x][y] != TILE_WALL) {
-
-				if (map[x][y] != TILE_DOOR) { //picking already created doors is not an issue
+				case TILE_WALL:
+					collision_mask = COLLISION_WALL;
+					break;
+				case TILE_FLOOR:
+					collision_mask = COLLISION_FLOOR;
+					state->rotation = (unsigned char)rng_range(rng, 0, 3);
+					break;
+				case TILE_WATER:
+					collision_mask = COLLISION_WATER;
+					state->rotation = (unsigned char)rng_range(rng, 0, 3);
+					break;
+				case TILE_DOOR:
+				case TILE_LOCK_DOOR:
+					collision_mask = COLLISION_OBSTACLE;
+					break;
+				case TILE_EXIT:
+					collision_mask = COLLISION_FLOOR;
+					break;
+				case TILE_CHEST:
+					collision_mask = COLLISION_FLOOR;
+					if (RngBool(rng)) {
 
-					//should never happen: this means the generator is broken (rooms overlapping / doors in an empty space)
-					d_printf(LOG_ERROR, "%s: door not in a wall\n", __func__);
-					is_failed = 1;
-				}
-				continue;
+						state->flags |= TILE_STATE_ARMOR;
+					}
+					break;
+				default:
+					collision_mask = 0;
+					break;
 			}
 
-			map[x][y] = TILE_DOOR;
-
-			door_count++;
+			collision_map[MapIndex(x, y)] = collision_mask;
 		}
 	}
-}
 
-void pick_random_doors(int *out_x, int *out_y) {
-
-	int n = Random(0, door_count - 1); //door number
-	int m = 0;
+	init_map_chunks();
+}
 
-	//skip doors until the correct number is found
-	for (int x = 0; x < MAP_SIZE; x++) {
-		for (int y = 0; y < MAP_SIZE; y++) {
+//removes all map sprites before creating a new map
+void clear_sprite_map(void) {
 
-			if (map[x][y] == TILE_DOOR) {
+	clear_map_chunks();
 
-				if (n == m) {
+	//wipe all data
+	if (map_size) {
 
-					*out_x = x;
-					*out_y = y;
-					return;
-				}
-				m++;
-			}
-		}
+		memset(sprite_map, 0, sizeof(sprite_t *) * map_size * map_size);
+		memset(collision_map, 0, sizeof(int) * map_size * map_size);
 	}
-	d_printf(LOG_ERROR, "%s: found no door\n", __func__);
-	is_failed = 1;
-}
 
-//fixes doors after creating the map
-void fix_doors(void) {
+	//the old visible tiles and paths are gone
+	reset_visibility();
+	invalidate_flow_field();
+}
 
-	int count = 0;
+//changes the collision mask of a tile sprite and keeps the collision map up to date
+void set_tile_collision_mask(sprite_t *s, int collision_mask) {
 
-	//remove doors to nowhere
-	for (int x = 0; x < MAP_SIZE; x++) {
-		for (int y = 0; y < MAP_SIZE; y++) {
+	int x = (int)(s->position[VEC_X] + map_offset + 0.5f);
+	int y = (int)(s->position[VEC_Y] + map_offset + 0.5f);
 
-			if (map[x][y] == TILE_DOOR && count_neighbors_of_type(x, y, TILE_FLOOR) != 2) {
+	s->collision_mask = collision_mask;
 
-				map[x][y] = TILE_WALL;
-				door_count--;
-				count++;
-			}
-		}
-	}
+	if (get_map_sprite(x, y) == s) {
 
-	//remove side-by-side doors
-	for (int x = 0; x < MAP_SIZE; x++) {
-		for (int y = 0; y < MAP_SIZE; y++) {
+		collision_map[MapIndex(x, y)] = collision_mask;
 
-			if (map[x][y] == TILE_DOOR && has_neighbor_of_type(x, y, TILE_DOOR)) {
+		//the tile might open a shorter path for mobs
+		if (collision_mask & COLLISION_FLOOR) {
 
-				map[x][y] = TILE_WALL;
-				door_count--;
-				count++;
-			}
+			flow_field_tile_opened(x, y);
+		}
+		else
+		{
+			invalidate_flow_field();
 		}
 	}
-	d_printf(LOG_INFO, "%s: fixed %d doors\n", __func__, count);
-}
-
-void remove_some_doors(void) {
-
-	int total = (int)(door_count * 0.6f);
-	int count = 0;
-	int x, y;
-
-	for (int i = 0; i < total; i++) {
-
-		pick_random_doors(&x, &y);
-
-		map[x][y] = TILE_FLOOR;
-
-		door_count--;
-		count++;
+	else
+	{
+		d_printf(LOG_WARNING, "%s: sprite is not a map tile\n", __func__);
 	}
-
-	d_printf(LOG_INFO, "%s: removed %d doors\n", __func__, count);
 }
 
 //----------
-// feature generation
+// map storage
 //----------
 
-void make_room_start_end(int start_x, int start_y, int end_x, int end_y) {
-
-	if(start_x < 0 || start_y < 0 || end_x >= MAP_SIZE || end_y >= MAP_SIZE) {
+//returns 1 if the tile coordinates are inside the current map
+int is_inside_map(int x, int y) {
 
-		d_printf(LOG_ERROR, "%s: room out of map bounds\n", __func__);
-		is_failed = 1;
-		return;
-	}
-
-	for (int x = start_x; x <= end_x; x++) {
-		for (int y = start_y; y <= end_y; y++) {
-
-			if (map[x][y] != TILE_EMPTY) {
-
-				if (map[x][y] == TILE_FLOOR) {
-
-					//should never happen: this means the room is misaligned
-					d_printf(LOG_ERROR, "%s: tile not empty\n", __func__);
-					is_failed = 1;
-				}
-
-				//walls or doors overlapping are fine
-				continue;
-			}
-
-			if (x == start_x || y == start_y || x == end_x || y == end_y) {
-
-				//edge is a wall
-				map[x][y] = TILE_WALL;
-			}
-			else
-			{
-				//inside is a floor
-				map[x][y] = TILE_FLOOR;
-				floor_count++;
-			}
-		}
-	}
-
-	//add doors
-	add_random_doors(start_x, start_y, end_x, end_y);
+	return x >= 0 && y >= 0 && x < map_size && y < map_size;
 }
 
-//make room using a center point
-void make_room(int x_center, int y_center, int x_size, int y_size) {
+//returns the contents of the tile (nothing outside of the map)
+int get_map_contents(int x, int y) {
 
-	int start_x = x_center - x_size / 2;
-	int start_y = y_center - y_size / 2;
-
-	int end_x = x_center + x_size / 2;
-	int end_y = y_center + y_size / 2;
-
-	make_room_start_end(start_x, start_y, end_x, end_y);
+	return is_inside_map(x, y) ? map_contents[MapIndex(x, y)] : MAP_NOTHING;
 }
 
-//hallway is described as a start point and an end point
-void make_hallway(int start_x, int start_y, int end_x, int end_y) {
-
-	//no support for diagonal hallways
-	if (start_x != end_x && start_y != end_y) {
-
-		d_printf(LOG_ERROR, "%s: hallway is diagonal\n", __func__);
-		is_failed = 1;
-		return;
-	}
-
-	//expand bounds in the correct direction
-	if (start_x == end_x) {
-
-		start_x--;
-		end_x++;
-	}
-	else
-	{
-		start_y--;
-		end_y++;
-	}
-
-	//went out of bounds...
-	if (start_x < 0 || start_y < 0 || end_x >= MAP_SIZE || end_y >= MAP_SIZE) {
-
-		d_printf(LOG_ERROR, "%s: hallway out of map bounds\n", __func__);
-		is_failed = 1;
-		return;
-	}
-
-	for (int x = start_x; x <= end_x; x++) {
-		for (int y = start_y; y <= end_y; y++) {
-
-			if (map[x][y] != TILE_EMPTY) {
-
-				continue;
-			}
+//returns the sprite of the tile (NULL outside of the map)
+sprite_t *get_map_sprite(int x, int y) {
 
-			if (x == start_x || y == start_y || x == end_x || y == end_y) {
-
-				map[x][y] = TILE_WALL;
-			}
-			else
-			{
-				map[x][y] = TILE_FLOOR;
-				floor_count++;
-			}
-		}
-	}
-
-	//add doors
-	add_random_doors(start_x, start_y, end_x, end_y);
+	return is_inside_map(x, y) ? sprite_map[MapIndex(x, y)] : NULL;
 }
 
-//tries to add a room or a hallway starting from a door
-void make_feature(void) {
-
-	//door coordinates
-	int x0 = 0;
-	int y0 = 0;
-
-	//feature expansion direction
-	int direction;
-
-	int i, offset;
-	int mins_x, mins_y;
-	int maxs_x, maxs_y;
-	int offset_x, offset_y;
-
-	//is this a room or a hallway feature?
-	int is_room = RandomBool;
-
-	//try find a door with nothing on the other side
-	for (i = 0; i < 500; i++) {
-
-		pick_random_doors(&x0, &y0);
-
-		//make sure the picked door leads to an empty space
-		direction = has_neighbor_of_type(x0, y0, TILE_EMPTY);
-
-		if (direction) {
-
-			break;
-		}
-	}
-	if (i == 500) {
-
-		//this is fine
-		//d_printf(LOG_TEXT, "%s: failed to make a feature\n", __func__);
-		return;
-	}
-
-	if (is_room) {
-
-		//find room coordinates
-		for (i = 0; i < 100; i++) {
-
-			//room size
-			offset_x = Random(MIN_FEATURE_SIZE, MAX_FEATURE_SIZE);
-			offset_y = Random(MIN_FEATURE_SIZE, MAX_FEATURE_SIZE);
-
-			MakeOddNumber(offset_x);
-			MakeOddNumber(offset_y);
-
-			//door edge offset
-			offset = Random(0, ((direction & AXIS_X ? offset_x : offset_y) / 2) - 1);
-			offset = 0;
-
-			//room bounds
-			mins_x = direction & AXIS_X ? (direction & DIR_NEGATIVE ? x0 - offset_x : x0) : x0 - offset_x / 2;
-			mins_y = direction & AXIS_X ? y0 - offset_x / 2 : (direction & DIR_NEGATIVE ? y0 - offset_y : y0);
-			maxs_x = mins_x + offset_x;
-			maxs_y = mins_y + offset_y;
-
-			if (mins_x < 0 || mins_y < 0 || maxs_x >= MAP_SIZE || maxs_y >= MAP_SIZE) {
-
-				//out of bounds, try again
-				continue;
-			}
-
-			if (!is_overlapping(mins_x, mins_y, maxs_x, maxs_y)) {
-
-				//valid room
-				break;
-			}
-		}
-
-		if (i == 100) {
-
-			//this is fine
-			//d_printf(LOG_TEXT, "%s: failed to make room\n", __func__);
-			return;
-		}
-
-		make_room_start_end(mins_x, mins_y, maxs_x, maxs_y);
-	}
-	else
-	{
-		//find hallway coordinates
-		for (i = 0; i < 100; i++) {
-
-			//hallway length
-			offset = Random(MIN_FEATURE_SIZE, MAX_FEATURE_SIZE);
-
-			offset_x = x0 + (direction & AXIS_X ? (offset * (direction & DIR_NEGATIVE ? -1 : 1)) : 0);
-			offset_y = y0 + (direction & AXIS_X ? 0 : (offset * (direction & DIR_NEGATIVE ? -1 : 1)));
-
-			//hallway bounds
-			mins_x = direction & DIR_NEGATIVE ? offset_x : x0;
-			mins_y = direction & DIR_NEGATIVE ? offset_y : y0;
-			maxs_x = direction & DIR_NEGATIVE ? x0 : offset_x;
-			maxs_y = direction & DIR_NEGATIVE ? y0 : offset_y;
-
-			if (!is_overlapping(mins_x, mins_y, maxs_x, maxs_y)) {
+//returns the collision mask of the tile (walls outside of the map)
+int get_collision_mask(int x, int y) {
 
-				//valid hallway
-				break;
-			}
-		}
-
-		if (i == 100) {
+	return is_inside_map(x, y) ? collision_map[MapIndex(x, y)] : COLLISION_WALL;
+}
 
-			//this is fine
-			//d_printf(LOG_TEXT, "%s: failed to make hallway\n", __func__);
-			return;
-		}
+//returns the type of the tile (empty outside of the map)
+int get_map_tile(int x, int y) {
 
-		make_hallway(mins_x, mins_y, maxs_x, maxs_y);
-	}
+	return is_inside_map(x, y) ? map[MapIndex(x, y)] : TILE_EMPTY;
 }
 
-//----------
-// water
-//----------
+//returns the visibility of the tile (from the sprite if it exists, otherwise from the kept state)
+int get_tile_visibility(int x, int y) {
 
-//recursively fills neighbor tiles with water
-void flood_fill_water(int x, int y) {
+	sprite_t *s = get_map_sprite(x, y);
 
-	int x0, y0;
-	
-	if (map[x][y] == TILE_FLOOR) {
+	if (s) {
 
-		floor_count--;
+		return s->visibility;
 	}
+	return is_inside_map(x, y) ? tile_states[MapIndex(x, y)].visibility : VIS_HIDDEN;
+}
 
-	map[x][y] = TILE_WATER;
-
-	for (int i = 0; i < 4; i++) {
+//returns 1 if the tile object (door or chest) was already used
+int is_tile_used(int x, int y) {
 
-		x0 = x + (i % 2) * (i > 1 ? 1 : -1);
-		y0 = y + (!(i % 2)) * (i > 1 ? 1 : -1);
+	sprite_t *s = get_map_sprite(x, y);
 
-		if (map[x0][y0] != TILE_WATER && !has_neighbor_of_type(x0, y0, TILE_WALL) && !has_neighbor_of_type(x0, y0, TILE_DOOR) && 
-			!has_neighbor_of_type(x0, y0, TILE_LOCK_DOOR) && !has_neighbor_of_type(x0, y0, TILE_CHEST) &&
-			x0 != MAP_OFFSET && y0 != MAP_OFFSET && RandomBool) {
+	if (s) {
 
-			flood_fill_water(x0, y0);
-		}
+		return !s->action;
 	}
+	return is_inside_map(x, y) && (tile_states[MapIndex(x, y)].flags & TILE_STATE_USED);
 }
 
-//creates water on the map
-void add_water_pools(void) {
+//allocates a zeroed map array, returns 0 if out of memory
+int alloc_map_array(void **array, size_t element_size) {
 
-	int skip;
-	int current;
-	int water_count = 0;
+	free(*array);
+	*array = calloc((size_t)map_size * map_size, element_size);
 
-	for (int i = 0; i < 300; i++) {
+	if (!*array) {
 
-restart:
-		skip = Random(0, floor_count); //pick a random number of floor tiles to skip
-		current = 0;
-		for (int x = 0; x < MAP_SIZE; x++) {
-			for (int y = 0; y < MAP_SIZE; y++) {
-
-				if (current == skip && map[x][y] == TILE_FLOOR && 
-					!has_neighbor_of_type(x, y, TILE_WALL) && !has_neighbor_of_type(x, y, TILE_DOOR) && !has_neighbor_of_type(x, y, TILE_WATER) && !has_neighbor_of_type(x, y, TILE_LOCK_DOOR) &&
-					!has_neighbor_of_type(x, y, TILE_CHEST) &&
-					(x > MAP_OFFSET + MAP_SAFE_ZONE || x < MAP_OFFSET - MAP_SAFE_ZONE) && (y > MAP_OFFSET + MAP_SAFE_ZONE || y < MAP_OFFSET - MAP_SAFE_ZONE) ) {
-
-					flood_fill_water(x, y);
-					water_count++;
-
-					i++;
-					goto restart;
-				}
-				if (map[x][y] == TILE_FLOOR) {
-
-					current++;
-				}
-			}
-		}
-	}
-
-	if (water_count) {
-
-		d_printf(LOG_INFO, "%s: map with %d water pools\n", __func__, water_count);
-	}
-	else
-	{
-		d_printf(LOG_INFO, "%s: map with no water\n", __func__);
+		out_of_memory_error(__func__);
+		return 0;
 	}
+	return 1;
 }
 
-//----------
-// exit
-//----------
-
-void make_exit(void) {
-
-	//pick a random floor tile
-	int skip = Random(0, floor_count);
-	int current = 0;
-	int i, x, y;
-
-	for (i = 0; i < 15000; i++) {
-
-		current = 0;
-		for (x = 0; x < MAP_SIZE; x++) {
-			for (y = 0; y < MAP_SIZE; y++) {
+//changes the map dimensions and reallocates all map arrays (the map sprites must be cleared before)
+void set_map_size(int size) {
 
-				if (current == skip) {
+	if (size == map_size) {
 
-					//keep the "small" safe zone in mind
-					if (map[x][y] == TILE_FLOOR &&
-						(x > MAP_OFFSET + MAP_SAFE_ZONE / 2 || x < MAP_OFFSET - MAP_SAFE_ZONE / 2) &&
-						(y > MAP_OFFSET + MAP_SAFE_ZONE / 2 || y < MAP_OFFSET - MAP_SAFE_ZONE / 2) &&
-						map_contents[x][y] == MAP_NOTHING) {
+		return;
+	}
 
-						map[x][y] = TILE_EXIT;
-						floor_count--;
+	d_printf(LOG_INFO, "%s: map size %dx%d\n", __func__, size, size);
 
-						d_printf(LOG_INFO, "%s: dungeon exit at [%d, %d]\n", __func__, x - MAP_OFFSET, y - MAP_OFFSET);
-						return;
-					}
-				}
+	map_size = size;
+	map_offset = size / 2;
 
-				if (map[x][y] == TILE_FLOOR) {
+	if (!alloc_map_array((void **)&sprite_map, sizeof(sprite_t *)) ||
+		!alloc_map_array((void **)&collision_map, sizeof(int)) ||
+		!alloc_map_array((void **)&tile_states, sizeof(tile_state_t))) {
 
-					current++;
-				}
-			}
-		}
+		return;
 	}
 
-	d_printf(LOG_ERROR, "%s: failed to make dungeon exit!\n", __func__);
-	is_failed = 1;
+	//tile data of the other modules
+	resize_pick_map();
+	resize_fov_map();
+	resize_visibility_map();
+	resize_flow_field();
 }
 
 //----------
-// map contents
+// generation
 //----------
 
-//adds a random item
-void make_item(int x, int y) {
+//worker job: creates the map requested by pregenerate_map
+void pregenerate_job(void *arg) {
 
-	int random = Random(1, 8);
+	pregenerated_map_t *next = arg;
 
-	if (random > 6) {
+	if (prepare_map_generator(&next->generator, next->level)) {
 
-		map_contents[x][y] = MAP_ITEM_SWORD;
+		run_map_generator(&next->generator, next->seed);
 	}
-	else if(random > 3)
-	{
-		map_contents[x][y] = MAP_ITEM_SHIELD;
-	}
-	else {
-
-		map_contents[x][y] = MAP_ITEM_POTION_HP;
-	}
-}
-
-//adds a random mob
-void make_mob(int x, int y) {
-
-	map_contents[x][y] = RandomBool ? MAP_MOB_SLIME : MAP_MOB_GOBLIN;
 }
 
+//returns the slot of the map of the given level and seed (being created or ready), NULL if it wasn't requested
+pregenerated_map_t *find_pregenerated_map(int level, unsigned int seed) {
 
-//randomly puts the given amount of content on the map
-void add_contents_of_type(int type, int count) {
-
-	int skip;
-	int current;
-	int total_attempts = 0;
-	int i = 0;
-
-	//place contents
-restart:
-	while (i < count) {
-
-		if (total_attempts > 1000) {
-
-			d_printf(LOG_TEXT, "%s: too many total attempts\n", __func__);
-			break;
-		}
-
-		skip = Random(0, floor_count); //amount of floor tiles to skip
-		current = 0;
-		for (int x = 0; x < MAP_SIZE; x++) {
-			for (int y = 0; y < MAP_SIZE; y++) {
-
-				if (current == skip) {
-
-					if (map[x][y] == TILE_FLOOR &&												//must be on the floor
-						(x > MAP_OFFSET + MAP_SAFE_ZONE || x < MAP_OFFSET - MAP_SAFE_ZONE) &&	//keep the safe zone in mind - mobs spawning next to a player are bad
-						(y > MAP_OFFSET + MAP_SAFE_ZONE || y < MAP_OFFSET - MAP_SAFE_ZONE) &&
-						map_contents[x][y] == MAP_NOTHING &&									//make sure nothing is placed on this tile
-						!neighbor_has_content_of_type(x, y, type) &&							//don't spawn side by side with another content of the same type
-						!has_neighbor_of_type(x, y, TILE_DOOR)) {								//don't spawn next to a door
-
-						switch (type)
-						{
-							case CONTENT_ITEM:
-								make_item(x, y);
-								break;
-							case CONTENT_MOB:
-								make_mob(x, y);
-								break;
-						}
-
-						//next
-						i++;
-						goto restart;
-					}
-					total_attempts++;
-				}
+	for (int i = 0; i < PREGENERATED_MAPS; i++) {
 
-				if (map[x][y] == TILE_FLOOR) {
+		if (next_maps[i].level == level && next_maps[i].seed == seed) {
 
-					current++;
-				}
-			}
+			return &next_maps[i];
 		}
 	}
+	return NULL;
 }
 
-void add_map_contents(void) {
-
-	int count;
-
-	//items
-	count = Random(MAX_ITEMS / 2, MAX_ITEMS);
-	d_printf(LOG_INFO, "%s: placing %d items...\n", __func__, count);
-	add_contents_of_type(CONTENT_ITEM, count);
-
-	//mobs
-	count = Random(MAX_MOBS / 2, MAX_MOBS);
-	d_printf(LOG_INFO, "%s: placing %d mobs...\n", __func__, count);
-	add_contents_of_type(CONTENT_MOB, count);
-}
-
-//----------
-// locked room
-//----------
-
-void make_locked_room_chest(int x_min, int y_min, int x_max, int y_max) {
+//starts creating the map of the given level and seed in the background (picked up by generate_map), never waits for a job
+void pregenerate_map(int level, unsigned int seed) {
 
-	//pick a random position inside the locked room
-	int x = Random(x_min + 1, x_max - 1);
-	int y = Random(y_min + 1, y_max - 1);
+	pregenerated_map_t *next = find_pregenerated_map(level, seed);
 
-	map[x][y] = TILE_CHEST;
-	floor_count--;
+	if (next) {
 
-	d_printf(LOG_INFO, "%s: chest at [%d, %d]\n", __func__, x, y);
-}
-
-void make_locked_room(void) {
-
-	int x0 = 1, y0 = 1;
-	int i, direction, offset_x, offset_y, mins_x, mins_y, maxs_x, maxs_y;
-	//try find a door with nothing on the other side
-	for (i = 0; i < 500; i++) {
-
-		pick_random_doors(&x0, &y0);
-
-		//make sure the picked door leads to an empty space
-		direction = has_neighbor_of_type(x0, y0, TILE_EMPTY);
-
-		if (direction) {
-
-			break;
-		}
-	}
-	if (i == 500) {
-
-		//this is fine
-		d_printf(LOG_ERROR, "%s: failed to make the locked room\n", __func__);
+		//already requested, the job (or its result) is reused
 		return;
 	}
 
-	//find room coordinates
-	for (i = 0; i < 100; i++) {
-
-		//room size
-		offset_x = Random(MIN_FEATURE_SIZE, MAX_FEATURE_SIZE);
-		offset_y = Random(MIN_FEATURE_SIZE, MAX_FEATURE_SIZE);
+	//a free slot or one with a finished job (its map was dropped)
+	for (int i = 0; i < PREGENERATED_MAPS && !next; i++) {
 
-		MakeOddNumber(offset_x);
-		MakeOddNumber(offset_y);
+		if (!next_maps[i].worker.is_running || is_worker_done(&next_maps[i].worker)) {
 
-		//room bounds
-		mins_x = direction & AXIS_X ? (direction & DIR_NEGATIVE ? x0 - offset_x : x0) : x0 - offset_x / 2;
-		mins_y = direction & AXIS_X ? y0 - offset_x / 2 : (direction & DIR_NEGATIVE ? y0 - offset_y : y0);
-		maxs_x = mins_x + offset_x;
-		maxs_y = mins_y + offset_y;
-
-		if (mins_x < 0 || mins_y < 0 || maxs_x >= MAP_SIZE || maxs_y >= MAP_SIZE) {
-
-			//out of bounds, try again
-			continue;
+			next = &next_maps[i];
 		}
-
-		if (!is_overlapping(mins_x, mins_y, maxs_x, maxs_y)) {
-
-			for (int x1 = mins_x; x1 < maxs_x; x1++) {
-
-				if (x1 != x0 && (map[x1][mins_y] == TILE_DOOR || map[x1][maxs_y] == TILE_DOOR)) {
-
-					//has random door somewhere
-					continue;
-				}
-			}
-			for (int y1 = mins_y; y1 < maxs_y; y1++) {
-
-				if (y1 != y0 && (map[mins_x][y1] == TILE_DOOR || map[maxs_x][y1] == TILE_DOOR)) {
-
-					//has random door somewhere
-					continue;
-				}
-			}
-
-			//valid room
-			break;
-		}
-	}
-	if (i == 100) {
-
-		d_printf(LOG_ERROR, "%s: couldn't fit a room\n", __func__);
-		is_failed = 1;
-		return;
 	}
 
-	if (mins_x < 0 || mins_y < 0 || maxs_x >= MAP_SIZE || maxs_y >= MAP_SIZE) {
+	if (!next) {
 
-		d_printf(LOG_ERROR, "%s: room out of map bounds\n", __func__);
-		is_failed = 1;
+		d_printf(LOG_WARNING, "%s: the dropped maps are still being created, the next map will be generated on demand\n", __func__);
 		return;
 	}
 
-	for (int x = mins_x; x <= maxs_x; x++) {
-		for (int y = mins_y; y <= maxs_y; y++) {
-
-			if (map[x][y] != TILE_EMPTY) {
+	//releases the thread of the finished job
+	wait_worker(&next->worker);
 
-				if (map[x][y] == TILE_FLOOR) {
+	next->level = level;
+	next->seed = seed;
 
-					//should never happen: this means the room is misaligned
-					d_printf(LOG_ERROR, "%s: tile not empty\n", __func__);
-					is_failed = 1;
-				}
-				else if (map[x][y] == TILE_DOOR) {
+	if (!start_worker(&next->worker, pregenerate_job, next)) {
 
-					map[x][y] = TILE_WALL; //seal all other entrances
-				}
-
-				//walls or doors overlapping are fine
-				continue;
-			}
-
-			if (x == mins_x || y == mins_y || x == maxs_x || y == maxs_y) {
-
-				//edge is a wall
-				map[x][y] = TILE_WALL;
-			}
-			else
-			{
-				//inside is a floor
-				map[x][y] = TILE_FLOOR;
-				map_contents[x][y] = MAP_ITEM_LOCK_ROOM;
-				floor_count++;
-			}
-		}
+		next->level = 0;
+		d_printf(LOG_WARNING, "%s: the next map will be generated on demand\n", __func__);
 	}
-
-	map[x0][y0] = TILE_LOCK_DOOR;
-	door_count--;
-
-	make_locked_room_chest(mins_x, mins_y, maxs_x, maxs_y);
-
-	d_printf(LOG_INFO, "%s: locked door at [%d, %d]\n", __func__, x0, y0);
 }
 
-//----------
-// sprite builder
-//----------
-
-//generates tile sprites from the map array
-void build_sprites(void) {
-
-	sprite_t *s;
-	texname tname;
-	int collision_mask;
-	int anim_pause;
-	int rotation;
-	void (*action)(sprite_t *s);
-	void *object_data;
-
-	//for each tile...
-	for (int x = 0; x < MAP_SIZE; x++) {
-		for (int y = 0; y < MAP_SIZE; y++) {
-
-			anim_pause = 0;
-			rotation = 0;
-			action = NULL;
-			object_data = NULL;
-
-			switch (map[x][y])
-			{
-				case TILE_WALL:
-					tname = WALL;
-					collision_mask = COLLISION_WALL;
-					break;
-				case TILE_FLOOR:
-					tname = ROCK;
-					collision_mask = COLLISION_FLOOR;
-					rotation = Random(0, 3);
-					break;
-				case TILE_WATER:
-					tname = WATER;
-					collision_mask = COLLISION_WATER;
-					rotation = Random(0, 3);
-					break;
-				case TILE_DOOR:
-					tname = DOOR;
-					anim_pause = 1;
-					collision_mask = COLLISION_OBSTACLE;
-					action = door_action;
-					break;
-				case TILE_LOCK_DOOR:
-					tname = LOCKED_DOOR;
-					anim_pause = 1;
-					collision_mask = COLLISION_OBSTACLE;
-					action = locked_door_action;
-					break;
-				case TILE_EXIT:
-					tname = LEVEL_EXIT;
-					anim_pause = 1;
-					collision_mask = COLLISION_FLOOR;
-					action = next_level_action;
-					break;
-				case TILE_CHEST:
-					tname = CHEST;
-					anim_pause = 1;
-					collision_mask = COLLISION_FLOOR;
-					action = chest_action;
-					if (RandomBool) {
-
-						object_data = malloc(sizeof(int)); //armor chest type
-					}
-					break;
-				default:
-					continue;
-			}
-
-			//create a new sprite
-			s = new_sprite();
-
-			vec2_t position;
-			position[VEC_X] = (float)((x * SPRITE_SIZE * 2) - MAP_OFFSET); //map has an offset (the real center is at [0, 0] but
-			position[VEC_Y] = (float)((y * SPRITE_SIZE * 2) - MAP_OFFSET); //the array can't have negative indexes)
+//waits until the map of the given level and seed is created in the background (the tools use it to test the pregenerated maps)
+void wait_pregenerated_map(int level, unsigned int seed) {
 
-			Vec2Copy(position, s->position);
+	pregenerated_map_t *next = find_pregenerated_map(level, seed);
 
-			s->tex_id = get_texture_id(tname);
-			s->framecount = get_texture_framecount(tname);
-			s->render_layer = get_texture_render_layer(tname);
-			s->frame_msec = get_texture_frametime(tname);
-			s->render_layer = get_texture_render_layer(tname);
-			s->animation_pause = anim_pause;
-			s->collision_mask = collision_mask;
-			s->action = action;
-			s->rotation = rotation;
-			s->object_data = object_data;
+	if (next) {
 
-			sprite_map[x][y] = s;
-		}
+		wait_worker(&next->worker);
 	}
 }
 
-//removes all map sprites before creating a new map
-void clear_sprite_map(void) {
+//moves the map created in the background to the current map generator, returns 0 if it's not ready or not requested
+int take_pregenerated_map(int level, unsigned int seed) {
 
-	for (int x = 0; x < MAP_SIZE; x++) {
-		for (int y = 0; y < MAP_SIZE; y++) {
+	pregenerated_map_t *next = find_pregenerated_map(level, seed);
+	map_generator_t swap;
 
-			if (sprite_map[x][y]) {
+	if (!next) {
 
-				delete_sprite(sprite_map[x][y]);
-			}
-		}
+		return 0;
 	}
 
-	//wipe all data
-	memset(&sprite_map, 0, sizeof(sprite_t *) * MAP_SIZE * MAP_SIZE);
-}
-
-//creates a new map
-void generate_map(void) {
-
-	int tile_count = 0;
-
-	d_printf(LOG_INFO, "%s: generating a map...\n", __func__);
-
-	srand((unsigned int)time(NULL));
-
-	clear_sprite_map();
-
-	//compensate for the small chance of map generator failure
-	for (int k = 0; k < 10; k++) { //10 attempts should be enough?
-
-		//reset counters
-		is_failed = 0;
-		door_count = 0;
-		floor_count = 0;
-		has_lock_room = 0;
+	if (!is_worker_done(&next->worker)) {
 
-		//wipe map data
-		memset(&map, TILE_EMPTY, sizeof(int) * MAP_SIZE * MAP_SIZE);
-		memset(&map_contents, 0, sizeof(int) * MAP_SIZE * MAP_SIZE);
-
-		//make center room
-		make_room(MAP_OFFSET, MAP_OFFSET, Random(MIN_FEATURE_SIZE, MAX_FEATURE_SIZE), Random(MIN_FEATURE_SIZE, MAX_FEATURE_SIZE));
-
-		//500 attempts to make a feature (usually enough for MAP_BUDGET < 2000)
-		for (int i = 0; i < 500; i++) {
-
-			make_feature();
-
-			tile_count = count_tiles_of_not_type(TILE_EMPTY);
-			if (tile_count > MAP_BUDGET) {
-
-				break;
-			}
-		}
+		//don't wait: the job is left running in its slot and its result is dropped
+		d_printf(LOG_WARNING, "%s: the next map is not ready yet\n", __func__);
+		return 0;
+	}
 
-		if (is_failed || tile_count < MAP_BUDGET) {
+	wait_worker(&next->worker);
 
-			d_printf(LOG_ERROR, "%s: map budget not met: %d tiles out of %d\n", __func__, tile_count, MAP_BUDGET);
-			goto retry;
-		}
+	if (!next->generator.tiles) {
 
-		//add locked room
-		make_locked_room();
+		return 0;
+	}
 
-		//remove redundant doors
-		fix_doors();
+	//the old grids are reused for the next map
+	swap = level_generator;
+	level_generator = next->generator;
+	next->generator = swap;
+	next->level = 0;
 
-		if (is_failed) {
+	return 1;
+}
 
-			goto retry;
-		}
+//creates a new map of the level from the seed (uses the map generated in the background if there is one)
+void generate_map(unsigned int seed, int level) {
 
-		//add water tiles
-		add_water_pools();
+	rng_t rng;
 
-		//make an exit
-		make_exit();
+	clear_sprite_map();
 
-		//remove some doors to make the map feel more open
-		remove_some_doors();
+	if (take_pregenerated_map(level, seed)) {
 
-		if (!is_failed) {
+		d_printf(LOG_INFO, "%s: using the pregenerated map (seed %u)\n", __func__, seed);
+	}
+	else
+	{
+		if (!prepare_map_generator(&level_generator, level)) {
 
-			break;
+			return;
 		}
 
-retry:
-		if (k < 4) {
-
-			d_printf(LOG_WARNING, "%s: failed to generate the map, retrying... (%d tiles)\n", __func__, tile_count);
-		}
+		run_map_generator(&level_generator, seed);
 	}
 
-	//still failed...
-	if (is_failed) {
+	set_map_size(level_generator.size);
 
-		d_printf(LOG_ERROR, "%s: failed to generate the map (%d tiles)\n", __func__, tile_count);
-	}
-	
-	d_printf(LOG_INFO, "%s: map tiles: %d\n", __func__, tile_count);
+	map = level_generator.tiles;
+	map_contents = level_generator.contents;
 
-	//set map contents
-	add_map_contents();
-
-	//build the sprite map
-	build_sprites();
-}
\ No newline at end of file
+	//prepare the tiles (sprites are created around the player)
+	rng_seed(&rng, seed, RNG_STREAM_TILES);
+	build_tile_states(&rng);
+}
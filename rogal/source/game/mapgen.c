@@ -0,0 +1,1115 @@
+/*
+* This file contains the map generator.
+*
+* The generator works on a map_generator_t context that owns the tile and
+* contents grids, the tile counters and the random state. Nothing here touches
+* the game state (sprites, mobs, the current map), so a map can be created for
+* benchmarks or ahead of time and the same seed always gives the same map.
+* map.c turns the finished grids into the playable map.
+*/
+
+#include "mapgen.h"
+#include <string.h>
+#include <stdlib.h>
+
+//creates an odd number from any number (never returns a zero)
+#define MakeOddNumber(in) ((in) = (in) % 2 ? (in) : ((in) >= 0 ? (in) + 1 : (in) - 1))
+
+//directions from tile
+#define DIR_E	1		//x++ east
+#define DIR_S	(1<<1)	//y-- south
+#define DIR_W	(1<<2)	//x-- west
+#define DIR_N	(1<<3)	//y++ north
+
+//direction axes
+#define AXIS_X (DIR_E | DIR_W)
+#define AXIS_Y (DIR_S | DIR_N)
+
+//direction signs
+#define DIR_NEGATIVE (DIR_S | DIR_W)
+#define DIR_POSITIVE (DIR_E | DIR_N)
+
+//content types
+#define CONTENT_MOB			0
+#define CONTENT_ITEM		1
+
+//----------
+// helper functions
+//----------
+
+//returns a direction of the content
+//the idea is that map items are bit shifted and mobs are on the lesser bits - unshifting will yeld 0 for mobs and > 0 if there's an item on the tile
+int neighbor_has_content_of_type(map_generator_t *gen, int x, int y, int type) {
+
+	if (x < gen->size - 1 && ((type == CONTENT_ITEM) ? (gen->contents[GenIndex(gen, x + 1, y)] >> MAP_ITEM_BYTE_OFFSET) : (gen->contents[GenIndex(gen, x + 1, y)] & 0xff))) {
+
+		return DIR_E;
+	}
+	if (y > 0 && ((type == CONTENT_ITEM) ? (gen->contents[GenIndex(gen, x, y - 1)] >> MAP_ITEM_BYTE_OFFSET) : (gen->contents[GenIndex(gen, x, y - 1)] & 0xff))) {
+
+		return DIR_S;
+	}
+	if (x > 0 && ((type == CONTENT_ITEM) ? (gen->contents[GenIndex(gen, x - 1, y)] >> MAP_ITEM_BYTE_OFFSET) : (gen->contents[GenIndex(gen, x - 1, y)] & 0xff))) {
+
+		return DIR_W;
+	}
+	if (y < gen->size - 1 && ((type == CONTENT_ITEM) ? (gen->contents[GenIndex(gen, x, y + 1)] >> MAP_ITEM_BYTE_OFFSET) : (gen->contents[GenIndex(gen, x, y + 1)] & 0xff))) {
+
+		return DIR_N;
+	}
+	return 0;
+}
+
+//returns a direction of the neighbor
+int has_neighbor_of_type(map_generator_t *gen, int x, int y, int type) {
+
+	if (x < gen->size - 1 && gen->tiles[GenIndex(gen, x + 1, y)] == type) {
+
+		return DIR_E;
+	}
+	if (y > 0 && gen->tiles[GenIndex(gen, x, y - 1)] == type) {
+
+		return DIR_S;
+	}
+	if (x > 0 && gen->tiles[GenIndex(gen, x - 1, y)] == type) {
+
+		return DIR_W;
+	}
+	if (y < gen->size - 1&& gen->tiles[GenIndex(gen, x, y + 1)] == type) {
+		
+		return DIR_N;
+	}
+	return 0;
+}
+
+int count_neighbors_contents(map_generator_t *gen, int x, int y, int content) {
+
+	int count = 0;
+
+	if (x < gen->size - 1 && gen->contents[GenIndex(gen, x + 1, y)] == content) {
+
+		count++;
+	}
+	if (y > 0 && gen->contents[GenIndex(gen, x, y - 1)] == content) {
+
+		count++;
+	}
+	if (x > 0 && gen->contents[GenIndex(gen, x - 1, y)] == content) {
+
+		count++;
+	}
+	if (y < gen->size - 1 && gen->contents[GenIndex(gen, x, y + 1)] == content) {
+
+		count++;
+	}
+	return count;
+}
+
+int count_neighbors_of_type(map_generator_t *gen, int x, int y, int type) {
+
+	int count = 0;
+
+	if (x < gen->size - 1 && gen->tiles[GenIndex(gen, x + 1, y)] == type) {
+
+		count++;
+	}
+	if (y > 0 && gen->tiles[GenIndex(gen, x, y - 1)] == type) {
+
+		count++;
+	}
+	if (x > 0 && gen->tiles[GenIndex(gen, x - 1, y)] == type) {
+
+		count++;
+	}
+	if (y < gen->size - 1 && gen->tiles[GenIndex(gen, x, y + 1)] == type) {
+
+		count++;
+	}
+	return count;
+}
+
+int count_tiles_of_type(map_generator_t *gen, int type) {
+
+	return gen->tile_counts[type];
+}
+
+int count_tiles_of_not_type(map_generator_t *gen, int type) {
+
+	return gen->size * gen->size - gen->tile_counts[type];
+}
+
+//----------
+// tile bookkeeping
+//----------
+
+//returns the list that keeps tiles of the given type (NULL if the type isn't listed)
+int *get_tile_list(map_generator_t *gen, int type) {
+
+	switch (type)
+	{
+		case TILE_FLOOR:
+			return gen->floor_tiles;
+		case TILE_DOOR:
+			return gen->door_tiles;
+		default:
+			return NULL;
+	}
+}
+
+//changes a map tile and updates the counters and tile lists
+void set_gen_tile(map_generator_t *gen, int x, int y, int type) {
+
+	int *list;
+	int old_type = gen->tiles[GenIndex(gen, x, y)];
+	int index, last;
+
+	if (old_type == type) {
+
+		return;
+	}
+
+	//remove from the old list (the last tile of the list takes its place)
+	list = get_tile_list(gen, old_type);
+
+	if (list) {
+
+		index = gen->tile_list_index[GenIndex(gen, x, y)];
+		last = list[gen->tile_counts[old_type] - 1];
+
+		list[index] = last;
+		gen->tile_list_index[last] = index;
+	}
+	gen->tile_counts[old_type]--;
+
+	//add to the new list
+	list = get_tile_list(gen, type);
+
+	if (list) {
+
+		gen->tile_list_index[GenIndex(gen, x, y)] = gen->tile_counts[type];
+		list[gen->tile_counts[type]] = GenIndex(gen, x, y);
+	}
+	gen->tile_counts[type]++;
+
+	gen->tiles[GenIndex(gen, x, y)] = type;
+}
+
+//wipes the map tiles and resets the counters
+void reset_gen_tiles(map_generator_t *gen) {
+
+	memset(gen->tiles, TILE_EMPTY, sizeof(int) * gen->size * gen->size);
+	memset(&gen->tile_counts, 0, sizeof(gen->tile_counts));
+
+	gen->tile_counts[TILE_EMPTY] = gen->size * gen->size;
+}
+
+//picks a random tile of a listed type, returns 0 if there are no such tiles
+int pick_random_tile(map_generator_t *gen, int type, int *out_x, int *out_y) {
+
+	int *list = get_tile_list(gen, type);
+	int tile;
+
+	if (!list || !gen->tile_counts[type]) {
+
+		return 0;
+	}
+
+	tile = list[rng_range(&gen->rng, 0, gen->tile_counts[type] - 1)];
+
+	*out_x = tile / gen->size;
+	*out_y = tile % gen->size;
+	return 1;
+}
+
+//returns 1 if the given bounds overlap another room/hallway space
+int is_overlapping(map_generator_t *gen, int x_start, int y_start, int x_end, int y_end) {
+
+	//keep the bounds inside the map array
+	if (x_start < 0 || y_start < 0 || x_end >= gen->size || y_end >= gen->size) {
+
+		return 1;
+	}
+
+	//check every tile within bounds
+	for (int x = x_start; x <= x_end; x++) {
+		for (int y = y_start; y <= y_end; y++) {
+
+			if (gen->tiles[GenIndex(gen, x, y)] != TILE_EMPTY && gen->tiles[GenIndex(gen, x, y)] != TILE_WALL && gen->tiles[GenIndex(gen, x, y)] != TILE_DOOR) { //ignore walls and doors!
+
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+//----------
+// doors
+//----------
+
+void add_random_doors(map_generator_t *gen, int start_x, int start_y, int end_x, int end_y) {
+
+	int coord, x, y;
+	int random_side = rng_range(&gen->rng, 0, 3); //make sure at least one door is created
+
+	//bounds edge is 3 units or less long?
+	int x_is_tiny = abs(start_x - end_x) < 3;
+	int y_is_tiny = abs(start_y - end_y) < 3;
+
+	//for each direction pick random entrances
+	for (int i = 0; i < 4; i++) {
+
+		if (RngBool(&gen->rng) || i == random_side) {
+
+			random_side = -1; //no need to force door anymore
+
+			// a wall with length 3 can only have doors in the middle
+			if ((i < 2 && x_is_tiny) ||
+				y_is_tiny) {
+
+				coord = (i < 2 ? start_x : start_y) + 1;
+			}
+			else
+			{
+				//pick random coordinate along the edge
+				coord = (i < 2 ? start_x : start_y) + 1 + rng_next(&gen->rng) % ((i < 2 ? (end_x - start_x) : (end_y - start_y)) - 1);
+			}
+
+			//set door coordinates
+			x = (i < 2 ? coord : (i % 2 ? start_x : end_x));
+			y = (i >= 2 ? coord : (i % 2 ? start_y : end_y));
+
+			if (gen->tiles[GenIndex(gen, x, y)] != TILE_WALL) {
+
+				if (gen->tiles[GenIndex(gen, x, y)] != TILE_DOOR) { //picking already created doors is not an issue
+
+					//should never happen: this means the generator is broken (rooms overlapping / doors in an empty space)
+					d_printf(LOG_ERROR, "%s: door not in a wall\n", __func__);
+					gen->is_failed = 1;
+				}
+				continue;
+			}
+
+			set_gen_tile(gen, x, y, TILE_DOOR);
+		}
+	}
+}
+
+void pick_random_doors(map_generator_t *gen, int *out_x, int *out_y) {
+
+	if (!pick_random_tile(gen, TILE_DOOR, out_x, out_y)) {
+
+		d_printf(LOG_ERROR, "%s: found no door\n", __func__);
+		gen->is_failed = 1;
+	}
+}
+
+//fixes doors after creating the map
+void fix_doors(map_generator_t *gen) {
+
+	int count = 0;
+	int x, y;
+
+	//the door lists are walked backwards: a removed door is replaced by the last door which is already checked
+
+	//remove doors to nowhere
+	for (int i = gen->tile_counts[TILE_DOOR] - 1; i >= 0; i--) {
+
+		x = gen->door_tiles[i] / gen->size;
+		y = gen->door_tiles[i] % gen->size;
+
+		if (count_neighbors_of_type(gen, x, y, TILE_FLOOR) != 2) {
+
+			set_gen_tile(gen, x, y, TILE_WALL);
+			count++;
+		}
+	}
+
+	//remove side-by-side doors
+	for (int i = gen->tile_counts[TILE_DOOR] - 1; i >= 0; i--) {
+
+		x = gen->door_tiles[i] / gen->size;
+		y = gen->door_tiles[i] % gen->size;
+
+		if (has_neighbor_of_type(gen, x, y, TILE_DOOR)) {
+
+			set_gen_tile(gen, x, y, TILE_WALL);
+			count++;
+		}
+	}
+	d_printf(LOG_INFO, "%s: fixed %d doors\n", __func__, count);
+}
+
+void remove_some_doors(map_generator_t *gen) {
+
+	int total = (int)(gen->tile_counts[TILE_DOOR] * 0.6f);
+	int count = 0;
+	int x = 0, y = 0;
+
+	for (int i = 0; i < total; i++) {
+
+		pick_random_doors(gen, &x, &y);
+
+		set_gen_tile(gen, x, y, TILE_FLOOR);
+
+		count++;
+	}
+
+	d_printf(LOG_INFO, "%s: removed %d doors\n", __func__, count);
+}
+
+//----------
+// feature generation
+//----------
+
+void make_room_start_end(map_generator_t *gen, int start_x, int start_y, int end_x, int end_y) {
+
+	if(start_x < 0 || start_y < 0 || end_x >= gen->size || end_y >= gen->size) {
+
+		d_printf(LOG_ERROR, "%s: room out of map bounds\n", __func__);
+		gen->is_failed = 1;
+		return;
+	}
+
+	for (int x = start_x; x <= end_x; x++) {
+		for (int y = start_y; y <= end_y; y++) {
+
+			if (gen->tiles[GenIndex(gen, x, y)] != TILE_EMPTY) {
+
+				if (gen->tiles[GenIndex(gen, x, y)] == TILE_FLOOR) {
+
+					//should never happen: this means the room is misaligned
+					d_printf(LOG_ERROR, "%s: tile not empty\n", __func__);
+					gen->is_failed = 1;
+				}
+
+				//walls or doors overlapping are fine
+				continue;
+			}
+
+			if (x == start_x || y == start_y || x == end_x || y == end_y) {
+
+				//edge is a wall
+				set_gen_tile(gen, x, y, TILE_WALL);
+			}
+			else
+			{
+				//inside is a floor
+				set_gen_tile(gen, x, y, TILE_FLOOR);
+			}
+		}
+	}
+
+	//add doors
+	add_random_doors(gen, start_x, start_y, end_x, end_y);
+}
+
+//make room using a center point
+void make_room(map_generator_t *gen, int x_center, int y_center, int x_size, int y_size) {
+
+	int start_x = x_center - x_size / 2;
+	int start_y = y_center - y_size / 2;
+
+	int end_x = x_center + x_size / 2;
+	int end_y = y_center + y_size / 2;
+
+	make_room_start_end(gen, start_x, start_y, end_x, end_y);
+}
+
+//hallway is described as a start point and an end point
+void make_hallway(map_generator_t *gen, int start_x, int start_y, int end_x, int end_y) {
+
+	//no support for diagonal hallways
+	if (start_x != end_x && start_y != end_y) {
+
+		d_printf(LOG_ERROR, "%s: hallway is diagonal\n", __func__);
+		gen->is_failed = 1;
+		return;
+	}
+
+	//expand bounds in the correct direction
+	if (start_x == end_x) {
+
+		start_x--;
+		end_x++;
+	}
+	else
+	{
+		start_y--;
+		end_y++;
+	}
+
+	//went out of bounds...
+	if (start_x < 0 || start_y < 0 || end_x >= gen->size || end_y >= gen->size) {
+
+		d_printf(LOG_ERROR, "%s: hallway out of map bounds\n", __func__);
+		gen->is_failed = 1;
+		return;
+	}
+
+	for (int x = start_x; x <= end_x; x++) {
+		for (int y = start_y; y <= end_y; y++) {
+
+			if (gen->tiles[GenIndex(gen, x, y)] != TILE_EMPTY) {
+
+				continue;
+			}
+
+			if (x == start_x || y == start_y || x == end_x || y == end_y) {
+
+				set_gen_tile(gen, x, y, TILE_WALL);
+			}
+			else
+			{
+				set_gen_tile(gen, x, y, TILE_FLOOR);
+			}
+		}
+	}
+
+	//add doors
+	add_random_doors(gen, start_x, start_y, end_x, end_y);
+}
+
+//tries to add a room or a hallway starting from a door
+void make_feature(map_generator_t *gen) {
+
+	//door coordinates
+	int x0 = 0;
+	int y0 = 0;
+
+	//feature expansion direction
+	int direction;
+
+	int i, offset;
+	int mins_x, mins_y;
+	int maxs_x, maxs_y;
+	int offset_x, offset_y;
+
+	//is this a room or a hallway feature?
+	int is_room = RngBool(&gen->rng);
+
+	//try find a door with nothing on the other side
+	for (i = 0; i < 500; i++) {
+
+		pick_random_doors(gen, &x0, &y0);
+
+		//make sure the picked door leads to an empty space
+		direction = has_neighbor_of_type(gen, x0, y0, TILE_EMPTY);
+
+		if (direction) {
+
+			break;
+		}
+	}
+	if (i == 500) {
+
+		//this is fine
+		//d_printf(LOG_TEXT, "%s: failed to make a feature\n", __func__);
+		return;
+	}
+
+	if (is_room) {
+
+		//find room coordinates
+		for (i = 0; i < 100; i++) {
+
+			//room size
+			offset_x = rng_range(&gen->rng, MIN_FEATURE_SIZE, MAX_FEATURE_SIZE);
+			offset_y = rng_range(&gen->rng, MIN_FEATURE_SIZE, MAX_FEATURE_SIZE);
+
+			MakeOddNumber(offset_x);
+			MakeOddNumber(offset_y);
+
+			//door edge offset
+			offset = rng_range(&gen->rng, 0, ((direction & AXIS_X ? offset_x : offset_y) / 2) - 1);
+			offset = 0;
+
+			//room bounds
+			mins_x = direction & AXIS_X ? (direction & DIR_NEGATIVE ? x0 - offset_x : x0) : x0 - offset_x / 2;
+			mins_y = direction & AXIS_X ? y0 - offset_x / 2 : (direction & DIR_NEGATIVE ? y0 - offset_y : y0);
+			maxs_x = mins_x + offset_x;
+			maxs_y = mins_y + offset_y;
+
+			if (mins_x < 0 || mins_y < 0 || maxs_x >= gen->size || maxs_y >= gen->size) {
+
+				//out of bounds, try again
+				continue;
+			}
+
+			if (!is_overlapping(gen, mins_x, mins_y, maxs_x, maxs_y)) {
+
+				//valid room
+				break;
+			}
+		}
+
+		if (i == 100) {
+
+			//this is fine
+			//d_printf(LOG_TEXT, "%s: failed to make room\n", __func__);
+			return;
+		}
+
+		make_room_start_end(gen, mins_x, mins_y, maxs_x, maxs_y);
+	}
+	else
+	{
+		//find hallway coordinates
+		for (i = 0; i < 100; i++) {
+
+			//hallway length
+			offset = rng_range(&gen->rng, MIN_FEATURE_SIZE, MAX_FEATURE_SIZE);
+
+			offset_x = x0 + (direction & AXIS_X ? (offset * (direction & DIR_NEGATIVE ? -1 : 1)) : 0);
+			offset_y = y0 + (direction & AXIS_X ? 0 : (offset * (direction & DIR_NEGATIVE ? -1 : 1)));
+
+			//hallway bounds
+			mins_x = direction & DIR_NEGATIVE ? offset_x : x0;
+			mins_y = direction & DIR_NEGATIVE ? offset_y : y0;
+			maxs_x = direction & DIR_NEGATIVE ? x0 : offset_x;
+			maxs_y = direction & DIR_NEGATIVE ? y0 : offset_y;
+
+			//make_hallway adds walls on both sides, they can't cover floors either
+			if (!is_overlapping(gen, mins_x - !(direction & AXIS_X), mins_y - !!(direction & AXIS_X),
+				maxs_x + !(direction & AXIS_X), maxs_y + !!(direction & AXIS_X))) {
+
+				//valid hallway
+				break;
+			}
+		}
+
+		if (i == 100) {
+
+			//this is fine
+			//d_printf(LOG_TEXT, "%s: failed to make hallway\n", __func__);
+			return;
+		}
+
+		make_hallway(gen, mins_x, mins_y, maxs_x, maxs_y);
+	}
+}
+
+//----------
+// water
+//----------
+
+//recursively fills neighbor tiles with water
+void flood_fill_water(map_generator_t *gen, int x, int y) {
+
+	int x0, y0;
+
+	set_gen_tile(gen, x, y, TILE_WATER);
+
+	for (int i = 0; i < 4; i++) {
+
+		x0 = x + (i % 2) * (i > 1 ? 1 : -1);
+		y0 = y + (!(i % 2)) * (i > 1 ? 1 : -1);
+
+		if (gen->tiles[GenIndex(gen, x0, y0)] != TILE_WATER && !has_neighbor_of_type(gen, x0, y0, TILE_WALL) && !has_neighbor_of_type(gen, x0, y0, TILE_DOOR) && 
+			!has_neighbor_of_type(gen, x0, y0, TILE_LOCK_DOOR) && !has_neighbor_of_type(gen, x0, y0, TILE_CHEST) &&
+			x0 != gen->offset && y0 != gen->offset && RngBool(&gen->rng)) {
+
+			flood_fill_water(gen, x0, y0);
+		}
+	}
+}
+
+//creates water on the map
+void add_water_pools(map_generator_t *gen) {
+
+	int x, y;
+	int water_count = 0;
+
+	//bigger maps get more pools
+	for (int i = 0; i < 300 * (gen->budget / MAP_BUDGET); i++) {
+
+		//pick a random floor tile
+		if (!pick_random_tile(gen, TILE_FLOOR, &x, &y)) {
+
+			break;
+		}
+
+		if (!has_neighbor_of_type(gen, x, y, TILE_WALL) && !has_neighbor_of_type(gen, x, y, TILE_DOOR) && !has_neighbor_of_type(gen, x, y, TILE_WATER) && !has_neighbor_of_type(gen, x, y, TILE_LOCK_DOOR) &&
+			!has_neighbor_of_type(gen, x, y, TILE_CHEST) &&
+			(x > gen->offset + MAP_SAFE_ZONE || x < gen->offset - MAP_SAFE_ZONE) && (y > gen->offset + MAP_SAFE_ZONE || y < gen->offset - MAP_SAFE_ZONE) ) {
+
+			flood_fill_water(gen, x, y);
+			water_count++;
+
+			i++;
+		}
+	}
+
+	if (water_count) {
+
+		d_printf(LOG_INFO, "%s: map with %d water pools\n", __func__, water_count);
+	}
+	else
+	{
+		d_printf(LOG_INFO, "%s: map with no water\n", __func__);
+	}
+}
+
+//----------
+// exit
+//----------
+
+void make_exit(map_generator_t *gen) {
+
+	int x, y;
+
+	for (int i = 0; i < 15000; i++) {
+
+		//pick a random floor tile
+		if (!pick_random_tile(gen, TILE_FLOOR, &x, &y)) {
+
+			break;
+		}
+
+		//keep the "small" safe zone in mind
+		if ((x > gen->offset + MAP_SAFE_ZONE / 2 || x < gen->offset - MAP_SAFE_ZONE / 2) &&
+			(y > gen->offset + MAP_SAFE_ZONE / 2 || y < gen->offset - MAP_SAFE_ZONE / 2) &&
+			gen->contents[GenIndex(gen, x, y)] == MAP_NOTHING) {
+
+			set_gen_tile(gen, x, y, TILE_EXIT);
+
+			d_printf(LOG_INFO, "%s: dungeon exit at [%d, %d]\n", __func__, x - gen->offset, y - gen->offset);
+			return;
+		}
+	}
+
+	d_printf(LOG_ERROR, "%s: failed to make dungeon exit!\n", __func__);
+	gen->is_failed = 1;
+}
+
+//----------
+// map contents
+//----------
+
+//adds a random item
+void make_item(map_generator_t *gen, int x, int y) {
+
+	int random = rng_range(&gen->rng, 1, 8);
+
+	if (random > 6) {
+
+		gen->contents[GenIndex(gen, x, y)] = MAP_ITEM_SWORD;
+	}
+	else if(random > 3)
+	{
+		gen->contents[GenIndex(gen, x, y)] = MAP_ITEM_SHIELD;
+	}
+	else {
+
+		gen->contents[GenIndex(gen, x, y)] = MAP_ITEM_POTION_HP;
+	}
+}
+
+//adds a random mob
+void make_mob(map_generator_t *gen, int x, int y) {
+
+	gen->contents[GenIndex(gen, x, y)] = RngBool(&gen->rng) ? MAP_MOB_SLIME : MAP_MOB_GOBLIN;
+}
+
+
+//randomly puts the given amount of content on the map
+void add_contents_of_type(map_generator_t *gen, int type, int count) {
+
+	int total_attempts = 0;
+	int i = 0;
+	int x, y;
+
+	//place contents
+	while (i < count) {
+
+		if (total_attempts > 1000 * (gen->budget / MAP_BUDGET)) {
+
+			d_printf(LOG_TEXT, "%s: too many total attempts\n", __func__);
+			break;
+		}
+
+		//pick a random floor tile
+		if (!pick_random_tile(gen, TILE_FLOOR, &x, &y)) {
+
+			break;
+		}
+
+		if ((x > gen->offset + MAP_SAFE_ZONE || x < gen->offset - MAP_SAFE_ZONE) &&	//keep the safe zone in mind - mobs spawning next to a player are bad
+			(y > gen->offset + MAP_SAFE_ZONE || y < gen->offset - MAP_SAFE_ZONE) &&
+			gen->contents[GenIndex(gen, x, y)] == MAP_NOTHING &&									//make sure nothing is placed on this tile
+			!neighbor_has_content_of_type(gen, x, y, type) &&							//don't spawn side by side with another content of the same type
+			!has_neighbor_of_type(gen, x, y, TILE_DOOR)) {								//don't spawn next to a door
+
+			switch (type)
+			{
+				case CONTENT_ITEM:
+					make_item(gen, x, y);
+					break;
+				case CONTENT_MOB:
+					make_mob(gen, x, y);
+					break;
+			}
+
+			//next
+			i++;
+			continue;
+		}
+		total_attempts++;
+	}
+}
+
+//places items and mobs on a generated map (the contents have their own random stream so they don't depend on the generation attempts)
+void add_map_contents(map_generator_t *gen, unsigned int seed) {
+
+	int count;
+
+	rng_seed(&gen->rng, seed, RNG_STREAM_CONTENTS);
+
+	//items
+	count = rng_range(&gen->rng, MAX_ITEMS / 2, MAX_ITEMS);
+	d_printf(LOG_INFO, "%s: placing %d items...\n", __func__, count);
+	add_contents_of_type(gen, CONTENT_ITEM, count);
+
+	//mobs
+	count = rng_range(&gen->rng, MAX_MOBS / 2, MAX_MOBS) * (gen->budget / MAP_BUDGET); //bigger maps get more mobs
+	d_printf(LOG_INFO, "%s: placing %d mobs...\n", __func__, count);
+	add_contents_of_type(gen, CONTENT_MOB, count);
+}
+
+//----------
+// locked room
+//----------
+
+void make_locked_room_chest(map_generator_t *gen, int x_min, int y_min, int x_max, int y_max) {
+
+	//pick a random position inside the locked room
+	int x = rng_range(&gen->rng, x_min + 1, x_max - 1);
+	int y = rng_range(&gen->rng, y_min + 1, y_max - 1);
+
+	set_gen_tile(gen, x, y, TILE_CHEST);
+
+	d_printf(LOG_INFO, "%s: chest at [%d, %d]\n", __func__, x, y);
+}
+
+void make_locked_room(map_generator_t *gen) {
+
+	int x0 = 1, y0 = 1;
+	int i, direction, offset_x, offset_y, mins_x, mins_y, maxs_x, maxs_y;
+
+	//try a few doors: the space behind a door can be too small for the room
+	for (int k = 0; k < 20; k++) {
+
+		//try find a door with nothing on the other side
+		for (i = 0; i < 500; i++) {
+
+			pick_random_doors(gen, &x0, &y0);
+
+			//make sure the picked door leads to an empty space
+			direction = has_neighbor_of_type(gen, x0, y0, TILE_EMPTY);
+
+			if (direction) {
+
+				break;
+			}
+		}
+		if (i == 500) {
+
+			//this is fine
+			d_printf(LOG_ERROR, "%s: failed to make the locked room\n", __func__);
+			return;
+		}
+
+		//find room coordinates
+		for (i = 0; i < 100; i++) {
+
+			//room size
+			offset_x = rng_range(&gen->rng, MIN_FEATURE_SIZE, MAX_FEATURE_SIZE);
+			offset_y = rng_range(&gen->rng, MIN_FEATURE_SIZE, MAX_FEATURE_SIZE);
+
+			MakeOddNumber(offset_x);
+			MakeOddNumber(offset_y);
+
+			//room bounds
+			mins_x = direction & AXIS_X ? (direction & DIR_NEGATIVE ? x0 - offset_x : x0) : x0 - offset_x / 2;
+			mins_y = direction & AXIS_X ? y0 - offset_x / 2 : (direction & DIR_NEGATIVE ? y0 - offset_y : y0);
+			maxs_x = mins_x + offset_x;
+			maxs_y = mins_y + offset_y;
+
+			if (mins_x < 0 || mins_y < 0 || maxs_x >= gen->size || maxs_y >= gen->size) {
+
+				//out of bounds, try again
+				continue;
+			}
+
+			if (!is_overlapping(gen, mins_x, mins_y, maxs_x, maxs_y)) {
+
+				for (int x1 = mins_x; x1 < maxs_x; x1++) {
+
+					if (x1 != x0 && (gen->tiles[GenIndex(gen, x1, mins_y)] == TILE_DOOR || gen->tiles[GenIndex(gen, x1, maxs_y)] == TILE_DOOR)) {
+
+						//has random door somewhere
+						continue;
+					}
+				}
+				for (int y1 = mins_y; y1 < maxs_y; y1++) {
+
+					if (y1 != y0 && (gen->tiles[GenIndex(gen, mins_x, y1)] == TILE_DOOR || gen->tiles[GenIndex(gen, maxs_x, y1)] == TILE_DOOR)) {
+
+						//has random door somewhere
+						continue;
+					}
+				}
+
+				//valid room
+				break;
+			}
+		}
+
+		if (i < 100) {
+
+			//found a room
+			break;
+		}
+	}
+	if (i == 100) {
+
+		d_printf(LOG_ERROR, "%s: couldn't fit a room\n", __func__);
+		gen->is_failed = 1;
+		return;
+	}
+
+	if (mins_x < 0 || mins_y < 0 || maxs_x >= gen->size || maxs_y >= gen->size) {
+
+		d_printf(LOG_ERROR, "%s: room out of map bounds\n", __func__);
+		gen->is_failed = 1;
+		return;
+	}
+
+	for (int x = mins_x; x <= maxs_x; x++) {
+		for (int y = mins_y; y <= maxs_y; y++) {
+
+			if (gen->tiles[GenIndex(gen, x, y)] != TILE_EMPTY) {
+
+				if (gen->tiles[GenIndex(gen, x, y)] == TILE_FLOOR) {
+
+					//should never happen: this means the room is misaligned
+					d_printf(LOG_ERROR, "%s: tile not empty\n", __func__);
+					gen->is_failed = 1;
+				}
+				else if (gen->tiles[GenIndex(gen, x, y)] == TILE_DOOR) {
+
+					set_gen_tile(gen, x, y, TILE_WALL); //seal all other entrances
+				}
+
+				//walls or doors overlapping are fine
+				continue;
+			}
+
+			if (x == mins_x || y == mins_y || x == maxs_x || y == maxs_y) {
+
+				//edge is a wall
+				set_gen_tile(gen, x, y, TILE_WALL);
+			}
+			else
+			{
+				//inside is a floor
+				set_gen_tile(gen, x, y, TILE_FLOOR);
+				gen->contents[GenIndex(gen, x, y)] = MAP_ITEM_LOCK_ROOM;
+			}
+		}
+	}
+
+	set_gen_tile(gen, x0, y0, TILE_LOCK_DOOR);
+
+	make_locked_room_chest(gen, mins_x, mins_y, maxs_x, maxs_y);
+
+	d_printf(LOG_INFO, "%s: locked door at [%d, %d]\n", __func__, x0, y0);
+}
+
+//----------
+// generator context
+//----------
+
+//sets up an empty generator (no grids allocated yet)
+void init_map_generator(map_generator_t *gen) {
+
+	memset(gen, 0, sizeof(map_generator_t));
+}
+
+//returns the map dimensions of the level
+int get_level_map_size(int level) {
+
+	int size = MIN_MAP_SIZE + (level - 1) * MAP_SIZE_PER_LEVEL;
+
+	return size > MAX_MAP_SIZE ? MAX_MAP_SIZE : size;
+}
+
+//sets the dimensions for the level and makes sure the grids are big enough, returns 0 if out of memory
+int prepare_map_generator(map_generator_t *gen, int level) {
+
+	int size = get_level_map_size(level);
+	int **arrays[] = { &gen->tiles, &gen->contents, &gen->floor_tiles, &gen->door_tiles, &gen->tile_list_index };
+
+	gen->level = level;
+	gen->size = size;
+	gen->offset = size / 2;
+
+	//keep the same amount of tiles per area as on the smallest map
+	gen->budget = (int)((long long)MAP_BUDGET * size * size / (MIN_MAP_SIZE * MIN_MAP_SIZE));
+
+	if (gen->capacity >= size * size) {
+
+		return 1;
+	}
+
+	for (unsigned i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+
+		free(*arrays[i]);
+		*arrays[i] = malloc(sizeof(int) * size * size);
+
+		if (!*arrays[i]) {
+
+			out_of_memory_error(__func__);
+			free_map_generator(gen);
+			return 0;
+		}
+	}
+
+	gen->capacity = size * size;
+	return 1;
+}
+
+//frees the grids of the generator
+void free_map_generator(map_generator_t *gen) {
+
+	free(gen->tiles);
+	free(gen->contents);
+	free(gen->floor_tiles);
+	free(gen->door_tiles);
+	free(gen->tile_list_index);
+
+	init_map_generator(gen);
+}
+
+//----------
+// generation
+//----------
+
+//adds the time since start to the phase timing, returns the current time
+double end_phase(map_generator_t *gen, int phase, double start) {
+
+	double now = get_time_msec();
+
+	gen->phase_msec[phase] += now - start;
+	return now;
+}
+
+//creates the map tiles and contents from the seed (see prepare_map_generator), returns 0 if all attempts failed
+int run_map_generator(map_generator_t *gen, unsigned int seed) {
+
+	int tile_count = 0;
+	double time;
+
+	d_printf(LOG_INFO, "%s: generating a map (seed %u)...\n", __func__, seed);
+
+	gen->seed = seed;
+	rng_seed(&gen->rng, seed, RNG_STREAM_MAP);
+
+	gen->budget_misses = 0;
+	memset(gen->phase_msec, 0, sizeof(gen->phase_msec));
+
+	//compensate for the small chance of map generator failure
+	for (gen->attempts = 1; gen->attempts <= 10; gen->attempts++) { //10 attempts should be enough?
+
+		time = get_time_msec();
+
+		//reset counters
+		gen->is_failed = 0;
+		gen->has_lock_room = 0;
+
+		//wipe map data
+		reset_gen_tiles(gen);
+		memset(gen->contents, 0, sizeof(int) * gen->size * gen->size);
+
+		//make center room
+		make_room(gen, gen->offset, gen->offset, rng_range(&gen->rng, MIN_FEATURE_SIZE, MAX_FEATURE_SIZE), rng_range(&gen->rng, MIN_FEATURE_SIZE, MAX_FEATURE_SIZE));
+
+		//500 attempts to make a feature per MAP_BUDGET tiles (usually enough for a budget < 2000)
+		for (int i = 0; i < 500 * (gen->budget / MAP_BUDGET); i++) {
+
+			make_feature(gen);
+
+			tile_count = count_tiles_of_not_type(gen, TILE_EMPTY);
+			if (tile_count > gen->budget) {
+
+				break;
+			}
+		}
+
+		time = end_phase(gen, MAPGEN_PHASE_FEATURES, time);
+
+		if (gen->is_failed || tile_count < gen->budget) {
+
+			d_printf(LOG_ERROR, "%s: map budget not met: %d tiles out of %d\n", __func__, tile_count, gen->budget);
+
+			if (tile_count < gen->budget) {
+
+				gen->budget_misses++;
+			}
+			gen->is_failed = 1;
+			goto retry;
+		}
+
+		//add locked room
+		make_locked_room(gen);
+		time = end_phase(gen, MAPGEN_PHASE_LOCKED_ROOM, time);
+
+		//remove redundant doors
+		fix_doors(gen);
+		time = end_phase(gen, MAPGEN_PHASE_DOORS, time);
+
+		if (gen->is_failed) {
+
+			goto retry;
+		}
+
+		//add water tiles
+		add_water_pools(gen);
+		time = end_phase(gen, MAPGEN_PHASE_WATER, time);
+
+		//make an exit
+		make_exit(gen);
+		time = end_phase(gen, MAPGEN_PHASE_EXIT, time);
+
+		//remove some doors to make the map feel more open
+		remove_some_doors(gen);
+		end_phase(gen, MAPGEN_PHASE_DOORS, time);
+
+		if (!gen->is_failed) {
+
+			break;
+		}
+
+retry:
+		if (gen->attempts < 5) {
+
+			d_printf(LOG_WARNING, "%s: failed to generate the map, retrying... (%d tiles)\n", __func__, tile_count);
+		}
+	}
+
+	//still failed...
+	if (gen->is_failed) {
+
+		gen->attempts = 10;
+		d_printf(LOG_ERROR, "%s: failed to generate the map (%d tiles)\n", __func__, tile_count);
+	}
+
+	d_printf(LOG_INFO, "%s: map tiles: %d\n", __func__, tile_count);
+
+	//set map contents
+	time = get_time_msec();
+	add_map_contents(gen, seed);
+	end_phase(gen, MAPGEN_PHASE_CONTENTS, time);
+
+	return !gen->is_failed;
+}
@@ -4,7 +4,8 @@
 * dungeons.
 * 
 * Mob behaviour includes walking (randomly or towards player) and attacking
-* the player when next to him.
+* the player when next to him. Mobs that walk towards the player follow
+* a flow field shared by all of them (see pathfinding.c).
 */
 
 #include "game.h"
@@ -12,7 +13,8 @@
 #include "raycast.h"
 #include "particles.h"
 #include <string.h>
-#include <GL/glut.h>
+#include <stdlib.h>
+#include <limits.h>
 
 #define TEXT_XOFFS 0.35f
 #define TEXT_YOFFS 0.35f
@@ -21,107 +23,298 @@
 #define TEXT_BG_XSCALE ((TEXT_SCALE))
 #define TEXT_BG_YSCALE (TEXT_BG_XSCALE * 2)
 
-int		is_mob_move = 0;					//global mob state: if mobs are moving then no inputs are processed
-mob_t	mobs[MAX_MOBS];						//all mobs are kept here
+int			is_mob_move = 0;				//global mob state: if mobs are moving then no inputs are processed
+mob_store_t	mob_store;						//all alive mobs are kept here
 
-//behaviour
-static vec2_t	lerp_starts[MAX_MOBS];		//each mob can have a movement start
-static vec2_t	lerp_ends[MAX_MOBS];		//and movement end
-static int		lerp_max_msecs[MAX_MOBS];	//how many miliseconds should the move take
-static int		lerp_msecs[MAX_MOBS];		//how many miliseconds this move already took
+static int		is_mob_attack = 0;			//local attack state (for holding movement until attacks are done)
 
-static int		attacks_player[MAX_MOBS];	//1 => this mob attacks the player
+static rng_t	ai_rng;						//random decisions of the mobs (seeded with the level)
+static int		turn_count;					//mob turns started (one for each player action)
 
-static int		is_mob_attack = 0;			//local attack state (for holding movement until attacks are done)
+//handle slots
+static int				*slot_index;		//store index of the mob using each slot
+static unsigned int		*slot_generation;	//bumped every time the slot is freed
+static int				*free_slots;		//stack of unused slots
+static int				free_slot_count;
+static int				slot_capacity;
+
+//occupancy
+static mob_handle_t	*mob_map;			//mob standing on each tile (as MapIndex)
+static int			*reserved_map;		//1 => a mob moves to this tile in the current turn
+static int			mob_map_size;		//map size the occupancy maps are allocated for
+
+/*
+* Converts a world position to map tile coordinates. Returns 0 if the position is outside of the map.
+*/
+int mob_position_to_tile(vec2_t position, int *x, int *y) {
+
+	*x = (int)floorf(map_offset + position[VEC_X] / (SPRITE_SIZE * 2) + 0.5f);
+	*y = (int)floorf(map_offset + position[VEC_Y] / (SPRITE_SIZE * 2) + 0.5f);
+
+	return is_inside_map(*x, *y);
+}
+
+/*
+* Removes the mob at the given store index from its tile of the occupancy map.
+*/
+void leave_mob_tile(int i) {
+
+	int x = mob_store.tile_x[i];
+	int y = mob_store.tile_y[i];
+
+	//the map size might have changed since the mob was placed
+	if (x < mob_map_size && y < mob_map_size && mob_map[x * mob_map_size + y] == mob_store.handle[i]) {
+
+		mob_map[x * mob_map_size + y] = MOB_NONE;
+	}
+}
+
+/*
+* Moves the mob at the given store index to another tile of the occupancy map.
+*/
+void set_mob_tile(int i, vec2_t position) {
+
+	int x, y;
+
+	//leave the old tile
+	leave_mob_tile(i);
+
+	if (!mob_position_to_tile(position, &x, &y)) {
+
+		d_printf(LOG_WARNING, "%s: mob outside of the map\n", __func__);
+		return;
+	}
+
+	mob_store.tile_x[i] = x;
+	mob_store.tile_y[i] = y;
+	mob_map[MapIndex(x, y)] = mob_store.handle[i];
+}
+
+/*
+* Reallocates a single store array. Returns 0 if out of memory.
+*/
+int grow_mob_array(void **array, size_t element_size, int capacity) {
+
+	void *p = realloc(*array, element_size * capacity);
+
+	if (!p) {
+
+		out_of_memory_error(__func__);
+		return 0;
+	}
+	*array = p;
+	return 1;
+}
+
+/*
+* Makes sure the mob store and the handle slots can fit one more mob.
+* Returns 0 if out of memory.
+*/
+int reserve_mob(void) {
+
+	int capacity;
+
+	if (mob_store.count == mob_store.capacity) {
+
+		capacity = mob_store.capacity ? mob_store.capacity * 2 : 16;
+
+		if (!grow_mob_array((void **)&mob_store.type, sizeof(int), capacity) ||
+			!grow_mob_array((void **)&mob_store.look_direction, sizeof(int), capacity) ||
+			!grow_mob_array((void **)&mob_store.tile_x, sizeof(int), capacity) ||
+			!grow_mob_array((void **)&mob_store.tile_y, sizeof(int), capacity) ||
+			!grow_mob_array((void **)&mob_store.stats, sizeof(player_stats_t), capacity) ||
+			!grow_mob_array((void **)&mob_store.attacks_player, sizeof(int), capacity) ||
+			!grow_mob_array((void **)&mob_store.lerp_starts, sizeof(vec2_t), capacity) ||
+			!grow_mob_array((void **)&mob_store.lerp_ends, sizeof(vec2_t), capacity) ||
+			!grow_mob_array((void **)&mob_store.lerp_max_msecs, sizeof(int), capacity) ||
+			!grow_mob_array((void **)&mob_store.lerp_msecs, sizeof(int), capacity) ||
+			!grow_mob_array((void **)&mob_store.render, sizeof(mob_render_t), capacity) ||
+			!grow_mob_array((void **)&mob_store.handle, sizeof(mob_handle_t), capacity)) {
+
+			return 0;
+		}
+		mob_store.capacity = capacity;
+	}
+
+	if (!free_slot_count && slot_capacity == (int)MOB_SLOT_MASK) {
+
+		d_printf(LOG_ERROR, "%s: out of mob handles!\n", __func__);
+		return 0;
+	}
+
+	if (!free_slot_count) {
+
+		capacity = slot_capacity ? slot_capacity * 2 : 16;
+
+		if (capacity > (int)MOB_SLOT_MASK) {
+
+			capacity = MOB_SLOT_MASK;
+		}
+
+		if (!grow_mob_array((void **)&slot_index, sizeof(int), capacity) ||
+			!grow_mob_array((void **)&slot_generation, sizeof(unsigned int), capacity) ||
+			!grow_mob_array((void **)&free_slots, sizeof(int), capacity)) {
+
+			return 0;
+		}
+
+		//new slots are pushed so that the lowest slot is used first
+		for (int slot = capacity - 1; slot >= slot_capacity; slot--) {
+
+			slot_generation[slot] = 1;
+			free_slots[free_slot_count++] = slot;
+		}
+		slot_capacity = capacity;
+	}
+
+	return 1;
+}
+
+/*
+* Returns the store index of the mob or -1 if the mob is dead.
+*/
+int mob_index(mob_handle_t handle) {
+
+	int slot = handle & MOB_SLOT_MASK;
+
+	if (handle == MOB_NONE || slot >= slot_capacity || slot_generation[slot] != handle >> MOB_SLOT_BITS) {
+
+		return -1;
+	}
+	return slot_index[slot];
+}
 
 /*
-* Deletes the mob from current level.
+* Deletes the mob at the given store index from current level. The last mob of the store
+* is moved to the freed index.
 */
-void delete_mob(mob_t *mob) {
+void delete_mob(int i) {
 
-	if (!mob) {
+	mob_render_t *r;
+	int slot, last;
 
-		d_printf(LOG_WARNING, "%s: NULL mob passed as the argument\n", __func__);
+	if (i < 0 || i >= mob_store.count) {
+
+		d_printf(LOG_WARNING, "%s: invalid mob index passed as the argument\n", __func__);
 		return;
 	}
 
+	r = &mob_store.render[i];
+
+	//free the tile
+	leave_mob_tile(i);
+
 	//delete mob's sprites
-	for (int i = 0; i < 3; i++) {
+	for (int j = 0; j < 3; j++) {
 
-		if (mob->sprite[i]) {
+		if (r->sprite[j]) {
 
-			delete_sprite(mob->sprite[i]);
+			delete_sprite(r->sprite[j]);
 		}
 	}
 
 	//delete attack sprite
-	if (mob->attack_sprite) {
+	if (r->attack_sprite) {
 
-		delete_sprite(mob->attack_sprite);
+		delete_sprite(r->attack_sprite);
 	}
 
 	//delete texts
-	if (mob->health_text) {
+	if (r->health_text) {
 
-		delete_text(mob->health_text);
+		delete_text(r->health_text);
 	}
-	if (mob->armor_text) {
+	if (r->armor_text) {
 
-		delete_text(mob->armor_text);
+		delete_text(r->armor_text);
 	}
 
 	//delete text background
-	if (mob->text_background) {
+	if (r->text_background) {
 
-		delete_sprite(mob->text_background);
+		delete_sprite(r->text_background);
 	}
 
-	//wipe the entire structure
-	memset(mob, 0, sizeof(mob_t));
+	//free the handle (old handles of this slot become invalid)
+	slot = mob_store.handle[i] & MOB_SLOT_MASK;
+	slot_generation[slot] = (slot_generation[slot] + 1) & (UINT_MAX >> MOB_SLOT_BITS);
+
+	if (!slot_generation[slot]) {
+
+		slot_generation[slot] = 1; //keep handles different from MOB_NONE
+	}
+	free_slots[free_slot_count++] = slot;
+
+	//move the last mob into the gap
+	last = --mob_store.count;
+
+	if (i != last) {
+
+		mob_store.type[i] = mob_store.type[last];
+		mob_store.look_direction[i] = mob_store.look_direction[last];
+		mob_store.tile_x[i] = mob_store.tile_x[last];
+		mob_store.tile_y[i] = mob_store.tile_y[last];
+		mob_store.stats[i] = mob_store.stats[last];
+		mob_store.attacks_player[i] = mob_store.attacks_player[last];
+		Vec2Copy(mob_store.lerp_starts[last], mob_store.lerp_starts[i]);
+		Vec2Copy(mob_store.lerp_ends[last], mob_store.lerp_ends[i]);
+		mob_store.lerp_max_msecs[i] = mob_store.lerp_max_msecs[last];
+		mob_store.lerp_msecs[i] = mob_store.lerp_msecs[last];
+		mob_store.render[i] = mob_store.render[last];
+		mob_store.handle[i] = mob_store.handle[last];
+
+		slot_index[mob_store.handle[i] & MOB_SLOT_MASK] = i;
+	}
 }
 
 /*
-* Finds a free mob slot and returns a pointer to it.
+* Adds a new mob to the store and returns its store index (or -1 if out of memory).
 */
-mob_t *new_mob(void) {
+int new_mob(void) {
 
-	for (int i = 0; i < MAX_MOBS; i++) {
+	int i, slot;
 
-		//empty mob
-		if (mobs[i].type == MAP_NOTHING) {
+	if (!reserve_mob()) {
 
-			return &mobs[i];
-		}
+		return -1;
 	}
-	//array end
-	d_printf(LOG_ERROR, "%s: max mobs exceeded!\n", __func__);
 
-	//clear and return the last mob
-	delete_mob(&mobs[MAX_MOBS - 1]);
-	return &mobs[MAX_MOBS - 1];
+	i = mob_store.count++;
+	slot = free_slots[--free_slot_count];
+
+	slot_index[slot] = i;
+	mob_store.handle[i] = (slot_generation[slot] << MOB_SLOT_BITS) | slot;
+
+	//clear the new mob
+	mob_store.type[i] = MAP_NOTHING;
+	mob_store.look_direction[i] = LOOK_RIGHT;
+	mob_store.tile_x[i] = 0;
+	mob_store.tile_y[i] = 0;
+	memset(&mob_store.stats[i], 0, sizeof(player_stats_t));
+	mob_store.attacks_player[i] = 0;
+	Vec2Zero(mob_store.lerp_starts[i]);
+	Vec2Zero(mob_store.lerp_ends[i]);
+	mob_store.lerp_max_msecs[i] = 0;
+	mob_store.lerp_msecs[i] = 0;
+	memset(&mob_store.render[i], 0, sizeof(mob_render_t));
+
+	return i;
 }
 
 /*
-* Counts all alive mobs and returns the amount.
+* Returns the amount of alive mobs.
 */
 int alive_mobs_count(void) {
 
-	int count = 0;
-	for (int i = 0; i < MAX_MOBS; i++) {
-
-		if (mobs[i].type != MAP_NOTHING) {
-
-			count++;
-		}
-	}
-	return count;
+	return mob_store.count;
 }
 
 /*
 * Updates mob stat texts.
 */
-void mob_update_texts(mob_t *mob) {
+void mob_update_texts(int i) {
 
+	mob_render_t *mob = &mob_store.render[i];
 	char text[4];
 	int x_mult = 1;
 	int len;
@@ -129,7 +322,7 @@ void mob_update_texts(mob_t *mob) {
 	if (mob->health_text) {
 
 		memset(text, 0, 4 * sizeof(char));
-		snprintf(text, 4, "%d", mob->stats.health);
+		snprintf(text, 4, "%d", mob_store.stats[i].health);
 
 		Vec2Copy(mob->sprite[0]->position, mob->health_text->position);
 		mob->health_text->position[VEC_X] += TEXT_XOFFS;
@@ -143,7 +336,7 @@ void mob_update_texts(mob_t *mob) {
 	if (mob->armor_text) {
 
 		memset(text, 0, 4 * sizeof(char));
-		snprintf(text, 4, "%d", mob->stats.armor);
+		snprintf(text, 4, "%d", mob_store.stats[i].armor);
 
 		Vec2Copy(mob->sprite[0]->position, mob->armor_text->position);
 		mob->armor_text->position[VEC_X] += TEXT_XOFFS;
@@ -171,22 +364,23 @@ void mob_update_texts(mob_t *mob) {
 /*
 * Gives mob random statistics in range of the preset limits.
 */
-void randomize_mob(mob_t *mob) {
+void randomize_mob(int i, rng_t *rng) {
 
+	player_stats_t *stats = &mob_store.stats[i];
 	int current_level = get_current_level();
 	int min_health = MIN_MOB_HEALTH + current_level / 2;
 	int min_armor = MIN_MOB_ARMOR;
 	int min_damage = MIN_MOB_DAMAGE;
 
-	mob->stats.health = mob->stats.max_health = (MIN_MOB_HEALTH + current_level / 2) + rand() % ((MAX_MOB_HEALTH + current_level) - min_health);
-	mob->stats.armor = MIN_MOB_ARMOR + rand() % ((MAX_MOB_ARMOR + current_level / 3) - min_armor);
-	mob->stats.attack_damage = MIN_MOB_DAMAGE + rand() % ((MAX_MOB_DAMAGE + current_level / 2) - min_damage);
+	stats->health = stats->max_health = (MIN_MOB_HEALTH + current_level / 2) + rng_next(rng) % ((MAX_MOB_HEALTH + current_level) - min_health);
+	stats->armor = MIN_MOB_ARMOR + rng_next(rng) % ((MAX_MOB_ARMOR + current_level / 3) - min_armor);
+	stats->attack_damage = MIN_MOB_DAMAGE + rng_next(rng) % ((MAX_MOB_DAMAGE + current_level / 2) - min_damage);
 }
 
 /*
-* Adds a sprite to the *mob at the given index, with the given name and position.
+* Adds a sprite to the mob at the given store index, with the given sprite index, name and position.
 */
-void add_mob_sprite(mob_t *mob, int index, texname tname, float x_pos, float y_pos) {
+void add_mob_sprite(int i, int index, texname tname, float x_pos, float y_pos) {
 
 	sprite_t *s;
 
@@ -194,33 +388,37 @@ void add_mob_sprite(mob_t *mob, int index, texname tname, float x_pos, float y_p
 
 	s->tex_id = get_texture_id(tname);
 	s->framecount = get_texture_framecount(tname);
-	s->render_layer = get_texture_render_layer(tname);
+	set_sprite_render_layer(s, get_texture_render_layer(tname));
 	s->frame_msec = get_texture_frametime(tname);
-	s->render_layer = get_texture_render_layer(tname);
 	s->animation_pause = 1;
 	s->collision_mask = COLLISION_MOB;
 	s->position[VEC_X] = x_pos;
 	s->position[VEC_Y] = y_pos;
 	s->skip_render = 1;
+	register_pick_sprite(s);
 
-	mob->sprite[index] = s;
+	mob_store.render[i].sprite[index] = s;
 }
 
 /*
-* Generates mobs based on map_contents array.
+* Generates mobs based on map_contents array. The seed decides the mob statistics.
 */
-void generate_mobs(void) {
+void generate_mobs(unsigned int seed) {
 
 	texname tnames[3];		//names for all mob sprites
 	texname attack_tname;	//name of the attack sprite
-	mob_t *mob;
+	mob_render_t *mob;
 	sprite_t *s;
+	rng_t rng;
+	int i;
+
+	rng_seed(&rng, seed, RNG_STREAM_MOBS);
 
 	//check all map contents
-	for (int x = 0; x < MAP_SIZE; x++) {
-		for (int y = 0; y < MAP_SIZE; y++) {
+	for (int x = 0; x < map_size; x++) {
+		for (int y = 0; y < map_size; y++) {
 
-			switch (map_contents[x][y])
+			switch (map_contents[MapIndex(x, y)])
 			{
 				case MAP_MOB_SLIME:
 					tnames[0] = SLIME_R;
@@ -240,24 +438,31 @@ void generate_mobs(void) {
 			}
 
 			//get a new mob
-			mob = new_mob();
-			mob->type = map_contents[x][y];
+			i = new_mob();
+
+			if (i < 0) {
+
+				return;
+			}
+			mob_store.type[i] = map_contents[MapIndex(x, y)];
+			mob = &mob_store.render[i];
 
 			//set sprites
-			for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
 
-				add_mob_sprite(mob, i, tnames[i], (x * SPRITE_SIZE * 2) - MAP_OFFSET, (y * SPRITE_SIZE * 2) - MAP_OFFSET);
+				add_mob_sprite(i, j, tnames[j], (x * SPRITE_SIZE * 2) - map_offset, (y * SPRITE_SIZE * 2) - map_offset);
 			}
 
 			mob->sprite[0]->skip_render = 0; //activate first sprite by default
 
+			set_mob_tile(i, mob->sprite[0]->position);
+
 			//add attack sprite
 			s = new_sprite();
 			s->tex_id = get_texture_id(attack_tname);
 			s->framecount = get_texture_framecount(attack_tname);
-			s->render_layer = get_texture_render_layer(attack_tname);
+			set_sprite_render_layer(s, get_texture_render_layer(attack_tname));
 			s->frame_msec = get_texture_frametime(attack_tname);
-			s->render_layer = get_texture_render_layer(attack_tname);
 			s->animation_pause = 1;
 			s->collision_mask = COLLISION_IGNORE;
 			s->position[VEC_X] = 0; //doesn't really matter at this moment?
@@ -268,7 +473,7 @@ void generate_mobs(void) {
 
 			mob->attack_sprite = s;
 
-			randomize_mob(mob); //set random statistics
+			randomize_mob(i, &rng); //set random statistics
 
 			//set statistics texts
 			//health
@@ -287,11 +492,10 @@ void generate_mobs(void) {
 			mob->text_background = new_sprite();
 			mob->text_background->tex_id = get_texture_id(MOB_UI_BG);
 			mob->text_background->framecount = get_texture_framecount(MOB_UI_BG);
-			mob->text_background->render_layer = get_texture_render_layer(MOB_UI_BG);
+			set_sprite_render_layer(mob->text_background, get_texture_render_layer(MOB_UI_BG));
 			mob->text_background->frame_msec = get_texture_frametime(MOB_UI_BG);
-			mob->text_background->render_layer = get_texture_render_layer(MOB_UI_BG);
 
-			mob_update_texts(mob);
+			mob_update_texts(i);
 		}
 	}
 }
@@ -299,59 +503,79 @@ void generate_mobs(void) {
 /*
 * Runs mob initialization (executed after map generation)
 */
-void init_mobs(void) {
+void init_mobs(unsigned int seed) {
+
+	//clear all existing mobs (from the back so nothing has to be moved)
+	while (mob_store.count) {
 
-	//clear all existing mobs
-	for (int i = 0; i < MAX_MOBS; i++) {
+		delete_mob(mob_store.count - 1);
+	}
+
+	//fit the occupancy maps to the new map
+	if (mob_map_size != map_size) {
+
+		free(mob_map);
+		free(reserved_map);
+
+		mob_map = malloc(sizeof(mob_handle_t) * map_size * map_size);
+		reserved_map = malloc(sizeof(int) * map_size * map_size);
+		mob_map_size = map_size;
 
-		if (mobs[i].sprite[0]) {
+		if (!mob_map || !reserved_map) {
 
-			delete_mob(&mobs[i]);
+			out_of_memory_error(__func__);
+			mob_map_size = 0;
+			return;
 		}
 	}
 
-	//wipe the entire array
-	memset(&mobs, 0, sizeof(mob_t) * MAX_MOBS);
+	memset(mob_map, 0, sizeof(mob_handle_t) * map_size * map_size);
+	memset(reserved_map, 0, sizeof(int) * map_size * map_size);
 
 	//generate new mobs
-	generate_mobs();
+	generate_mobs(seed);
+
+	//the same level always plays the same for the same player actions
+	rng_seed(&ai_rng, seed, RNG_STREAM_AI);
 }
 
 /*
 * Finds mob with a given position (if there is any).
 */
-mob_t *find_mob(vec2_t position) {
+mob_handle_t find_mob(vec2_t position) {
 
-	for (int i = 0; i < MAX_MOBS; i++) {
+	int x, y;
 
-		//check if mob is active and position matches
-		if (mobs[i].type != MAP_NOTHING && Vec2Compare(mobs[i].sprite[0]->position, position)) {
+	//check the occupancy map
+	if (mob_position_to_tile(position, &x, &y) && mob_map[MapIndex(x, y)]) {
 
-			return &mobs[i];
-		}
+		return mob_map[MapIndex(x, y)];
 	}
+
 	//found nothing
 	d_printf(LOG_WARNING, "%s: mob not found!\n", __func__);
-	return NULL;
+	return MOB_NONE;
 }
 
 /*
 * Executed when mob's health goes equal or below 0HP
 */
-void mob_die(mob_t *mob) {
+void mob_die(mob_handle_t handle) {
 
-	delete_mob(mob);
+	delete_mob(mob_index(handle));
 }
 
 /*
 * Activates correct mob sprite and sets look direction according to the rotation.
 */
-void mob_look_at_rotation(mob_t *mob, int rot) {
+void mob_look_at_rotation(int i, int rot) {
+
+	mob_render_t *mob = &mob_store.render[i];
 
 	//deactivate all sprites
-	for (int i = 0; i < 3; i++) {
+	for (int j = 0; j < 3; j++) {
 
-		mob->sprite[i]->skip_render = 1;
+		mob->sprite[j]->skip_render = 1;
 	}
 	//activate the correct sprite
 	switch (rot)
@@ -359,33 +583,34 @@ void mob_look_at_rotation(mob_t *mob, int rot) {
 		case ROTATION_0:
 		case ROTATION_90:
 			mob->sprite[0]->skip_render = 0;
-			mob->look_direction = LOOK_RIGHT;
+			mob_store.look_direction[i] = LOOK_RIGHT;
 			break;
 		case ROTATION_180:
 			mob->sprite[1]->skip_render = 0;
-			mob->look_direction = LOOK_LEFT;
+			mob_store.look_direction[i] = LOOK_LEFT;
 			break;
 		case ROTATION_270:
 			mob->sprite[2]->skip_render = 0;
-			mob->look_direction = LOOK_UP;
+			mob_store.look_direction[i] = LOOK_UP;
 			break;
 	}
 }
 
 /*
-* Glut timer callback that makes all mobs move from lerp_start to lerp_end
+* Scheduler task that makes all mobs move from lerp_start to lerp_end. With instant turns
+* the mobs are moved to lerp_end at once and the move ends in the same call.
 */
 void lerp_all_mobs(int value) {
 
 	vec2_t v;
 	int lerp_current_msec;
-	int msec = glutGet(GLUT_ELAPSED_TIME) - value; //get delta time (value is elapsed time on last frame)
+	int msec = TICK_MSEC; //runs once per tick
 	int all_done = 1;
 
 	//iterate over all mobs (they all move at once)
-	for (int i = 0; i < MAX_MOBS; i++) {
+	for (int i = 0; i < mob_store.count; i++) {
 
-		if (lerp_max_msecs[i] == 0 || lerp_msecs[i] == lerp_max_msecs[i]) {
+		if (mob_store.lerp_max_msecs[i] == 0 || mob_store.lerp_msecs[i] == mob_store.lerp_max_msecs[i]) {
 
 			//this mob doesn't move
 			continue;
@@ -393,53 +618,65 @@ void lerp_all_mobs(int value) {
 		all_done = 0; //this one needs to be moved, so it's not "all done"
 
 		//increment lerp miliseconds
-		lerp_current_msec = lerp_msecs[i] + msec;
+		lerp_current_msec = is_instant_turns ? mob_store.lerp_max_msecs[i] : mob_store.lerp_msecs[i] + msec;
 
 		//maximum lerp time reached?
-		if (lerp_current_msec >= lerp_max_msecs[i]) {
+		if (lerp_current_msec >= mob_store.lerp_max_msecs[i]) {
 
-			lerp_current_msec = lerp_max_msecs[i];
+			lerp_current_msec = mob_store.lerp_max_msecs[i];
 
 			//last frame, pause the animation
-			mobs[i].sprite[mobs[i].look_direction]->animation_pause = 1;
+			mob_store.render[i].sprite[mob_store.look_direction[i]]->animation_pause = 1;
 		}
 		else
 		{
 			//unpause the animation
-			mobs[i].sprite[mobs[i].look_direction]->animation_pause = 0;
+			mob_store.render[i].sprite[mob_store.look_direction[i]]->animation_pause = 0;
 		}
 
-		lerp_msecs[i] = lerp_current_msec;
+		mob_store.lerp_msecs[i] = lerp_current_msec;
 
 		//find new position of the mob (lerp between move start and end by total time's fraction in this frame
 		Vec2Zero(v);
-		Vec2Lerp(lerp_starts[i], lerp_ends[i], (float)lerp_current_msec / lerp_max_msecs[i], v);
+		Vec2Lerp(mob_store.lerp_starts[i], mob_store.lerp_ends[i], (float)lerp_current_msec / mob_store.lerp_max_msecs[i], v);
 
 		//apply position to all sprites
 		for (int j = 0; j < 3; j++) {
 
-			Vec2Copy(v, mobs[i].sprite[j]->position);
+			Vec2Copy(v, mob_store.render[i].sprite[j]->position);
+			register_pick_sprite(mob_store.render[i].sprite[j]); //moves to another pick tile when needed
 		}
 
 		//update stats texts
-		mob_update_texts(&mobs[i]);
+		mob_update_texts(i);
 	}
 
-	if (!all_done) {
+	if (!all_done && !is_instant_turns) {
 
 		//execute again at next tick time
-		glutTimerFunc(TICK_MSEC, lerp_all_mobs, glutGet(GLUT_ELAPSED_TIME)); //pass current time as value
+		schedule_task(lerp_all_mobs, TICK_MSEC, value);
 	}
 	else
 	{
 		//end
 		is_mob_move = 0;
+
+		//mobs are now standing on their destinations (the reservations are not needed anymore)
+		for (int i = 0; i < mob_store.count; i++) {
+
+			if (mob_store.lerp_max_msecs[i]) {
+
+				set_mob_tile(i, mob_store.lerp_ends[i]);
+				reserved_map[MapIndex(mob_store.tile_x[i], mob_store.tile_y[i])] = 0;
+			}
+		}
+
 		recalculate_sprites_visibility(); //recalculate visibility after movement
 	}
 }
 
 /*
-* This timer callback waits for attack routine to end and executes movement callback.
+* This task waits for attack routine to end and executes movement task.
 */
 void lerp_mobs_wait_for_attack(int value) {
 
@@ -448,18 +685,19 @@ void lerp_mobs_wait_for_attack(int value) {
 	if (is_mob_attack) {
 
 		//still attacking, recheck at next tick
-		glutTimerFunc(TICK_MSEC, lerp_mobs_wait_for_attack, 0);
+		schedule_task(lerp_mobs_wait_for_attack, TICK_MSEC, 0);
 	}
 	else
 	{
 		//run movement lerp routine
-		glutTimerFunc(TICK_MSEC, lerp_all_mobs, glutGet(GLUT_ELAPSED_TIME));
+		schedule_task(lerp_all_mobs, TICK_MSEC, 0);
 	}
 }
 
 /*
-* Attack routine callback. Basically this function makes the mob attack sprite appear for a while.
-* Value = 0: start attack, value = 1: end attack.
+* Attack routine task. Basically this function makes the mob attack sprite appear for a while.
+* Value = 0: start attack, value = 1: end attack, value = 2: only hide the attack sprites (the
+* attack didn't hold the turn, see is_instant_turns).
 */
 void attack_routine(int value) {
 
@@ -470,57 +708,68 @@ void attack_routine(int value) {
 
 		get_player_pos(&player_pos);
 
-		for (int i = 0; i < MAX_MOBS; i++) {
+		for (int i = 0; i < mob_store.count; i++) {
 
-			if (attacks_player[i]) {
+			if (mob_store.attacks_player[i]) {
 
 				//show the attack sprite
 
 				//set rotation
-				mobs[i].attack_sprite->rotation = LookToRot(mobs[i].look_direction);
+				mob_store.render[i].attack_sprite->rotation = LookToRot(mob_store.look_direction[i]);
 
 				//set attack sprite rotation
-				diff_x = player_pos[VEC_X] - mobs[i].sprite[0]->position[VEC_X];
-				diff_y = player_pos[VEC_Y] - mobs[i].sprite[0]->position[VEC_Y];
+				diff_x = player_pos[VEC_X] - mob_store.render[i].sprite[0]->position[VEC_X];
+				diff_y = player_pos[VEC_Y] - mob_store.render[i].sprite[0]->position[VEC_Y];
 
 				if (diff_x < 0) {
 
-					mobs[i].attack_sprite->rotation = 2;
+					mob_store.render[i].attack_sprite->rotation = 2;
 				}
 				else if(diff_x > 0)
 				{
-					mobs[i].attack_sprite->rotation = 0;
+					mob_store.render[i].attack_sprite->rotation = 0;
 				}
 				else if (diff_y < 0)
 				{
-					mobs[i].attack_sprite->rotation = 1;
+					mob_store.render[i].attack_sprite->rotation = 1;
 				}
 				else
 				{
-					mobs[i].attack_sprite->rotation = 3;
+					mob_store.render[i].attack_sprite->rotation = 3;
 				}
 
 				//activate the attack sprite
-				mobs[i].attack_sprite->skip_render = 0;
+				mob_store.render[i].attack_sprite->skip_render = 0;
 
 				//move to the correct position
-				Vec2Lerp(mobs[i].sprite[0]->position, player_pos, 0.5f, mobs[i].attack_sprite->position);
+				Vec2Lerp(mob_store.render[i].sprite[0]->position, player_pos, 0.5f, mob_store.render[i].attack_sprite->position);
 
 				//make player receive the damage
-				player_receive_damage(mobs[i].stats.attack_damage);
+				player_receive_damage(mob_store.stats[i].attack_damage);
 			}
 		}
 		//set to be called again to end after attack msecs have passed
-		glutTimerFunc(ATTACK_ANIM_MSEC, attack_routine, 1); 
+		schedule_task(attack_routine, ATTACK_ANIM_MSEC, is_instant_turns ? 2 : 1);
+	}
+	else if (value == 2)
+	{
+		//later turns may have changed the attackers, hide every attack sprite
+		for (int i = 0; i < mob_store.count; i++) {
+
+			if (mob_store.render[i].attack_sprite) {
+
+				mob_store.render[i].attack_sprite->skip_render = 1;
+			}
+		}
 	}
 	else
 	{
 		//end attack - hide all attack sprites
-		for (int i = 0; i < MAX_MOBS; i++) {
+		for (int i = 0; i < mob_store.count; i++) {
 
-			if (attacks_player[i]) {
+			if (mob_store.attacks_player[i]) {
 
-				mobs[i].attack_sprite->skip_render = 1;
+				mob_store.render[i].attack_sprite->skip_render = 1;
 			}
 		}
 
@@ -533,183 +782,111 @@ void attack_routine(int value) {
 */
 void all_mobs_attack(void) {
 
-	is_mob_attack = 1;
+	//with instant turns the movement doesn't wait for the attack sprites
+	is_mob_attack = !is_instant_turns;
 	attack_routine(0);
 }
 
 /*
-* Pathfinding. Uses heuristic to find best tile to move towards the player. Simply tries to decrease the distance
-* between the two as much as possible. If the tile cannot be stepped on (is water for example) then
-* movement is cancelled.
-* Returns 0 if no action can be performed, returns 1 if movement is performed and returns 2 if attack
-* is performed against the player.
-* dir_out: set to the direction of the movement (if any)
-* i: mob array index
+* Checks if another mob stands on the tile or is going to move there.
 */
-int to_player_mob_destination(mob_t *m, int i, int *dir_out) {
-
-	vec2_t dominant_dir;
-	vec2_t dominant_dir2;
-	vec2_t player_pos;
-	sprite_t *s;
-	sprite_t *s2 = NULL;
-	float diff_x, diff_y, abs_x, abs_y;
-	int k, x, y;
-	int rotation = 0;
-	int rotation2 = 0;
-	int try_both = 0;
-	int is_first_invalid = 0;
-
-	get_player_pos(&player_pos);
+int is_tile_taken_by_mob(vec2_t position) {
 
-	//find the best tile towards player
+	int x, y;
 
-	//position differences
-	diff_x = m->sprite[0]->position[VEC_X] - player_pos[VEC_X];
-	diff_y = m->sprite[0]->position[VEC_Y] - player_pos[VEC_Y];
-	//position distances
-	abs_x = fabsf(diff_x);
-	abs_y = fabsf(diff_y);
+	if (!mob_position_to_tile(position, &x, &y)) {
 
-	Vec2Copy(m->sprite[0]->position, dominant_dir);
-
-	//largest distance wins
-	if (abs_x > abs_y) {
-
-		dominant_dir[VEC_X] += SPRITE_SIZE * 2 * (diff_x > 0 ? -1 : 1);
-		rotation = diff_x > 0 ? 2 : 0;
-	}
-	else if(abs_x < abs_y)
-	{
-		dominant_dir[VEC_Y] += SPRITE_SIZE * 2 * (diff_y > 0 ? -1 : 1);
-		rotation = diff_y > 0 ? 1 : 3;
+		return 1;
 	}
-	else
-	{
-		//if both distances are equal then both need to be tried (one might be blocked by a wall for example)
-		try_both = 1;
-		Vec2Copy(m->sprite[0]->position, dominant_dir2);
 
-		dominant_dir[VEC_X] += SPRITE_SIZE * 2 * (diff_x > 0 ? -1 : 1);
-		rotation = diff_x > 0 ? 2 : 0;
+	return mob_map[MapIndex(x, y)] || reserved_map[MapIndex(x, y)];
+}
 
-		dominant_dir2[VEC_Y] += SPRITE_SIZE * 2 * (diff_y > 0 ? -1 : 1);
-		rotation2 = diff_y > 0 ? 1 : 3;
-	}
+/*
+* Starts a move of the mob at index i and reserves the destination tile.
+*/
+void reserve_mob_destination(int i, vec2_t destination) {
 
-	//check if attacks the player (must be close enough)
-	if (Vec2Distance(m->sprite[0]->position, player_pos) <= SPRITE_SIZE * 2) {
+	int x, y;
 
-		attacks_player[i] = 1;
+	Vec2Copy(mob_store.render[i].sprite[0]->position, mob_store.lerp_starts[i]);
+	Vec2Copy(destination, mob_store.lerp_ends[i]);
+	mob_store.lerp_max_msecs[i] = 1; //temporary set for other mob checks
 
-		mob_look_at_rotation(m, rotation);
+	if (mob_position_to_tile(destination, &x, &y)) {
 
-		return 2;
+		reserved_map[MapIndex(x, y)] = 1;
 	}
+}
 
-	//check other mobs
-	for (k = 0; k < MAX_MOBS; k++) {
-
-		if (!mobs[k].sprite[0]) {
-
-			//inactive mob
-			continue;
-		}
-
-		if (Vec2Distance(dominant_dir, mobs[k].sprite[0]->position) < SPRITE_SIZE) {
+/*
+* Pathfinding. Follows the player's flow field (see pathfinding.c) to the first free tile that is
+* closer to the player. If no such tile is free then movement is cancelled.
+* Returns 0 if no action can be performed, returns 1 if movement is performed and returns 2 if attack
+* is performed against the player.
+* dir_out: set to the direction of the movement (if any)
+* i: mob store index
+*/
+int to_player_mob_destination(int i, int *dir_out) {
 
-			//another mob is on that tile
-			if (try_both) {
+	vec2_t destination;
+	vec2_t player_pos;
+	float diff_x, diff_y;
+	int directions[4];
+	int count, x, y, rotation;
 
-				if (Vec2Distance(dominant_dir2, mobs[k].sprite[0]->position) < SPRITE_SIZE) {
+	get_player_pos(&player_pos);
 
-					//also on the second tile
-					return 0;
-				}
-			}
-			else
-			{
-				return 0;
-			}
-			is_first_invalid = 1;
-		}
+	//check if attacks the player (must be close enough)
+	if (Vec2Distance(mob_store.render[i].sprite[0]->position, player_pos) <= SPRITE_SIZE * 2) {
 
-		//if lerp vector is set and the distance to it is too small... (another mob will take this tile)
-		if (lerp_max_msecs[k] && Vec2Distance(dominant_dir, lerp_ends[k]) < SPRITE_SIZE) {
+		mob_store.attacks_player[i] = 1;
 
-			if (try_both) {
+		//look towards the player along the longer axis
+		diff_x = mob_store.render[i].sprite[0]->position[VEC_X] - player_pos[VEC_X];
+		diff_y = mob_store.render[i].sprite[0]->position[VEC_Y] - player_pos[VEC_Y];
 
-				if (lerp_max_msecs[k] && Vec2Distance(dominant_dir2, lerp_ends[k]) < SPRITE_SIZE) {
+		if (fabsf(diff_x) >= fabsf(diff_y)) {
 
-					//both will be taken
-					return 0;
-				}
-			}
-			else
-			{
-				return 0;
-			}
-			is_first_invalid = 1;
+			rotation = diff_x > 0 ? 2 : 0;
+		}
+		else
+		{
+			rotation = diff_y > 0 ? 1 : 3;
 		}
-	}
 
-	//check tiles
-	x = (int)((MAP_OFFSET + dominant_dir[VEC_X]) / (SPRITE_SIZE * 2));
-	y = (int)((MAP_OFFSET + dominant_dir[VEC_Y]) / (SPRITE_SIZE * 2));
+		mob_look_at_rotation(i, rotation);
 
-	s = sprite_map[x][y];
+		return 2;
+	}
 
-	if (!s) {
+	//find the directions that lead closer to the player
+	mob_position_to_tile(mob_store.render[i].sprite[0]->position, &x, &y);
 
-		if (!try_both) {
+	count = flow_field_directions(x, y, directions);
 
-			return 0;
-		}
-		is_first_invalid = 1;
-	}
-	if (try_both) {
+	//take the first free tile
+	for (int j = 0; j < count; j++) {
 
-		x = (int)((MAP_OFFSET + dominant_dir2[VEC_X]) / (SPRITE_SIZE * 2));
-		y = (int)((MAP_OFFSET + dominant_dir2[VEC_Y]) / (SPRITE_SIZE * 2));
+		rotation = directions[j];
 
-		s2 = sprite_map[x][y];
+		Vec2Copy(mob_store.render[i].sprite[0]->position, destination);
+		destination[VEC_X] += (SPRITE_SIZE * 2 * !(rotation & 1)) * (rotation > 0 ? -1 : 1);
+		destination[VEC_Y] += (SPRITE_SIZE * 2 * (rotation & 1)) * (rotation > 1 ? 1 : -1);
 
-		if (!s2 && is_first_invalid) {
+		if (is_tile_taken_by_mob(destination)) {
 
-			return 0;
+			continue;
 		}
-	}
-
-	if ((s->collision_mask & COLLISION_FLOOR) && !is_first_invalid) { //is target a floor?
 
 		//walk here
-
-		//calculate lerp
-		Vec2Copy(m->sprite[0]->position, lerp_starts[i]);
-		Vec2Copy(m->sprite[0]->position, lerp_ends[i]);
-
-		lerp_ends[i][VEC_X] += (SPRITE_SIZE * 2 * !(rotation & 1)) * (rotation > 0 ? -1 : 1);
-		lerp_ends[i][VEC_Y] += (SPRITE_SIZE * 2 * (rotation & 1)) * (rotation > 1 ? 1 : -1);
-		lerp_max_msecs[i] = 1; //temporary set for other mob checks
+		reserve_mob_destination(i, destination);
 
 		*dir_out = rotation;
 
 		return 1;
 	}
-	else if (try_both && s2 && s2->collision_mask & COLLISION_FLOOR) { //is the second target a flooor?
-
-		//or here
-		Vec2Copy(m->sprite[0]->position, lerp_starts[i]);
-		Vec2Copy(m->sprite[0]->position, lerp_ends[i]);
 
-		lerp_ends[i][VEC_X] += (SPRITE_SIZE * 2 * !(rotation2 & 1)) * (rotation2 > 0 ? -1 : 1);
-		lerp_ends[i][VEC_Y] += (SPRITE_SIZE * 2 * (rotation2 & 1)) * (rotation2 > 1 ? 1 : -1);
-		lerp_max_msecs[i] = 1; //temporary set for other mob checks
-
-		*dir_out = rotation2;
-
-		return 1;
-	}
 	//nowhere to go
 	return 0;
 }
@@ -720,15 +897,14 @@ int to_player_mob_destination(mob_t *m, int i, int *dir_out) {
 * Returns 0 if no action can be performed, returns 1 if movement is performed and returns 2 if attack
 * is performed against the player.
 * dir_out: set to the direction of the movement (if any)
-* i: mob array index
+* i: mob store index
 */
-int random_mob_destination(mob_t *m, int i, int *rand_out) {
+int random_mob_destination(int i, int *rand_out) {
 
 	vec2_t vtemp;
 	vec2_t player_pos;
 	int available_angles[4];
-	int x, y, random, no_angles, j, k;
-	sprite_t *s;
+	int x, y, random, no_angles, j;
 
 	get_player_pos(&player_pos);
 
@@ -738,7 +914,7 @@ int random_mob_destination(mob_t *m, int i, int *rand_out) {
 	//check all directions
 	for (j = 0; j < 4; j++) {
 
-		Vec2Copy(m->sprite[0]->position, vtemp);
+		Vec2Copy(mob_store.render[i].sprite[0]->position, vtemp);
 
 		//add direction unit vector to vtemp
 		vtemp[VEC_X] += (SPRITE_SIZE * 2 * !(j & 1)) * (j > 0 ? -1 : 1);
@@ -747,54 +923,29 @@ int random_mob_destination(mob_t *m, int i, int *rand_out) {
 		//check attacks the player at this angle
 		if (Vec2Distance(vtemp, player_pos) < SPRITE_SIZE) {
 
-			attacks_player[i] = 1;
+			mob_store.attacks_player[i] = 1;
 
 			//look at the player
-			mob_look_at_rotation(m, j);
+			mob_look_at_rotation(i, j);
 
 			return 2;
 		}
 
 		//check other mobs
-		for (k = 0; k < MAX_MOBS; k++) {
-
-			if (!mobs[k].sprite[0]) {
-
-				//mob inactive
-				continue;
-			}
-
-			if (Vec2Distance(vtemp, mobs[k].sprite[0]->position) < SPRITE_SIZE) {
-
-				//another mob is on that tile
-				goto next_angle;
-			}
-			//if lerp vector is set and the distance is too small... (another mob will take this tile)
-			if (lerp_max_msecs[k] && Vec2Distance(vtemp, lerp_ends[k]) < SPRITE_SIZE) {
+		if (is_tile_taken_by_mob(vtemp)) {
 
-				goto next_angle;
-			}
+			continue;
 		}
 
-		//check tiles
-		x = (int)((MAP_OFFSET + vtemp[VEC_X]) / (SPRITE_SIZE * 2));
-		y = (int)((MAP_OFFSET + vtemp[VEC_Y]) / (SPRITE_SIZE * 2));
-
-		s = sprite_map[x][y];
+		//check tiles (the tile sprite might not exist, see chunks.c)
+		mob_position_to_tile(vtemp, &x, &y);
 
-		if (!s) {
-
-			continue;
-		}
-		if (s->collision_mask & COLLISION_FLOOR) {
+		if (get_collision_mask(x, y) & COLLISION_FLOOR) {
 
 			//this tile is available
 			available_angles[j] = 1;
 			no_angles = 0;
 		}
-
-	next_angle:
-		continue;
 	}
 
 	//mob can't go anywhere
@@ -805,16 +956,16 @@ int random_mob_destination(mob_t *m, int i, int *rand_out) {
 
 	//pick a random available angle
 	do {
-		random = Random(0, 3);
+		random = rng_range(&ai_rng, 0, 3);
 	} while (!available_angles[random]);
 
 	//calculate lerp data
-	Vec2Copy(m->sprite[0]->position, lerp_starts[i]);
-	Vec2Copy(m->sprite[0]->position, lerp_ends[i]);
+	Vec2Copy(mob_store.render[i].sprite[0]->position, vtemp);
+
+	vtemp[VEC_X] += (SPRITE_SIZE * 2 * !(random & 1)) * (random > 0 ? -1 : 1);
+	vtemp[VEC_Y] += (SPRITE_SIZE * 2 * (random & 1)) * (random > 1 ? 1 : -1);
 
-	lerp_ends[i][VEC_X] += (SPRITE_SIZE * 2 * !(random & 1)) * (random > 0 ? -1 : 1);
-	lerp_ends[i][VEC_Y] += (SPRITE_SIZE * 2 * (random & 1)) * (random > 1 ? 1 : -1);
-	lerp_max_msecs[i] = 1; //temporary set for other mob checks
+	reserve_mob_destination(i, vtemp);
 
 	*rand_out = random;
 
@@ -826,37 +977,45 @@ int random_mob_destination(mob_t *m, int i, int *rand_out) {
 */
 void calculate_mob_destinations(void) {
 
-	int current, i;
+	int current, i, x, y;
 	int direction = 0;
 	int any_attacks = 0;
+	vec2_t player_pos;
+	mob_render_t *r;
+	double start = profile_start();
 
-	//clear all behaviour arrays
-	memset(&lerp_starts, 0, sizeof(vec2_t) * MAX_MOBS);
-	memset(&lerp_ends, 0, sizeof(vec2_t) * MAX_MOBS);
-	memset(&lerp_msecs, 0, sizeof(int) * MAX_MOBS);
-	memset(&lerp_max_msecs, 0, sizeof(int) * MAX_MOBS);
-	memset(&attacks_player, 0, sizeof(int) * MAX_MOBS);
+	//clear all behaviour data
+	memset(mob_store.lerp_msecs, 0, sizeof(int) * mob_store.count);
+	memset(mob_store.lerp_max_msecs, 0, sizeof(int) * mob_store.count);
+	memset(mob_store.attacks_player, 0, sizeof(int) * mob_store.count);
 
-	for (i = 0; i < MAX_MOBS; i++) {
+	//one flow field towards the player is shared by all following mobs
+	get_player_pos(&player_pos);
+	mob_position_to_tile(player_pos, &x, &y);
+	update_flow_field(x, y);
 
-		if (!mobs[i].sprite[0] || !mobs[i].sprite[1]|| !mobs[i].sprite[2]	//no sprite?
-			|| (mobs[i].sprite[0]->skip_render == 1 &&						//inactive?
-			mobs[i].sprite[1]->skip_render == 1 && 
-			mobs[i].sprite[2]->skip_render == 1)) {
+	for (i = 0; i < mob_store.count; i++) {
+
+		r = &mob_store.render[i];
+
+		if (!r->sprite[0] || !r->sprite[1] || !r->sprite[2]	//no sprite?
+			|| (r->sprite[0]->skip_render == 1 &&			//inactive?
+			r->sprite[1]->skip_render == 1 &&
+			r->sprite[2]->skip_render == 1)) {
 
 			//mob inactive
 			continue;
 		}
 
-		if (mobs[i].type == MAP_MOB_SLIME) {
+		if (mob_store.type[i] == MAP_MOB_SLIME) {
 
 			//slime moves randomly
-			current = random_mob_destination(&mobs[i], i, &direction);
+			current = random_mob_destination(i, &direction);
 		}
 		else
 		{
 			//goblin follows the player
-			current = to_player_mob_destination(&mobs[i], i, &direction);
+			current = to_player_mob_destination(i, &direction);
 		}
 
 		if (current == 2) { //2 == attack
@@ -870,12 +1029,14 @@ void calculate_mob_destinations(void) {
 		}
 
 		//make mobs move faster than the player (slow movement ruins the game "dynamics"...)
-		lerp_max_msecs[i] = (int)((1000 / (MOVE_SPEED * 8)) * SPRITE_SIZE * 2);
+		mob_store.lerp_max_msecs[i] = (int)((1000 / (MOVE_SPEED * 8)) * SPRITE_SIZE * 2);
 
 		//make mob look at the direction
-		mob_look_at_rotation(&mobs[i], direction);
+		mob_look_at_rotation(i, direction);
 	}
 
+	profile_end(PROFILE_AI, start);
+
 	//start attacks
 	if (any_attacks) {
 
@@ -883,18 +1044,25 @@ void calculate_mob_destinations(void) {
 
 	}
 
+	if (is_instant_turns) {
+
+		//move right away
+		lerp_all_mobs(0);
+		return;
+	}
+
 	//start waiting for attacks to end in order to perform move
-	glutTimerFunc(TICK_MSEC, lerp_mobs_wait_for_attack, 0);
+	schedule_task(lerp_mobs_wait_for_attack, TICK_MSEC, 0);
 }
 
 /*
-* Callback that waits for player movement to end. After that happens it starts mob behaviours calculation.
+* Task that waits for player movement to end. After that happens it starts mob behaviours calculation.
 */
 void wait_for_player(int value) {
 
 	if (is_player_move) { //still moving, wait anoher tick
 
-		glutTimerFunc(TICK_MSEC, wait_for_player, value);
+		schedule_task(wait_for_player, TICK_MSEC, value);
 	}
 	else
 	{
@@ -908,51 +1076,79 @@ void wait_for_player(int value) {
 void mobs_move(void) {
 
 	is_mob_move = 1;
+	turn_count++;
 
-	glutTimerFunc(TICK_MSEC, wait_for_player, 0);
+	if (is_instant_turns) {
+
+		//the player move has already ended, the whole turn resolves now
+		calculate_mob_destinations();
+		return;
+	}
+
+	schedule_task(wait_for_player, TICK_MSEC, 0);
+}
+
+/*
+* Returns the amount of turns played (every player action ends with a mob turn).
+*/
+int get_turn_count(void) {
+
+	return turn_count;
 }
 
 /*
 * Calculates damage received by the mob and triggers a kill if necessary.
 */
-void mob_receive_damage(mob_t *mob, int damage) {
+void mob_receive_damage(mob_handle_t handle, int damage) {
 
 	int armor_diff;
+	int i = mob_index(handle);
+	player_stats_t *stats;
+	sprite_t *s;
+
+	if (i < 0) {
+
+		d_printf(LOG_WARNING, "%s: dead mob passed as the argument\n", __func__);
+		return;
+	}
+
+	stats = &mob_store.stats[i];
+	s = mob_store.render[i].sprite[0];
 
-	armor_diff = mob->stats.armor - damage;
+	armor_diff = stats->armor - damage;
 
 	if (armor_diff < 0) {
 
 		//armor destroyed
-		armor_diff = damage - mob->stats.armor; //leftover damage
-		mob->stats.armor = 0;
+		armor_diff = damage - stats->armor; //leftover damage
+		stats->armor = 0;
 
 		//hp
-		mob->stats.health -= armor_diff;
+		stats->health -= armor_diff;
 	}
 	else
 	{
 		//armor takes all the damage
-		mob->stats.armor -= damage;
+		stats->armor -= damage;
 	}
 
 	//death?
-	if (mob->stats.health <= 0) {
+	if (stats->health <= 0) {
 
-		mob->stats.health = 0;
-		mob->stats.armor = 0;
+		stats->health = 0;
+		stats->armor = 0;
 
 		//death particles
-		make_death_particles(mob->sprite[0]->position);
+		make_death_particles(s->position);
 
-		mob_die(mob);
+		mob_die(handle);
 	}
 	else
 	{
 		//add blood effect
-		make_blood_particles(mob->sprite[0]->position, mob->sprite[0]->position[VEC_Y] - SPRITE_SIZE + 0.08f);
+		make_blood_particles(s->position, s->position[VEC_Y] - SPRITE_SIZE + 0.08f);
 
 		//refresh stats texts
-		mob_update_texts(mob);
+		mob_update_texts(i);
 	}
 }
\ No newline at end of file
@@ -13,8 +13,8 @@ void door_action(sprite_t *s) {
 
 	//open the door
 	s->current_frame = 2;
-	s->collision_mask = COLLISION_FLOOR;
-	s->render_layer = RENDER_LAYER_FLOOR;
+	set_tile_collision_mask(s, COLLISION_FLOOR);
+	set_sprite_render_layer(s, RENDER_LAYER_FLOOR);
 	s->action = NULL;
 
 	//recalculate visibility
@@ -34,8 +34,8 @@ void locked_door_action(sprite_t *s) {
 
 		//already unlocked -> open the door completely
 		s->current_frame = 3;
-		s->collision_mask = COLLISION_FLOOR;
-		s->render_layer = RENDER_LAYER_FLOOR;
+		set_tile_collision_mask(s, COLLISION_FLOOR);
+		set_sprite_render_layer(s, RENDER_LAYER_FLOOR);
 		s->action = NULL;
 		recalculate_sprites_visibility();
 	}
@@ -66,8 +66,8 @@ void chest_action(sprite_t *s) {
 
 		//chest becomes a normal floor with a different texture frame
 		s->current_frame = 2; //frame 2 is an image of the open chest
-		s->collision_mask = COLLISION_FLOOR;
-		s->render_layer = RENDER_LAYER_FLOOR;
+		set_tile_collision_mask(s, COLLISION_FLOOR);
+		set_sprite_render_layer(s, RENDER_LAYER_FLOOR);
 		s->action = NULL;
 
 		//if data is not present add health. else add armor
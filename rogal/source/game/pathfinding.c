@@ -0,0 +1,218 @@
+/*
+* This file contains the flow field used by mobs that follow the player.
+*
+* The flow field is a map of walking distances (in tiles) to the target tile,
+* found with a breadth-first search over the walkable tiles (tiles with the
+* COLLISION_FLOOR mask in collision_map). It is built once per mob turn and
+* shared by all mobs: a mob finds its next step by looking at its neighbors
+* and picking one that is closer to the target.
+*
+* The field is only rebuilt when the target moves. Opening a door only makes
+* the distances shorter, so instead of a rebuild the new distances are
+* propagated from the opened tile.
+*/
+
+#include "game.h"
+#include <string.h>
+#include <stdlib.h>
+
+//distance of tiles that can't reach the target
+#define FLOW_UNREACHABLE	-1
+
+//distances to the target tile (map_size * map_size)
+static int *flow_field;
+
+//target of the current field
+static int target_x, target_y;
+static int is_flow_valid = 0;
+
+//breadth-first search queue (as MapIndex)
+static int *queue;
+
+//neighbor offsets for each rotation (see ROTATION_...)
+static const int rotation_x[4] = { 1, 0, -1, 0 };
+static const int rotation_y[4] = { 0, -1, 0, 1 };
+
+/*
+* Checks if mobs can walk on the tile.
+*/
+int is_tile_walkable(int x, int y) {
+
+	return is_inside_map(x, y) && (collision_map[MapIndex(x, y)] & COLLISION_FLOOR);
+}
+
+/*
+* Propagates distances from the queued tiles until nothing gets shorter.
+*/
+void propagate_flow(int head, int tail) {
+
+	int x, y, nx, ny, distance;
+
+	while (head < tail) {
+
+		x = queue[head] / map_size;
+		y = queue[head] % map_size;
+		head++;
+
+		distance = flow_field[MapIndex(x, y)] + 1;
+
+		for (int r = 0; r < 4; r++) {
+
+			nx = x + rotation_x[r];
+			ny = y + rotation_y[r];
+
+			if (!is_tile_walkable(nx, ny)) {
+
+				continue;
+			}
+
+			if (flow_field[MapIndex(nx, ny)] == FLOW_UNREACHABLE || flow_field[MapIndex(nx, ny)] > distance) {
+
+				//the search starts from a single tile so the first distance found is the shortest
+				//and every tile is queued at most once
+				flow_field[MapIndex(nx, ny)] = distance;
+				queue[tail++] = MapIndex(nx, ny);
+			}
+		}
+	}
+}
+
+/*
+* Reallocates the flow field for the current map size.
+*/
+void resize_flow_field(void) {
+
+	free(flow_field);
+	free(queue);
+
+	flow_field = malloc(sizeof(int) * map_size * map_size);
+	queue = malloc(sizeof(int) * map_size * map_size);
+	is_flow_valid = 0;
+
+	if (!flow_field || !queue) {
+
+		out_of_memory_error(__func__);
+	}
+}
+
+/*
+* Builds the flow field towards the given map tile. Does nothing if the field for
+* that tile is already up to date.
+*/
+void update_flow_field(int x, int y) {
+
+	if (is_flow_valid && x == target_x && y == target_y) {
+
+		return;
+	}
+
+	memset(flow_field, FLOW_UNREACHABLE, sizeof(int) * map_size * map_size);
+
+	target_x = x;
+	target_y = y;
+	is_flow_valid = 1;
+
+	if (!is_inside_map(x, y)) {
+
+		return;
+	}
+
+	flow_field[MapIndex(x, y)] = 0;
+	queue[0] = MapIndex(x, y);
+
+	propagate_flow(0, 1);
+}
+
+/*
+* Marks the flow field as outdated (used when a new map is created).
+*/
+void invalidate_flow_field(void) {
+
+	is_flow_valid = 0;
+}
+
+/*
+* Updates the flow field after a tile became walkable (for example an opened door).
+*/
+void flow_field_tile_opened(int x, int y) {
+
+	int nx, ny;
+	int distance = FLOW_UNREACHABLE;
+
+	if (!is_flow_valid || !is_tile_walkable(x, y)) {
+
+		return;
+	}
+
+	//find the shortest distance through the neighbors
+	for (int r = 0; r < 4; r++) {
+
+		nx = x + rotation_x[r];
+		ny = y + rotation_y[r];
+
+		if (is_tile_walkable(nx, ny) && flow_field[MapIndex(nx, ny)] != FLOW_UNREACHABLE &&
+			(distance == FLOW_UNREACHABLE || flow_field[MapIndex(nx, ny)] + 1 < distance)) {
+
+			distance = flow_field[MapIndex(nx, ny)] + 1;
+		}
+	}
+
+	if (distance == FLOW_UNREACHABLE || (flow_field[MapIndex(x, y)] != FLOW_UNREACHABLE && flow_field[MapIndex(x, y)] <= distance)) {
+
+		//nothing changes
+		return;
+	}
+
+	flow_field[MapIndex(x, y)] = distance;
+	queue[0] = MapIndex(x, y);
+
+	propagate_flow(0, 1);
+}
+
+/*
+* Finds the directions (rotations) that lead closer to the flow field target from the given tile.
+* Directions along the longer axis to the target come first.
+* Returns the amount of directions written to the array.
+*/
+int flow_field_directions(int x, int y, int directions[4]) {
+
+	int count = 0;
+	int nx, ny, r;
+	int first_rotations[4];
+
+	if (!is_flow_valid || !is_inside_map(x, y) ||
+		flow_field[MapIndex(x, y)] == FLOW_UNREACHABLE || flow_field[MapIndex(x, y)] == 0) {
+
+		return 0;
+	}
+
+	//try the longer axis first (looks more natural when there are two equal paths)
+	if (abs(target_x - x) >= abs(target_y - y)) {
+
+		first_rotations[0] = ROTATION_0;
+		first_rotations[1] = ROTATION_180;
+		first_rotations[2] = ROTATION_90;
+		first_rotations[3] = ROTATION_270;
+	}
+	else
+	{
+		first_rotations[0] = ROTATION_90;
+		first_rotations[1] = ROTATION_270;
+		first_rotations[2] = ROTATION_0;
+		first_rotations[3] = ROTATION_180;
+	}
+
+	for (int i = 0; i < 4; i++) {
+
+		r = first_rotations[i];
+		nx = x + rotation_x[r];
+		ny = y + rotation_y[r];
+
+		if (is_tile_walkable(nx, ny) && flow_field[MapIndex(nx, ny)] != FLOW_UNREACHABLE && flow_field[MapIndex(nx, ny)] < flow_field[MapIndex(x, y)]) {
+
+			directions[count++] = r;
+		}
+	}
+
+	return count;
+}
@@ -1,8 +1,8 @@
 #include "player.h"
 #include "camera.h"
+#include "raycast.h"
 #include "ui.h"
 #include "particles.h"
-#include <GL/glut.h>
 
 player_t player;
 
@@ -37,14 +37,14 @@ void set_player_default_weapon(void) {
 
 	s->tex_id = get_texture_id(SWORD);
 	s->framecount = get_texture_framecount(SWORD);
-	s->render_layer = get_texture_render_layer(SWORD);
+	set_sprite_render_layer(s, get_texture_render_layer(SWORD));
 	s->frame_msec = get_texture_frametime(SWORD);
 	w->modifier_value = 1;
 	s->action = weapon_pickup_action;
 
 	//item is picked up
 	s->collision_mask = COLLISION_IGNORE;
-	s->render_layer = RENDER_LAYER_EFFECT;
+	set_sprite_render_layer(s, RENDER_LAYER_EFFECT);
 	s->skip_render = 1;
 
 	s->scale_x = 0.5f;
@@ -68,7 +68,7 @@ void player_drop_weapon(void) {
 	}
 
 	w->sprite->collision_mask = COLLISION_ITEM;
-	w->sprite->render_layer = RENDER_LAYER_ITEM;
+	set_sprite_render_layer(w->sprite, RENDER_LAYER_ITEM);
 	w->sprite->skip_render = 0;
 
 	//visibility
@@ -79,6 +79,7 @@ void player_drop_weapon(void) {
 	w->sprite->scale_y = 1.f;
 
 	Vec2Copy(player.sprite[0]->position, w->sprite->position);
+	register_pick_sprite(w->sprite);
 }
 
 void player_pickup_weapon(item_t *w) {
@@ -87,7 +88,7 @@ void player_pickup_weapon(item_t *w) {
 
 	//set item sprite
 	w->sprite->collision_mask = COLLISION_IGNORE;
-	w->sprite->render_layer = RENDER_LAYER_EFFECT;
+	set_sprite_render_layer(w->sprite, RENDER_LAYER_EFFECT);
 	w->sprite->skip_render = 1;
 
 	w->sprite->scale_x = 0.5f;
@@ -119,7 +120,7 @@ sprite_t *new_player_sprite(void) {
 
 	s->animation_pause = 1;
 	s->skip_render = 1;
-	s->render_layer = RENDER_LAYER_PLAYER;
+	set_sprite_render_layer(s, RENDER_LAYER_PLAYER);
 	s->collision_mask = COLLISION_IGNORE;
 
 	return s;
@@ -230,7 +231,7 @@ void walk_routine(int value) {
 	vec2_t v;
 	vec2_t particle_v;
 	vec2_t particle_v2;
-	int msec = glutGet(GLUT_ELAPSED_TIME) - value;
+	int msec = TICK_MSEC;
 
 	//calculate msec
 	int lerp_current_msec = lerp_msec + msec;
@@ -279,20 +280,27 @@ void walk_routine(int value) {
 	if (lerp_current_msec != lerp_max_msec) {
 
 		//continue routine
-		glutTimerFunc(TICK_MSEC, walk_routine, glutGet(GLUT_ELAPSED_TIME));
+		schedule_task(walk_routine, TICK_MSEC, value);
 	}
 	else 
 	{
-		//end move
-		is_player_move = 0;
-		player.sprite[player.look_direction]->animation_pause = 1;
-		player.sprite[player.look_direction]->current_frame = 1;
-
-		//recalculate visibility
-		recalculate_sprites_visibility();
+		end_walk();
 	}
 }
 
+/*
+* Ends the player move (the player stands on the destination tile).
+*/
+void end_walk(void) {
+
+	is_player_move = 0;
+	player.sprite[player.look_direction]->animation_pause = 1;
+	player.sprite[player.look_direction]->current_frame = 1;
+
+	//recalculate visibility
+	recalculate_sprites_visibility();
+}
+
 void walk_to_tile(vec2_t position, float dist) {
 
 	player.sprite[player.look_direction]->animation_pause = 0;
@@ -301,22 +309,40 @@ void walk_to_tile(vec2_t position, float dist) {
 	lerp_max_msec = (int)((1000 / MOVE_SPEED) * dist);
 	Vec2Copy(player.sprite[0]->position, lerp_start);
 	Vec2Copy(position, lerp_end);
+
+	if (is_instant_turns) {
+
+		//step onto the tile at once
+		for (int i = 0; i < 3; i++) {
+
+			Vec2Copy(lerp_end, player.sprite[i]->position);
+		}
+
+		set_camera_position(lerp_end);
+		end_walk();
+		return;
+	}
+
 	is_player_move = 1;
 
 	particle_msec_accumulator = 0;
 	particle_msec_current_limit = Random(20, 60);
 
-	glutTimerFunc(TICK_MSEC, walk_routine, glutGet(GLUT_ELAPSED_TIME));
+	schedule_task(walk_routine, TICK_MSEC, 0);
 }
 
-void attack_animation(int stop) {
+/*
+* Weapon animation task. Value = 0: show the weapon, value = 1: hide it and end the player move,
+* value = 2: only hide it (the animation didn't hold the turn, see is_instant_turns).
+*/
+void attack_animation(int value) {
 
 	float diff_x, diff_y;
 	// "animation"
-	if (!stop) {
+	if (!value) {
 
-		//make the game wait for animation to end
-		is_player_move = 1;
+		//make the game wait for animation to end (the weapon is only shown with instant turns)
+		is_player_move = !is_instant_turns;
 
 		//show the weapon
 		diff_x = player.sprite[0]->position[VEC_X] - attack_anim_target[VEC_X];
@@ -331,7 +357,7 @@ void attack_animation(int stop) {
 		
 		Color3Copy(player.weapon->rarity_color, player.weapon->sprite->color);
 
-		glutTimerFunc(ATTACK_ANIM_MSEC, attack_animation, 1);
+		schedule_task(attack_animation, ATTACK_ANIM_MSEC, is_instant_turns ? 2 : 1);
 	}
 	else
 	{
@@ -341,19 +367,29 @@ void attack_animation(int stop) {
 
 		player.weapon->sprite->skip_render = 1;
 
-		is_player_move = 0;
+		if (value == 1) {
+
+			is_player_move = 0;
+		}
 	}
 
 }
 
-void attack_mob(mob_t *mob) {
+void attack_mob(mob_handle_t handle) {
+
+	int i = mob_index(handle);
+
+	if (i < 0) {
+
+		return;
+	}
 
 	//show weapon animation
-	Vec2Copy(mob->sprite[0]->position, attack_anim_target);
+	Vec2Copy(mob_store.render[i].sprite[0]->position, attack_anim_target);
 	attack_animation(0);
 
 	//attack...
-	mob_receive_damage(mob, player.stats.attack_damage);
+	mob_receive_damage(handle, player.stats.attack_damage);
 }
 
 void player_die(void) {
@@ -0,0 +1,484 @@
+/*
+* This file records the input events into a file and replays them.
+*
+* The GLUT input callbacks go through this file: when recording, every keyboard,
+* special key and mouse event is written with the simulation tick it arrived at
+* (the events arrive between two ticks), and every new run is written with its
+* seed and level. The game is deterministic for the same seed, the same events
+* and the same ticks, so a replay injects the events after the same ticks and
+* takes the run seeds from the file instead of the clock. Mouse positions are
+* stored as world positions and replayed as world positions (not converted back
+* to window pixels, which may round to the neighbouring sprite), so the window
+* size doesn't have to match.
+*
+* A replay runs either at the real speed (the frame timer advances the ticks) or
+* as fast as possible: then the ticks are run back to back without waiting, so
+* the animations are collapsed. Live input is ignored until the replay ends.
+*
+* File format (little endian):
+*	header: "RGRP", version (u8), TICK_MSEC (u8)
+*	event:  tick (u32), type (u8), then
+*		REPLAY_RUN:							seed (u32), level (u16)
+*		REPLAY_KEYBOARD/SPECIAL/MOUSE:		key or button (u8), state (u8), world x, y (f32)
+*/
+
+#include "game.h"
+#include "camera.h"
+#include <string.h>
+
+#define REPLAY_MAGIC	"RGRP"
+#define REPLAY_VERSION	1
+
+//a recorded event
+typedef struct replay_event {
+	unsigned int	tick;		//simulation tick the event arrived after
+	int				type;		//REPLAY_...
+	int				key;		//key, special key or mouse button
+	int				state;		//mouse button state
+	vec2_t			position;	//mouse world position
+	unsigned int	seed;		//REPLAY_RUN only
+	int				level;		//REPLAY_RUN only
+} replay_event_t;
+
+//recording
+static FILE *record_file;
+
+//replay
+static replay_event_t *events;
+static int event_count;
+static int next_event;
+static int is_replay;
+static int is_fast;
+
+//----------
+// file encoding
+//----------
+
+void write_u8(FILE *f, unsigned int value) {
+
+	fputc((int)(value & 0xFF), f);
+}
+
+void write_u16(FILE *f, unsigned int value) {
+
+	write_u8(f, value);
+	write_u8(f, value >> 8);
+}
+
+void write_u32(FILE *f, unsigned int value) {
+
+	write_u16(f, value);
+	write_u16(f, value >> 16);
+}
+
+void write_f32(FILE *f, float value) {
+
+	unsigned int bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	write_u32(f, bits);
+}
+
+/*
+* Reads a little endian number of the given size from the buffer. Returns 0 when the buffer ends.
+*/
+int read_uint(const unsigned char *buffer, long size, long *pos, int bytes, unsigned int *out) {
+
+	if (*pos + bytes > size) {
+
+		return 0;
+	}
+
+	*out = 0;
+
+	for (int i = 0; i < bytes; i++) {
+
+		*out |= (unsigned int)buffer[(*pos)++] << (8 * i);
+	}
+	return 1;
+}
+
+int read_f32(const unsigned char *buffer, long size, long *pos, float *out) {
+
+	unsigned int bits;
+
+	if (!read_uint(buffer, size, pos, 4, &bits)) {
+
+		return 0;
+	}
+
+	memcpy(out, &bits, sizeof(bits));
+	return 1;
+}
+
+//----------
+// recording
+//----------
+
+/*
+* Starts recording the input events into the given file. Returns 0 if the file couldn't be created.
+*/
+int start_recording(const char *filename) {
+
+	record_file = fopen(filename, "wb");
+
+	if (!record_file) {
+
+		d_printf(LOG_ERROR, "%s: can't create %s\n", __func__, filename);
+		return 0;
+	}
+
+	fputs(REPLAY_MAGIC, record_file);
+	write_u8(record_file, REPLAY_VERSION);
+	write_u8(record_file, TICK_MSEC);
+
+	d_printf(LOG_INFO, "%s: recording into %s\n", __func__, filename);
+	return 1;
+}
+
+/*
+* Stops recording and closes the file.
+*/
+void stop_recording(void) {
+
+	if (record_file) {
+
+		fclose(record_file);
+		record_file = NULL;
+	}
+}
+
+/*
+* Writes the header of an event at the current tick.
+*/
+void write_event_header(int type) {
+
+	write_u32(record_file, get_simulation_msec() / TICK_MSEC);
+	write_u8(record_file, (unsigned int)type);
+}
+
+/*
+* Writes an input event (screen position is converted to the world position).
+*/
+void write_input_event(int type, int key, int state, int x, int y) {
+
+	vec2_t position;
+
+	if (!record_file) {
+
+		return;
+	}
+
+	screen_to_world_coordinates(x, y, position);
+
+	write_event_header(type);
+	write_u8(record_file, (unsigned int)key);
+	write_u8(record_file, (unsigned int)state);
+	write_f32(record_file, position[VEC_X]);
+	write_f32(record_file, position[VEC_Y]);
+}
+
+/*
+* Records the start of a new run (called by start_run).
+*/
+void record_run_start(unsigned int seed, int level) {
+
+	if (!record_file) {
+
+		return;
+	}
+
+	write_event_header(REPLAY_RUN);
+	write_u32(record_file, seed);
+	write_u16(record_file, (unsigned int)level);
+
+	//keep the file usable if the game is killed
+	fflush(record_file);
+}
+
+//----------
+// GLUT input callbacks
+//----------
+
+/*
+* GLUT keyboard callback: records the event and passes it to the game.
+*/
+void record_keyboard_event(unsigned char key, int x, int y) {
+
+	if (is_replay) {
+
+		//live input is ignored during a replay
+		return;
+	}
+
+	write_input_event(REPLAY_KEYBOARD, key, 0, x, y);
+	keyboard_press_event(key, x, y);
+}
+
+/*
+* GLUT special key callback: records the event and passes it to the game.
+*/
+void record_special_event(int key, int x, int y) {
+
+	if (is_replay) {
+
+		return;
+	}
+
+	write_input_event(REPLAY_SPECIAL, key, 0, x, y);
+	special_press_event(key, x, y);
+}
+
+/*
+* GLUT mouse callback: records the event and passes it to the game.
+*/
+void record_mouse_event(int button, int state, int x, int y) {
+
+	if (is_replay) {
+
+		return;
+	}
+
+	write_input_event(REPLAY_MOUSE, button, state, x, y);
+	mouse_click_event(button, state, x, y);
+}
+
+//----------
+// replay
+//----------
+
+/*
+* Reads all events of a replay file into the events array. Returns 0 if the file isn't a valid replay.
+*/
+int read_replay_events(const unsigned char *buffer, long size) {
+
+	replay_event_t *resized;
+	replay_event_t ev;
+	unsigned int value, key, state;
+	long pos = (long)strlen(REPLAY_MAGIC) + 2;
+	int capacity = 0;
+
+	if (size < pos || memcmp(buffer, REPLAY_MAGIC, strlen(REPLAY_MAGIC)) ||
+		buffer[pos - 2] != REPLAY_VERSION || buffer[pos - 1] != TICK_MSEC) {
+
+		return 0;
+	}
+
+	event_count = 0;
+
+	while (pos < size) {
+
+		memset(&ev, 0, sizeof(ev));
+
+		if (!read_uint(buffer, size, &pos, 4, &ev.tick) || !read_uint(buffer, size, &pos, 1, &value)) {
+
+			return 0;
+		}
+		ev.type = (int)value;
+
+		if (ev.type == REPLAY_RUN) {
+
+			if (!read_uint(buffer, size, &pos, 4, &ev.seed) || !read_uint(buffer, size, &pos, 2, &value)) {
+
+				return 0;
+			}
+			ev.level = (int)value;
+		}
+		else if (ev.type == REPLAY_KEYBOARD || ev.type == REPLAY_SPECIAL || ev.type == REPLAY_MOUSE)
+		{
+			if (!read_uint(buffer, size, &pos, 1, &key) || !read_uint(buffer, size, &pos, 1, &state) ||
+				!read_f32(buffer, size, &pos, &ev.position[VEC_X]) || !read_f32(buffer, size, &pos, &ev.position[VEC_Y])) {
+
+				return 0;
+			}
+			ev.key = (int)key;
+			ev.state = (int)state;
+		}
+		else
+		{
+			return 0;
+		}
+
+		//grow the events array
+		if (event_count == capacity) {
+
+			capacity = capacity ? capacity * 2 : 256;
+			resized = realloc(events, sizeof(replay_event_t) * capacity);
+
+			if (!resized) {
+
+				out_of_memory_error(__func__);
+				return 0;
+			}
+			events = resized;
+		}
+
+		events[event_count++] = ev;
+	}
+
+	return 1;
+}
+
+/*
+* Loads a replay file and starts replaying it from the next tick. Returns 0 if the file couldn't be read.
+*
+* Parameters:
+* filename - replay file written by start_recording
+* fast - 1 => run as fast as possible (see run_fast_replay), 0 => real speed
+*/
+int start_replay(const char *filename, int fast) {
+
+	FILE *f = fopen(filename, "rb");
+	unsigned char *buffer;
+	long size;
+	int is_valid;
+
+	if (!f) {
+
+		d_printf(LOG_ERROR, "%s: can't open %s\n", __func__, filename);
+		return 0;
+	}
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	buffer = malloc(size > 0 ? (size_t)size : 1);
+
+	if (!buffer) {
+
+		fclose(f);
+		out_of_memory_error(__func__);
+		return 0;
+	}
+
+	is_valid = size > 0 && fread(buffer, 1, (size_t)size, f) == (size_t)size && read_replay_events(buffer, size);
+
+	free(buffer);
+	fclose(f);
+
+	if (!is_valid) {
+
+		d_printf(LOG_ERROR, "%s: %s is not a valid replay\n", __func__, filename);
+		return 0;
+	}
+
+	next_event = 0;
+	is_replay = event_count > 0;
+	is_fast = fast;
+
+	d_printf(LOG_INFO, "%s: replaying %d events from %s\n", __func__, event_count, filename);
+	return 1;
+}
+
+/*
+* Ends the replay, live input is accepted again.
+*/
+void stop_replay(void) {
+
+	is_replay = 0;
+	is_fast = 0;
+
+	d_printf(LOG_INFO, "%s: replay ended after %d of %d events\n", __func__, next_event, event_count);
+}
+
+/*
+* Returns 1 while a replay is running.
+*/
+int is_replaying(void) {
+
+	return is_replay;
+}
+
+/*
+* Returns 1 while a fast replay is running.
+*/
+int is_fast_replay(void) {
+
+	return is_replay && is_fast;
+}
+
+/*
+* Returns the amount of events replayed so far.
+*/
+int get_replayed_event_count(void) {
+
+	return next_event;
+}
+
+/*
+* Returns the seed of a new run: the recorded one during a replay, otherwise based on the current time.
+*/
+unsigned int new_run_seed(void) {
+
+	if (is_replay) {
+
+		if (next_event < event_count && events[next_event].type == REPLAY_RUN) {
+
+			return events[next_event++].seed;
+		}
+
+		d_printf(LOG_ERROR, "%s: the game doesn't match the replay (no run recorded here)\n", __func__);
+		stop_replay();
+	}
+
+	return (unsigned int)time(NULL);
+}
+
+/*
+* Injects the events recorded after the current tick. Called by the scheduler at the end of every tick.
+*/
+void play_replay_events(void) {
+
+	unsigned int tick = get_simulation_msec() / TICK_MSEC;
+	replay_event_t *ev;
+	int x, y;
+
+	while (is_replay && next_event < event_count && events[next_event].tick <= tick) {
+
+		ev = &events[next_event++];
+
+		//runs are started by the input events (see new_run_seed)
+		if (ev->type == REPLAY_RUN) {
+
+			d_printf(LOG_ERROR, "%s: the game doesn't match the replay (run not started at tick %u)\n", __func__, ev->tick);
+			stop_replay();
+			return;
+		}
+
+		//window coordinates start at the bottom, mouse coordinates at the top
+		world_to_screen_coordinates(ev->position, &x, &y);
+		y = window_props.height - y;
+
+		switch (ev->type)
+		{
+			case REPLAY_KEYBOARD:
+				keyboard_press_event((unsigned char)ev->key, x, y);
+				break;
+			case REPLAY_SPECIAL:
+				special_press_event(ev->key, x, y);
+				break;
+			case REPLAY_MOUSE:
+				world_click_event(ev->key, ev->state, ev->position);
+				break;
+		}
+	}
+
+	if (is_replay && next_event == event_count) {
+
+		stop_replay();
+	}
+}
+
+/*
+* Runs the ticks of a fast replay back to back until the given real time has passed or the replay ends.
+*/
+void run_fast_replay(double msec) {
+
+	double end = get_time_msec() + msec;
+
+	while (is_fast_replay() && get_time_msec() < end) {
+
+		run_simulation_tick();
+	}
+}
@@ -0,0 +1,147 @@
+/*
+* This file contains the fixed-timestep simulation loop.
+*
+* All game time advances in ticks of TICK_MSEC. Timed routines (logic frames,
+* walking, mob movement, attacks, HUD refresh, messages) are scheduled as tasks
+* that run after a delay of simulated time; routines that run every tick
+* schedule themselves again. advance_simulation() is called once per frame with
+* the real time: it runs as many ticks as fit into the time passed (the rest is
+* kept in an accumulator) and the renderer draws the sprites between their
+* positions at the start and the end of the last tick.
+*
+* Because every tick has the same length and the tasks run in a fixed order the
+* simulation doesn't depend on the framerate or on timer precision.
+*/
+
+#include "game.h"
+#include "camera.h"
+#include <string.h>
+
+typedef struct task {
+	void			(*func)(int value);
+	int				value;
+	unsigned int	due_msec;	//simulation time to run the task at
+} task_t;
+
+//scheduled tasks ordered by due time (tasks due at the same time keep the order they were added in)
+static task_t *tasks;
+static int task_count;
+static int task_capacity;
+
+//simulated time
+static unsigned int simulation_msec;
+
+//real time not simulated yet
+static double accumulator;
+static double last_real_msec = -1.0;
+
+static float interpolation;
+
+/*
+* Schedules a task to run after delay_msec of simulated time (on the first tick at or after that time).
+*/
+void schedule_task(void (*task)(int value), int delay_msec, int value) {
+
+	unsigned int due_msec = simulation_msec + (delay_msec > 0 ? (unsigned int)delay_msec : 0);
+	task_t *resized;
+	int i;
+
+	if (task_count == task_capacity) {
+
+		task_capacity = task_capacity ? task_capacity * 2 : 16;
+		resized = realloc(tasks, sizeof(task_t) * task_capacity);
+
+		if (!resized) {
+
+			out_of_memory_error(__func__);
+			return;
+		}
+		tasks = resized;
+	}
+
+	//insert after the tasks due at the same time or earlier
+	i = task_count;
+
+	while (i > 0 && tasks[i - 1].due_msec > due_msec) {
+
+		i--;
+	}
+
+	memmove(&tasks[i + 1], &tasks[i], sizeof(task_t) * (task_count - i));
+
+	tasks[i].func = task;
+	tasks[i].value = value;
+	tasks[i].due_msec = due_msec;
+	task_count++;
+}
+
+/*
+* Advances the simulation by a single tick and runs the tasks that are due.
+*/
+void run_simulation_tick(void) {
+
+	task_t task;
+
+	simulation_msec += TICK_MSEC;
+
+	//the renderer interpolates from the positions at the start of the tick
+	store_sprite_positions();
+	store_camera_position();
+
+	while (task_count && tasks[0].due_msec <= simulation_msec) {
+
+		task = tasks[0];
+
+		task_count--;
+		memmove(&tasks[0], &tasks[1], sizeof(task_t) * task_count);
+
+		task.func(task.value);
+	}
+
+	//a replay injects the input events recorded after this tick
+	play_replay_events();
+}
+
+/*
+* Runs all ticks that fit into the real time passed since the last call.
+*/
+void advance_simulation(double real_msec) {
+
+	if (last_real_msec < 0) {
+
+		last_real_msec = real_msec;
+	}
+
+	accumulator += real_msec - last_real_msec;
+	last_real_msec = real_msec;
+
+	//don't try to catch up after a stall (window dragged, breakpoint hit...)
+	if (accumulator > MAX_FRAME_TICKS * TICK_MSEC) {
+
+		accumulator = MAX_FRAME_TICKS * TICK_MSEC;
+	}
+
+	while (accumulator >= TICK_MSEC) {
+
+		run_simulation_tick();
+		accumulator -= TICK_MSEC;
+	}
+
+	interpolation = (float)(accumulator / TICK_MSEC);
+}
+
+/*
+* Returns the simulated time in milliseconds.
+*/
+unsigned int get_simulation_msec(void) {
+
+	return simulation_msec;
+}
+
+/*
+* Returns how far the real time is into the next tick (0 to 1).
+*/
+float get_render_interpolation(void) {
+
+	return interpolation;
+}
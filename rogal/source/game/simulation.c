@@ -0,0 +1,106 @@
+/*
+* This file allows driving the game without input events or a window.
+*
+* A level is started from a seed, player actions are applied directly to the
+* sprites next to the player (the same way the keyboard and mouse actions end
+* up in on_player_action) and the simulated time is advanced tick by tick
+* instead of following the real time. Nothing here depends on the renderer, so
+* it's used by the headless build (make headless) to run the game logic as
+* fast as possible, but it works in the windowed game as well.
+*/
+
+#include "game.h"
+#include "player.h"
+#include "raycast.h"
+#include "ui.h"
+
+/*
+* Starts a new run with the given seed at the given level, skipping the main menu.
+*/
+void start_simulation(unsigned int seed, int level) {
+
+	//hide the menu and unpause game state
+	toggle_main_menu(0);
+	is_paused = 0;
+	is_options = 0;
+
+	start_run(seed, level);
+
+	is_ingame = 1;
+}
+
+/*
+* Returns 1 if the game waits for a player action (nothing is moving).
+*/
+int is_simulation_idle(void) {
+
+	return !is_player_move && !is_mob_move;
+}
+
+/*
+* Applies a player action to the tile next to the player. Returns 0 if the action
+* couldn't be taken (the game isn't running, something is moving, the player is dead
+* or there is nothing to act on), the action itself may still do nothing.
+*
+* Parameters:
+* direction - ROTATION_... of the target tile or ACTION_HERE for the player's tile
+* mouse_key - GLUT_LEFT_BUTTON (interact) or GLUT_RIGHT_BUTTON (walk only), see on_player_action
+*/
+int apply_player_action(int direction, int mouse_key) {
+
+	vec2_t dest;
+	sprite_t *s;
+
+	if (!is_ingame || is_paused || is_player_dead || !is_simulation_idle()) {
+
+		return 0;
+	}
+
+	//start at the player position
+	Vec2Copy(player.sprite[0]->position, dest);
+
+	//move 1 tile in the given direction (same as simulate_mouse_click)
+	if (direction != ACTION_HERE) {
+
+		dest[VEC_X] += (SPRITE_SIZE * 2 * !(direction & 1)) * (direction > 0 ? -1 : 1);
+		dest[VEC_Y] += (SPRITE_SIZE * 2 * (direction & 1)) * (direction > 1 ? -1 : 1);
+	}
+
+	s = world_raycast(dest, COLLISION_PLAYER_ACTION);
+
+	if (!s) {
+
+		return 0;
+	}
+
+	on_player_action(s, mouse_key);
+	return 1;
+}
+
+/*
+* Advances the simulated time by the given amount of ticks.
+*/
+void run_simulation_ticks(int ticks) {
+
+	for (int i = 0; i < ticks; i++) {
+
+		run_simulation_tick();
+	}
+}
+
+/*
+* Advances the simulated time until nothing is moving (at most max_ticks).
+* Returns the amount of ticks simulated.
+*/
+int run_simulation_until_idle(int max_ticks) {
+
+	int ticks = 0;
+
+	while (ticks < max_ticks && !is_simulation_idle()) {
+
+		run_simulation_tick();
+		ticks++;
+	}
+
+	return ticks;
+}
@@ -1,73 +1,186 @@
 /*
 * This file manages a linked list of sprites and makes sure no memory
 * is leaked when sprites are removed and created.
+* 
+* Sprites are kept in one list per render layer so that the renderer
+* and the raycasts can visit each layer without touching sprites of all
+* the other layers. A sprite's layer must be changed using
+* set_sprite_render_layer() to keep the lists in sync.
+* 
+* Sprites are not allocated one by one. Instead they are taken from
+* fixed-size slabs which are allocated when all previously allocated
+* sprites are in use. Deleted sprites are put on an intrusive free list
+* (linked using their "next" pointer) and reused by new_sprite(), so
+* slabs are never returned to the system. Together with the tail pointer
+* of each layer list this makes both new_sprite() and delete_sprite()
+* run in constant time.
 */
 
 #include "shared.h"
+#include "raycast.h"
 #include <string.h> //for memset...
 
-sprite_t *first;
+//amount of sprites allocated at once
+#define SPRITE_SLAB_SIZE 512
+
+typedef struct sprite_slab {
+	struct sprite_slab	*next;
+	sprite_t			sprites[SPRITE_SLAB_SIZE];
+} sprite_slab_t;
+
+//per-layer linked lists
+static sprite_t *layer_first[RENDER_LAYER_COUNT];
+static sprite_t *layer_last[RENDER_LAYER_COUNT];
+
+static sprite_slab_t *slabs;		//all allocated slabs
+static sprite_t *free_sprites;		//unused sprites ready to be reused
 
 /*
-* Allocates a new sprite and returns a pointer to it.
+* Allocates a new slab and puts all of its sprites on the free list.
 */
-sprite_t *alloc_sprite(void) {
+void alloc_sprite_slab(void) {
 
-	sprite_t *s = malloc(sizeof(sprite_t));
+	sprite_slab_t *slab = malloc(sizeof(sprite_slab_t));
 
-	if (!s) {
+	if (!slab) {
 
 		out_of_memory_error(__func__);
+		return;
 	}
 
+	slab->next = slabs;
+	slabs = slab;
+
+	//link the sprites in reverse so they are handed out in memory order
+	for (int i = SPRITE_SLAB_SIZE - 1; i >= 0; i--) {
+
+		slab->sprites[i].next = free_sprites;
+		free_sprites = &slab->sprites[i];
+	}
+}
+
+/*
+* Takes a sprite from the free list and returns a pointer to it.
+*/
+sprite_t *alloc_sprite(void) {
+
+	sprite_t *s;
+
+	if (!free_sprites) {
+
+		alloc_sprite_slab();
+	}
+
+	s = free_sprites;
+	free_sprites = s->next;
+
 	return s;
 }
 
 /*
-* Frees a sprite and its data if necessary.
+* Frees sprite's data if necessary and puts it back on the free list.
 */
 void free_sprite(sprite_t *s) {
 
 	if (s->object_data) {
 
 		free(s->object_data);
+		s->object_data = NULL;
 	}
 
-	free(s);
+	s->previous = NULL;
+	s->next = free_sprites;
+	free_sprites = s;
 }
 
 /*
-* Returns the first element of sprites linked list.
+* Returns the first sprite on the given render layer.
 */
-sprite_t *sprite_head(void) {
+sprite_t *sprite_layer_head(unsigned layer) {
+
+	if (layer >= RENDER_LAYER_COUNT) {
+
+		return NULL;
+	}
 
-	return first;
+	return layer_first[layer];
 }
 
 /*
-* Adds a new sprite at the end of the list.
+* Adds a sprite at the end of its render layer list.
 */
 void add_sprite_to_list(sprite_t *s) {
 
-	sprite_t *current;
-	if (!first) {
+	unsigned layer = s->render_layer;
+
+	s->previous = layer_last[layer];
+	s->next = NULL;
+
+	if (!layer_first[layer]) {
 
-		//this is the first sprite
-		first = s;
+		//this is the first sprite on this layer
+		layer_first[layer] = layer_last[layer] = s;
 		return;
 	}
 
-	current = first;
+	//make a link
+	layer_last[layer]->next = s;
+	layer_last[layer] = s;
+}
 
-	//find the last sprite
-	while (current->next != NULL) {
+/*
+* Removes a sprite from its render layer list.
+*/
+void remove_sprite_from_list(sprite_t *s) {
+
+	unsigned layer = s->render_layer;
 
-		current = current->next;
+	//removing the first sprite?
+	if (s->previous == NULL) {
+
+		layer_first[layer] = s->next;
 	}
 
-	//make a link
-	current->next = s;
-	s->previous = current;
+	//removing the last sprite?
+	if (s->next == NULL) {
+
+		layer_last[layer] = s->previous;
+	}
+
+	//patch up the list
+	if (s->next) {
+
+		s->next->previous = s->previous;
+	}
+
+	if (s->previous) {
+
+		s->previous->next = s->next;
+	}
+
+	s->previous = NULL;
+	s->next = NULL;
+}
+
+/*
+* Moves the sprite to another render layer.
+*/
+void set_sprite_render_layer(sprite_t *s, unsigned layer) {
+
+	if (layer >= RENDER_LAYER_COUNT) {
+
+		d_printf(LOG_WARNING, "%s: invalid render layer %u\n", __func__, layer);
+		layer = RENDER_LAYER_COUNT - 1;
+	}
+
+	if (s->render_layer == layer) {
+
+		return;
+	}
+
+	remove_sprite_from_list(s);
+	s->render_layer = layer;
+	add_sprite_to_list(s);
 }
 
 /*
@@ -90,32 +203,55 @@ sprite_t *new_sprite(void) {
 }
 
 /*
-* Deletes the requested sprite and frees the memory used by it.
+* Saves the position of every sprite at the start of a simulation tick.
 */
-void delete_sprite(sprite_t *s) {
+void store_sprite_positions(void) {
 
-	if (!s) {
+	sprite_t *current;
 
-		d_printf(LOG_WARNING, "%s: tried to delete a null sprite\n", __func__);
-		return;
-	}
+	for (unsigned layer = 0; layer < RENDER_LAYER_COUNT; layer++) {
 
-	//deleting the first sprite?
-	if (s->previous == NULL) {
+		for (current = layer_first[layer]; current; current = current->next) {
 
-		first = s->next;
+			Vec2Copy(current->position, current->last_position);
+			current->has_last_position = 1;
+		}
 	}
+}
 
-	//patch up the list
-	if (s->next) {
+/*
+* Finds the position to draw the sprite at: between its position at the start of the
+* current tick and its current position.
+*/
+void get_sprite_render_position(sprite_t *s, float interpolation, vec2_t out) {
 
-		s->next->previous = s->previous;
+	float diff_x = s->position[VEC_X] - s->last_position[VEC_X];
+	float diff_y = s->position[VEC_Y] - s->last_position[VEC_Y];
+
+	if (!s->has_last_position || fabsf(diff_x) > MAX_INTERPOLATION_DISTANCE || fabsf(diff_y) > MAX_INTERPOLATION_DISTANCE) {
+
+		//new or teleported sprite
+		Vec2Copy(s->position, out);
+		return;
 	}
 
-	if (s->previous) {
+	out[VEC_X] = s->last_position[VEC_X] + diff_x * interpolation;
+	out[VEC_Y] = s->last_position[VEC_Y] + diff_y * interpolation;
+}
 
-		s->previous->next = s->next;
+/*
+* Deletes the requested sprite and returns it to the sprite pool.
+*/
+void delete_sprite(sprite_t *s) {
+
+	if (!s) {
+
+		d_printf(LOG_WARNING, "%s: tried to delete a null sprite\n", __func__);
+		return;
 	}
 
+	remove_sprite_from_list(s);
+	unregister_pick_sprite(s);
+
 	free_sprite(s);
 }
@@ -1,4 +1,5 @@
 #include "text.h"
+#include "raycast.h"
 #include <ctype.h>
 #include <string.h>
 
@@ -130,9 +131,19 @@ void update_text_properties(text_t *t) {
 		Vec2Copy(position, s->position);
 
 		//render layer and collision mask
-		s->render_layer = t->render_layer;
+		set_sprite_render_layer(s, t->render_layer);
 		s->collision_mask = t->collision_mask;
 
+		//clickable texts
+		if (s->collision_mask & COLLISION_UI) {
+
+			register_ui_pick_sprite(s);
+		}
+		else
+		{
+			unregister_pick_sprite(s);
+		}
+
 		//action
 		if (t->action) {
 
@@ -5,11 +5,23 @@
 * Every world sprite can be either hidden, discovered or visible. Hidden sprites
 * are completely disabled and the player is not able to see them. Discovered sprites
 * are darkened but mobs standing on them are not visible to the player.
+* 
+* Visible tiles are found by the field of view calculation (see fov.c). Mobs
+* and items are visible when the tile they stand on is visible.
+* 
+* Only tiles that were visible before or are visible now can change, so the
+* previous visible set is kept and colours are written only to tiles whose
+* visibility state has changed. Tiles start hidden (see build_tile_states).
 */
 
 #include "game.h"
 #include "player.h"
-#include "raycast.h"
+#include <string.h>
+#include <stdlib.h>
+
+//tiles visible after the previous update (as MapIndex)
+static int *last_visible;
+static int last_visible_count;
 
 /*
 * Sets the correct invisibility mode to a sprite.
@@ -31,9 +43,11 @@ void set_sprite_invisible(sprite_t *s) {
 }
 
 /*
-* Sets mob's sprites and texts according to the visibility value.
+* Sets sprites and texts of the mob at the given store index according to the visibility value.
 */
-void set_mob_visibility(mob_t *mob, int vis) {
+void set_mob_visibility(int index, int vis) {
+
+	mob_render_t *mob = &mob_store.render[index];
 
 	switch (vis) 
 	{
@@ -60,7 +74,7 @@ void set_mob_visibility(mob_t *mob, int vis) {
 			break;
 		default:
 			//visible
-			mob->sprite[mob->look_direction]->skip_render = 0;
+			mob->sprite[mob_store.look_direction[index]]->skip_render = 0;
 			//enable texts
 			if (mob->health_text) {
 
@@ -87,10 +101,6 @@ void recalculate_item_visibility(void) {
 
 	item_t *item;
 	sprite_t *s;
-	vec2_t p;
-	vec2_t s_offset;
-	float dist;
-	int intersects;
 
 	for (int j = 0; j < MAX_ITEMS + 1; j++) {
 
@@ -102,38 +112,14 @@ void recalculate_item_visibility(void) {
 			continue;
 		}
 
-		dist = Vec2Distance(player.sprite[0]->position, s->position);
+		if (is_position_visible(s->position)) {
 
-		if (dist > VIS_DISTANCE) {
-
-			set_sprite_invisible(s);
+			s->visibility = VIS_VISIBLE;
+			Color3Copy(item->rarity_color, s->color);
 		}
-		else {
-
-			//check if item visibility is broken by a sprite
-			intersects = 1;
-			for (int i = 0; i < 4; i++) {
-
-				//check if any sprite side is visible from player's perspective
-				s_offset[VEC_X] = s->position[VEC_X] + ((i % 2) ? SPRITE_SIZE * 0.95f * s->scale_x : 0) * ((i > 1) ? -1 : 1);
-				s_offset[VEC_Y] = s->position[VEC_Y] + ((i % 2) ? 0 : SPRITE_SIZE * 0.95f * s->scale_y) * ((i > 1) ? 1 : -1);
-
-				//raycast
-				if (!sprite_ray_intersection(player.sprite[0]->position, s_offset, COLLISION_WALL | COLLISION_OBSTACLE, &p)) {
-
-					intersects = 0;
-					break;
-				}
-			}
-			if (intersects) {
-
-				set_sprite_invisible(s);
-			}
-			else
-			{
-				s->visibility = VIS_VISIBLE;
-				Color3Copy(item->rarity_color, s->color);
-			}
+		else
+		{
+			set_sprite_invisible(s);
 		}
 	}
 }
@@ -143,18 +129,12 @@ void recalculate_item_visibility(void) {
 */
 void recalculate_mob_visibility(void) {
 
-	mob_t *mob;
 	sprite_t *s;
-	vec2_t p;
-	vec2_t s_offset;
-	float dist;
-	int intersects;
 
 	//mobs can only be visible or hidden
-	for (int j = 0; j < MAX_MOBS; j++) {
+	for (int j = 0; j < mob_store.count; j++) {
 
-		mob = &mobs[j];
-		s = mob->sprite[0];
+		s = mob_store.render[j].sprite[0];
 
 		if (!s) {
 
@@ -162,32 +142,30 @@ void recalculate_mob_visibility(void) {
 			continue;
 		}
 
-		//calculate the distance between player and the sprite
-		dist = Vec2Distance(player.sprite[0]->position, s->position);
+		set_mob_visibility(j, is_position_visible(s->position) ? VIS_VISIBLE : VIS_HIDDEN);
+	}
+}
 
-		if (dist > VIS_DISTANCE) {
-			
-			set_mob_visibility(mob, VIS_HIDDEN);
-		}
-		else
-		{
-			//check if mob visibility is broken by a sprite
-			intersects = 1;
-			for (int i = 0; i < 4; i++) {
+/*
+* Forgets the previously visible tiles. Used when the map sprites are rebuilt.
+*/
+void reset_visibility(void) {
 
-				//check if any sprite side is visible from player's perspective
-				s_offset[VEC_X] = s->position[VEC_X] + ((i % 2) ? SPRITE_SIZE * 0.95f * s->scale_x : 0) * ((i > 1) ? -1 : 1);
-				s_offset[VEC_Y] = s->position[VEC_Y] + ((i % 2) ? 0 : SPRITE_SIZE * 0.95f * s->scale_y) * ((i > 1) ? 1 : -1);
+	last_visible_count = 0;
+}
 
-				//raycast
-				if (!sprite_ray_intersection(player.sprite[0]->position, s_offset, COLLISION_WALL | COLLISION_OBSTACLE, &p)) {
+/*
+* Reallocates the previous visible set for the current map size.
+*/
+void resize_visibility_map(void) {
 
-					intersects = 0;
-					break;
-				}
-			}
-			set_mob_visibility(mob, intersects ? VIS_HIDDEN : VIS_VISIBLE);
-		}
+	free(last_visible);
+	last_visible = malloc(sizeof(int) * map_size * map_size);
+	last_visible_count = 0;
+
+	if (!last_visible) {
+
+		out_of_memory_error(__func__);
 	}
 }
 
@@ -196,59 +174,52 @@ void recalculate_mob_visibility(void) {
 */
 void recalculate_sprites_visibility(void) {
 
-	vec2_t p;
-	vec2_t s_offset;
 	sprite_t *s;
-	float dist;
-	int intersects;
-
-	for (int x = 0; x < MAP_SIZE; x++) {
-		for (int y = 0; y < MAP_SIZE; y++) {
-
-			s = sprite_map[x][y];
-
-			if (s) {
-				//calculate the distance between player and the sprite
-				dist = Vec2Distance(player.sprite[0]->position, s->position);
-
-				//too far from player
-				if (dist > VIS_DISTANCE) {
-
-					set_sprite_invisible(s);
-				}
-				else
-				{
-					//check if sprite visibility is broken by another sprite
-					intersects = 1;
-					for (int i = 0; i < 4; i++) {
-
-						//check if any sprite side is visible from player's perspective
-						s_offset[VEC_X] = s->position[VEC_X] + ((i % 2) ? SPRITE_SIZE * 0.95f * s->scale_x : 0) * ((i > 1) ? -1 : 1);
-						s_offset[VEC_Y] = s->position[VEC_Y] + ((i % 2) ? 0 : SPRITE_SIZE * 0.95f * s->scale_y) * ((i > 1) ? 1 : -1);
-
-						//raycast
-						if (!sprite_ray_intersection(player.sprite[0]->position, s_offset, COLLISION_WALL | COLLISION_OBSTACLE, &p)) {
-
-							intersects = 0;
-							break;
-						}
-					}
-					if (intersects) {
-
-						//sprite visibility is blocked
-						set_sprite_invisible(s);
-					}
-					else
-					{
-						s->visibility = VIS_VISIBLE;
-						Color3White(s->color);
-					}
-				}
-			}
+	vec2_t *player_pos = &player.sprite[0]->position;
+	const int *visible;
+	int count, x, y;
+	double start = profile_start();
+
+	//make sure the tiles around the player have sprites
+	update_map_chunks();
+
+	//find the visible tiles around the player
+	calculate_fov((int)floorf((*player_pos)[VEC_X] + map_offset + 0.5f), (int)floorf((*player_pos)[VEC_Y] + map_offset + 0.5f), VIS_DISTANCE);
+
+	//tiles that are no longer visible
+	for (int i = 0; i < last_visible_count; i++) {
+
+		x = last_visible[i] / map_size;
+		y = last_visible[i] % map_size;
+		s = sprite_map[last_visible[i]];
+
+		if (s && !is_tile_visible(x, y)) {
+
+			set_sprite_invisible(s);
+		}
+	}
+
+	//tiles that became visible
+	visible = get_visible_tiles(&count);
+
+	for (int i = 0; i < count; i++) {
+
+		s = sprite_map[visible[i]];
+
+		if (s && s->visibility != VIS_VISIBLE) {
+
+			s->visibility = VIS_VISIBLE;
+			Color3White(s->color);
 		}
 	}
 
+	//remember the visible set for the next update
+	memcpy(last_visible, visible, sizeof(int) * count);
+	last_visible_count = count;
+
 	//recalculate vis for mobs and items
 	recalculate_mob_visibility();
 	recalculate_item_visibility();
-}
\ No newline at end of file
+
+	profile_end(PROFILE_VISIBILITY, start);
+}
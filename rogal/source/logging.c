@@ -78,6 +78,9 @@ void d_printf(int type, const char *format, ...) {
 	printf("%s", text);
 
 	CLR_RESET;
+#else
+	UNUSED_VARIABLE(type);
+	UNUSED_VARIABLE(format);
 #endif // _DEBUG 
 }
 
@@ -86,6 +89,8 @@ void d_printf(int type, const char *format, ...) {
 */
 void d_spacer(void) {
 
+#ifdef _DEBUG 
+	//only print in debug configuration, like the messages
 #ifdef WIN32
 	if (!hOutput) {
 
@@ -97,6 +102,7 @@ void d_spacer(void) {
 	CLR_GREEN;
 	printf("----------\n");
 	CLR_RESET;
+#endif // _DEBUG 
 }
 
 /*
@@ -6,29 +6,71 @@
 #include "render/renderer.h"
 #include "render/textures.h"
 #include "ui.h"
+#include <string.h>
+
+/*
+* A callback to simulate the game up to the current time and draw the frame using constant DISPLAY_FRAMERATE.
+*/
+void frame_timer_callback(int value) {
+
+	if (is_fast_replay()) {
+
+		//a fast replay doesn't follow the real time, use most of the frame for simulating
+		run_fast_replay(FAST_REPLAY_FRAME_MSEC);
+	}
+	else
+	{
+		advance_simulation(get_time_msec());
+	}
+
+	glutPostRedisplay(); //force glut to execute display callback
+	glutTimerFunc((unsigned)(1000.f / DISPLAY_FRAMERATE), frame_timer_callback, value); //set the next callback execution
+}
 
 void register_glut_callbacks(void) {
 
 	//register display update function
 	glutDisplayFunc(display_frame);
 
-	//register display timer will automatically register itself
-	render_timer_callback(0);
+	//register frame timer (it will automatically register itself)
+	frame_timer_callback(0);
 
 	//register window resize
 	glutReshapeFunc(glut_change_size);
 
-	//register logic loop
-	glutTimerFunc(LOGIC_MSEC, logic_frame, glutGet(GLUT_ELAPSED_TIME));
+	//start the logic loop (runs on every simulation tick)
+	schedule_task(logic_frame, TICK_MSEC, 0);
 
-	//register input events
-	glutKeyboardFunc(keyboard_press_event);
-	glutSpecialFunc(special_press_event);
-	glutMouseFunc(mouse_click_event);
+	//register input events (they can be recorded, see replay.c)
+	glutKeyboardFunc(record_keyboard_event);
+	glutSpecialFunc(record_special_event);
+	glutMouseFunc(record_mouse_event);
 
 	d_printf(LOG_INFO, "%s: callbacks set\n", __func__);
 }
 
+/*
+* Starts recording or replaying the input events if requested on the command line:
+*	-record <file>		records the session
+*	-replay <file>		replays a recorded session at the real speed
+*	-fastreplay <file>	replays a recorded session as fast as possible
+*/
+void parse_replay_arguments(int argc, char **argv) {
+
+	for (int i = 1; i + 1 < argc; i++) {
+
+		if (!strcmp(argv[i], "-record")) {
+
+			start_recording(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-replay") || !strcmp(argv[i], "-fastreplay"))
+		{
+			start_replay(argv[i + 1], !strcmp(argv[i], "-fastreplay"));
+			i++;
+		}
+	}
+}
+
 int main(int argc, char **argv) {
 
 #ifdef WIN32
@@ -67,6 +109,9 @@ int main(int argc, char **argv) {
 	//create UI sprites
 	generate_ui();
 
+	//record or replay the input
+	parse_replay_arguments(argc, argv);
+
 	//pass control to glut
 	glutMainLoop();
 	
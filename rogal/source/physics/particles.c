@@ -4,228 +4,283 @@
 * look "prettier".
 *
 * Because the amount of particles is often changing and their
-* amount can vary a lot particles are allocated dynamically 
-* and stored in a linked list (similar to the sprites).
+* amount can vary a lot particles are kept in a fixed-capacity
+* pool. Alive particles are always packed at the beginning of
+* the pool: a new particle is appended after the last one and
+* an expired particle is replaced by the last particle in the
+* pool (swap-remove). Spawning, expiring and iterating are all
+* done without any allocations or list walks. The pool tracks
+* its high-water mark so the capacity can be tuned.
 * 
 * Particles are using a simple simulation algorithm: their
 * position and velocity can change (the velocity only due to
 * gravity).
 * 
-* Every particle is represented by a variable of particle_t
-* struct type.
+* The pool is a structure of arrays (particle_pool_t) and a
+* particle is identified by its index in these arrays. This
+* allows the simulation step to update four particles with a
+* single SSE instruction. A scalar version of the same step is
+* used when SSE2 is not available (or PARTICLES_NO_SIMD is
+* defined) and for the particles that don't fill a full SSE
+* register. Both versions perform exactly the same float
+* operations in the same order, so they produce bit-identical
+* results.
 */
 
 #include "particles.h"
 #include "game.h"
 #include <string.h>
 
-static particle_t *first_particle;
+#ifdef PARTICLES_SSE
+#include <emmintrin.h>
+#endif // PARTICLES_SSE
+
+//velocity below which a particle bounces off the ground
+#define BOUNCE_VELOCITY -.8f
+
+static particle_pool_t pool;
+
 int are_particles_enabled = 1;
 
 /*
-* Used to retrieve the first particle in the particle list
+* Returns the particle pool. Only the first pool->count particles are alive.
 */
-particle_t *head_particle(void) {
+particle_pool_t *particles_pool(void) {
 
-	return first_particle;
+	return &pool;
 }
 
 /**
-* Allocates a new particle and links it to the list.
+* Takes a new particle from the pool and returns its index. Returns -1 if the pool is full.
 */
-particle_t *new_particle(void) {
-
-	particle_t *p;
-	particle_t *current;
+int new_particle(void) {
 
-	//allocate the particle
-	p = malloc(sizeof(particle_t));
-	memset(p, 0, sizeof(particle_t));
+	int p;
 
-	//add to the list
-	if (!first_particle) {
+	if (pool.count == MAX_PARTICLES) {
 
-		//there's no particles currently allocated, this is the first one
-		first_particle = p;
+		return -1;
 	}
-	else
-	{
-		//find the last particle in the list and attach the new one after it
-		current = first_particle;
-		while (current->next) {
 
-			current = current->next;
-		}
+	p = pool.count++;
+
+	if (pool.count > pool.high_water_mark) {
 
-		current->next = p;
+		pool.high_water_mark = pool.count;
 	}
-	p->visibility = 1;
+
+	//clear particle data
+	pool.position_x[p] = pool.position_y[p] = 0.f;
+	pool.velocity_x[p] = pool.velocity_y[p] = 0.f;
+	pool.gravity[p] = 0.f;
+	pool.ground_height[p] = 0.f;
+	pool.life_msec[p] = 0;
+	Color3Black(pool.color[p]);
+	pool.render_layer[p] = 0;
+	pool.visibility[p] = 1;
+
 	return p;
 }
 
 /**
-* Removes the particle, clears memory allocated for it and deletes it from the list.
+* Removes the particle by moving the last particle of the pool in its place.
 */
-void delete_particle(particle_t *p) {
+void delete_particle(int index) {
 
-	particle_t *current;
-	particle_t *previous;
+	int last = pool.count - 1;
 
-	//special treatment for the first particle in the list
-	if (p == first_particle) {
+	if (index < 0 || index > last) {
 
-		if (first_particle->next) {
+		d_printf(LOG_ERROR, "%s: particle not found!\n", __func__);
+		return;
+	}
 
-			first_particle = first_particle->next;
-		}
-		else
-		{
-			first_particle = NULL;
-		}
+	if (index != last) {
+
+		pool.position_x[index] = pool.position_x[last];
+		pool.position_y[index] = pool.position_y[last];
+		pool.velocity_x[index] = pool.velocity_x[last];
+		pool.velocity_y[index] = pool.velocity_y[last];
+		pool.gravity[index] = pool.gravity[last];
+		pool.ground_height[index] = pool.ground_height[last];
+		pool.life_msec[index] = pool.life_msec[last];
+		Color3Copy(pool.color[last], pool.color[index]);
+		pool.render_layer[index] = pool.render_layer[last];
+		pool.visibility[index] = pool.visibility[last];
+	}
 
-		free(p);
+	pool.count--;
+}
 
-		return;
-	}
+/**
+* Clears all existing particles. Useful for changing levels.
+*/
+void delete_all_particles(void) {
+
+	pool.count = 0;
+}
 
-	//find in the list
-	current = first_particle->next;
-	previous = first_particle;
+/**
+* Simulates particles in [start, end) range one by one.
+*/
+void integrate_particles_scalar(int start, int end, float time) {
 
-	while (current != p) {
+	//ground friction doesn't depend on the particle
+	float friction = r_clamp(1.f - time * 5, 0, 1);
+	float end_x, end_y;
 
-		if (!current->next && current != p) {
+	for (int i = start; i < end; i++) {
 
-			d_printf(LOG_ERROR, "%s: particle not found!\n", __func__);
-			return;
+		//calculate velocity and position
+		if (pool.position_y[i] <= pool.ground_height[i]) {
+
+			if (pool.velocity_y[i] < BOUNCE_VELOCITY) { //hit ground hard
+
+				//bounce
+				pool.velocity_y[i] *= -(0.3f + 0.03f * Random(1, 3));
+			}
+			else {
+
+				//stop falling
+				pool.velocity_y[i] = 0;
+			}
+			//add some ground friciton
+			pool.velocity_x[i] *= friction;
 		}
-		previous = current;
-		current = current->next;
-	}
+		else {
 
-	//patch up the list
-	if (current->next) {
+			//add gravity
+			pool.velocity_y[i] -= pool.gravity[i] * time;
+		}
 
-		previous->next = current->next;
-	}
-	else
-	{
-		previous->next = NULL;
-	}
+		//calculate new position using lerp
+		end_x = pool.position_x[i] + pool.velocity_x[i]; //movement done in 1 sec (position + velocity vector)
+		end_y = pool.position_y[i] + pool.velocity_y[i];
 
-	//free the memory
-	free(p);
+		pool.position_x[i] = pool.position_x[i] + time * (end_x - pool.position_x[i]); //move by time fraction
+		pool.position_y[i] = pool.position_y[i] + time * (end_y - pool.position_y[i]);
+	}
 }
 
+#ifdef PARTICLES_SSE
 /**
-* Clears all existing particles. Useful for changing levels.
+* Simulates particles four at a time. Returns the index of the first particle
+* that wasn't simulated (the remaining particles don't fill a full register).
 */
-void delete_all_particles(void) {
+int integrate_particles_sse(int count, float time) {
 
-	particle_t *previous;
-	particle_t *current;
+	float bounce[4];
+	int i, lane, hard_mask;
 
-	//nothing is allocated
-	if (!first_particle) {
+	__m128 t = _mm_set1_ps(time);
+	__m128 friction = _mm_set1_ps(r_clamp(1.f - time * 5, 0, 1));
+	__m128 bounce_velocity = _mm_set1_ps(BOUNCE_VELOCITY);
+	__m128 zero = _mm_setzero_ps();
 
-		return;
-	}
+	__m128 px, py, vx, vy, ground, gravity;
+	__m128 on_ground, hard_hit, falling_vy, ground_vy, end_x, end_y;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+
+		px = _mm_loadu_ps(&pool.position_x[i]);
+		py = _mm_loadu_ps(&pool.position_y[i]);
+		vx = _mm_loadu_ps(&pool.velocity_x[i]);
+		vy = _mm_loadu_ps(&pool.velocity_y[i]);
+		ground = _mm_loadu_ps(&pool.ground_height[i]);
+		gravity = _mm_loadu_ps(&pool.gravity[i]);
+
+		on_ground = _mm_cmple_ps(py, ground);
+		hard_hit = _mm_and_ps(on_ground, _mm_cmplt_ps(vy, bounce_velocity));
+
+		//velocity of particles in the air: add gravity
+		falling_vy = _mm_sub_ps(vy, _mm_mul_ps(gravity, t));
+
+		//velocity of particles on the ground: stop falling or bounce
+		ground_vy = zero;
+		hard_mask = _mm_movemask_ps(hard_hit);
 
-	//iterate over the list and delete all elements
-	current = first_particle;
-	while (current) {
+		if (hard_mask) {
 
-		previous = current;
-		current = current->next;
-		free(previous);
+			//bounces are rare and need random numbers, which are taken in particle order
+			for (lane = 0; lane < 4; lane++) {
+
+				bounce[lane] = (hard_mask & (1 << lane)) ? -(0.3f + 0.03f * Random(1, 3)) : 0.f;
+			}
+			ground_vy = _mm_and_ps(hard_hit, _mm_mul_ps(vy, _mm_loadu_ps(bounce)));
+		}
+
+		vy = _mm_or_ps(_mm_and_ps(on_ground, ground_vy), _mm_andnot_ps(on_ground, falling_vy));
+
+		//add some ground friction
+		vx = _mm_or_ps(_mm_and_ps(on_ground, _mm_mul_ps(vx, friction)), _mm_andnot_ps(on_ground, vx));
+
+		//calculate new position using lerp
+		end_x = _mm_add_ps(px, vx);
+		end_y = _mm_add_ps(py, vy);
+
+		px = _mm_add_ps(px, _mm_mul_ps(t, _mm_sub_ps(end_x, px)));
+		py = _mm_add_ps(py, _mm_mul_ps(t, _mm_sub_ps(end_y, py)));
+
+		_mm_storeu_ps(&pool.position_x[i], px);
+		_mm_storeu_ps(&pool.position_y[i], py);
+		_mm_storeu_ps(&pool.velocity_x[i], vx);
+		_mm_storeu_ps(&pool.velocity_y[i], vy);
 	}
-	free(current); //delete the last particle
 
-	first_particle = NULL;
+	return i;
 }
+#endif // PARTICLES_SSE
 
 /**
 * Runs particle simulation step. This is executed by the game logic callback function in game.c (logic_frame())
 */
 void run_particles(int msec) {
 
-	particle_t *previous;
-	particle_t *current = first_particle;
-	vec2_t end;
 	float time = msec * 0.001f; //frametime
-	int x, y;
+	int i, x, y;
 	sprite_t *s;
 
-	//noting to simulate
-	if (!first_particle) {
-
-		return;
-	}
-
 	//check if alive
-	while (current) {
+	i = 0;
+	while (i < pool.count) {
 
 		//decrease the lifetime
-		current->life_msec -= msec;
-
-		if (current->life_msec <= 0) {
+		pool.life_msec[i] -= msec;
 
-			//jump to the next particle before removing the old one
-			previous = current;
-			current = current->next;
+		if (pool.life_msec[i] <= 0) {
 
-			delete_particle(previous);
+			//the last particle takes this slot, so check the same index again
+			delete_particle(i);
 			continue;
 		}
 
-		current = current->next;
+		i++;
 	}
 
 	//run simulation on each particle
-	current = first_particle;
-	while (current) {
-
-		//calculate velocity and position
-		if (current->position[VEC_Y] <= current->ground_height) {
-
-			if (current->velocity[VEC_Y] < -.8f) { //hit ground hard
-
-				//bounce
-				current->velocity[VEC_Y] *= -(0.3f + 0.03f * Random(1, 3));
-			}
-			else {
-
-				//stop falling
-				current->velocity[VEC_Y] = 0;
-			}
-			//add some ground friciton
-			current->velocity[VEC_X] *= r_clamp(1.f  - time * 5, 0, 1);
-		}
-		else {
+#ifdef PARTICLES_SSE
+	i = integrate_particles_sse(pool.count, time);
+#else
+	i = 0;
+#endif // PARTICLES_SSE
 
-			//add gravity
-			current->velocity[VEC_Y] -= current->gravity * time;
-		}
+	integrate_particles_scalar(i, pool.count, time);
 
-		//calculate new position using lerp
-		Vec2Add(current->position, current->velocity, end); //movement done in 1 sec (position + velocity vector)
-		Vec2Lerp(current->position, end, time, current->position); //move by time fraction
+	//set visibility
+	for (i = 0; i < pool.count; i++) {
 
-		//set visibility
-		x = r_roundf(current->position[VEC_X]);
-		y = r_roundf(current->position[VEC_Y]);
+		x = r_roundf(pool.position_x[i]);
+		y = r_roundf(pool.position_y[i]);
 
-		s = sprite_map[x + MAP_OFFSET][y + MAP_OFFSET];
+		s = get_map_sprite(x + map_offset, y + map_offset);
 		if (s) {
 
-			current->visibility = sprite_map[x + MAP_OFFSET][y + MAP_OFFSET]->visibility;
+			pool.visibility[i] = s->visibility;
 		}
 		else
 		{
-			current->visibility = 0;
+			pool.visibility[i] = 0;
 		}
-
-		current = current->next;
 	}
 }
 
@@ -234,6 +289,11 @@ void run_particles(int msec) {
 */
 void init_particles(void) {
 
+	if (pool.high_water_mark) {
+
+		d_printf(LOG_INFO, "%s: particle pool high-water mark: %d/%d\n", __func__, pool.high_water_mark, MAX_PARTICLES);
+	}
+
 	delete_all_particles();
 }
 
@@ -246,7 +306,7 @@ void init_particles(void) {
 */
 void make_walk_dust_particle(vec2_t position, float groundheight) {
 
-	particle_t *p;
+	int p;
 	float color_variation = 1.f / Random(4, 10); //color added to the base particle color (gray)
 	float rand_x, rand_y;
 
@@ -259,27 +319,34 @@ void make_walk_dust_particle(vec2_t position, float groundheight) {
 	//get a new particle
 	p = new_particle();
 
+	if (p < 0) {
+
+		//the pool is full
+		return;
+	}
+
 	//set position
-	Vec2Copy(position, p->position);
-	p->ground_height = groundheight;
+	pool.position_x[p] = position[VEC_X];
+	pool.position_y[p] = position[VEC_Y];
+	pool.ground_height[p] = groundheight;
 
-	p->life_msec = 300 + Random(0, 20) * 5; //lifetime with some random range
-	p->gravity = PARTICLE_DEFAULT_GRAVITY;	//dust needs to fall down
+	pool.life_msec[p] = 300 + Random(0, 20) * 5; //lifetime with some random range
+	pool.gravity[p] = PARTICLE_DEFAULT_GRAVITY;	//dust needs to fall down
 
-	p->render_layer = RENDER_LAYER_FLOOR_PARTICLE; //render behind everything but the floor
+	pool.render_layer[p] = RENDER_LAYER_FLOOR_PARTICLE; //render behind everything but the floor
 
 	//set color
-	Color3Gray(p->color);
-	p->color[0] += color_variation;
-	p->color[1] += color_variation;
-	p->color[2] += color_variation;
+	Color3Gray(pool.color[p]);
+	pool.color[p][0] += color_variation;
+	pool.color[p][1] += color_variation;
+	pool.color[p][2] += color_variation;
 
 	//set small, random velocity
 	rand_x = Random(-2, 2) * 0.1f;
 	rand_y = Random(0, 2) * 0.2f;
 
-	p->velocity[VEC_X] = rand_x;
-	p->velocity[VEC_Y] = rand_y;
+	pool.velocity_x[p] = rand_x;
+	pool.velocity_y[p] = rand_y;
 }
 
 /**
@@ -287,7 +354,7 @@ void make_walk_dust_particle(vec2_t position, float groundheight) {
 */
 void make_blood_particles(vec2_t position, float groundheight) {
 
-	particle_t *p;
+	int p;
 	float color_variation;
 	float rand_x, rand_y;
 	float offs_x, offs_y;
@@ -311,29 +378,36 @@ void make_blood_particles(vec2_t position, float groundheight) {
 		//make the particle
 		p = new_particle();
 
-		Vec2Copy(position, p->position);
-		p->position[VEC_X] += offs_x;
-		p->position[VEC_Y] += offs_y;
+		if (p < 0) {
+
+			//the pool is full
+			return;
+		}
 
-		p->ground_height = groundheight;
+		pool.position_x[p] = position[VEC_X];
+		pool.position_y[p] = position[VEC_Y];
+		pool.position_x[p] += offs_x;
+		pool.position_y[p] += offs_y;
 
-		p->life_msec = PARTICLE_DEFAULT_MSEC + Random(0, 100);
-		p->gravity = PARTICLE_DEFAULT_GRAVITY;
+		pool.ground_height[p] = groundheight;
 
-		p->render_layer = RENDER_LAYER_EFFECT;
+		pool.life_msec[p] = PARTICLE_DEFAULT_MSEC + Random(0, 100);
+		pool.gravity[p] = PARTICLE_DEFAULT_GRAVITY;
+
+		pool.render_layer[p] = RENDER_LAYER_EFFECT;
 
 		//set color
-		Color3DarkRed(p->color);
-		p->color[0] += color_variation;
-		p->color[1] += color_variation;
-		p->color[2] += color_variation;
+		Color3DarkRed(pool.color[p]);
+		pool.color[p][0] += color_variation;
+		pool.color[p][1] += color_variation;
+		pool.color[p][2] += color_variation;
 
 		//velocity
 		rand_x = Random(-2, 2) * 0.15f;
 		rand_y = Random(0, 2) * 0.5f;
 
-		p->velocity[VEC_X] = rand_x;
-		p->velocity[VEC_Y] = rand_y;
+		pool.velocity_x[p] = rand_x;
+		pool.velocity_y[p] = rand_y;
 	}
 }
 
@@ -342,7 +416,7 @@ void make_blood_particles(vec2_t position, float groundheight) {
 */
 void make_death_particles(vec2_t position) {
 
-	particle_t *p;
+	int p;
 	float color_variation;
 	float rand_x, rand_y;
 	float offs_x, offs_y;
@@ -366,29 +440,36 @@ void make_death_particles(vec2_t position) {
 		//make the particle
 		p = new_particle();
 
-		Vec2Copy(position, p->position);
-		p->position[VEC_X] += offs_x;
-		p->position[VEC_Y] += offs_y;
+		if (p < 0) {
+
+			//the pool is full
+			return;
+		}
 
-		p->ground_height = -10000.f; //put the ground very low so the particles never hits it
+		pool.position_x[p] = position[VEC_X];
+		pool.position_y[p] = position[VEC_Y];
+		pool.position_x[p] += offs_x;
+		pool.position_y[p] += offs_y;
 
-		p->life_msec = 600 + Random(0, 50) * 6;
-		p->gravity = 1;
+		pool.ground_height[p] = -10000.f; //put the ground very low so the particles never hits it
 
-		p->render_layer = RENDER_LAYER_EFFECT;
+		pool.life_msec[p] = 600 + Random(0, 50) * 6;
+		pool.gravity[p] = 1;
+
+		pool.render_layer[p] = RENDER_LAYER_EFFECT;
 
 		//set color
-		Color3Orange(p->color);
-		p->color[0] += color_variation;
-		p->color[1] += color_variation;
-		p->color[2] += color_variation;
+		Color3Orange(pool.color[p]);
+		pool.color[p][0] += color_variation;
+		pool.color[p][1] += color_variation;
+		pool.color[p][2] += color_variation;
 
 		//velocity
 		rand_x = Random(1, 2) * 0.3f * (RandomBool ? (-1) : 1);
 		rand_y = Random(1, 2) * 0.3f * (RandomBool ? (-1) : 1);
 
-		p->velocity[VEC_X] = rand_x;
-		p->velocity[VEC_Y] = rand_y;
+		pool.velocity_x[p] = rand_x;
+		pool.velocity_y[p] = rand_y;
 	}
 }
 
@@ -397,7 +478,7 @@ void make_death_particles(vec2_t position) {
 */
 void make_pickup_particles(vec2_t position, float color_r, float color_g, float color_b) {
 
-	particle_t *p;
+	int p;
 	float color_variation;
 	float rand_x, rand_y;
 	float offs_x, offs_y;
@@ -421,34 +502,41 @@ void make_pickup_particles(vec2_t position, float color_r, float color_g, float
 		//make the particle
 		p = new_particle();
 
-		Vec2Copy(position, p->position);
-		p->position[VEC_X] += offs_x;
-		p->position[VEC_Y] += offs_y;
+		if (p < 0) {
 
-		p->ground_height = -10000.f;
+			//the pool is full
+			return;
+		}
 
-		p->life_msec = 400 + Random(0, 50) * 3;
-		p->gravity = 0;
+		pool.position_x[p] = position[VEC_X];
+		pool.position_y[p] = position[VEC_Y];
+		pool.position_x[p] += offs_x;
+		pool.position_y[p] += offs_y;
 
-		p->render_layer = RENDER_LAYER_EFFECT;
+		pool.ground_height[p] = -10000.f;
+
+		pool.life_msec[p] = 400 + Random(0, 50) * 3;
+		pool.gravity[p] = 0;
+
+		pool.render_layer[p] = RENDER_LAYER_EFFECT;
 
 		//set color
-		p->color[0] = color_r + color_variation;
-		p->color[1] = color_g + color_variation;
-		p->color[2] = color_b + color_variation;
+		pool.color[p][0] = color_r + color_variation;
+		pool.color[p][1] = color_g + color_variation;
+		pool.color[p][2] = color_b + color_variation;
 
 		//velocity
 		rand_x = Random(1, 2) * 0.1f * (RandomBool ? (-1) : 1);
 		rand_y = Random(1, 2) * 0.1f * (RandomBool ? (-1) : 1);
 
-		p->velocity[VEC_X] = rand_x;
-		p->velocity[VEC_Y] = rand_y;
+		pool.velocity_x[p] = rand_x;
+		pool.velocity_y[p] = rand_y;
 	}
 }
 
 void make_chest_particles(vec2_t position, float color_r, float color_g, float color_b) {
 
-	particle_t *p;
+	int p;
 	float color_variation;
 	float rand_x, rand_y;
 	float offs_x, offs_y;
@@ -472,27 +560,34 @@ void make_chest_particles(vec2_t position, float color_r, float color_g, float c
 		//make the particle
 		p = new_particle();
 
-		Vec2Copy(position, p->position);
-		p->position[VEC_X] += offs_x;
-		p->position[VEC_Y] += offs_y;
+		if (p < 0) {
+
+			//the pool is full
+			return;
+		}
+
+		pool.position_x[p] = position[VEC_X];
+		pool.position_y[p] = position[VEC_Y];
+		pool.position_x[p] += offs_x;
+		pool.position_y[p] += offs_y;
 
-		p->ground_height = position[VEC_Y] - (SPRITE_SIZE * 0.8f);
+		pool.ground_height[p] = position[VEC_Y] - (SPRITE_SIZE * 0.8f);
 
-		p->life_msec = 1500 + Random(0, 100) * 3;
-		p->gravity = PARTICLE_DEFAULT_GRAVITY;
+		pool.life_msec[p] = 1500 + Random(0, 100) * 3;
+		pool.gravity[p] = PARTICLE_DEFAULT_GRAVITY;
 
-		p->render_layer = RENDER_LAYER_EFFECT;
+		pool.render_layer[p] = RENDER_LAYER_EFFECT;
 
 		//set color
-		p->color[0] = color_r + color_variation;
-		p->color[1] = color_g + color_variation;
-		p->color[2] = color_b + color_variation;
+		pool.color[p][0] = color_r + color_variation;
+		pool.color[p][1] = color_g + color_variation;
+		pool.color[p][2] = color_b + color_variation;
 
 		//velocity
 		rand_x = Random(1, 2) * 0.1f * (RandomBool ? (-1) : 1);
 		rand_y = Random(7, 10) * 0.2f;
 
-		p->velocity[VEC_X] = rand_x;
-		p->velocity[VEC_Y] = rand_y;
+		pool.velocity_x[p] = rand_x;
+		pool.velocity_y[p] = rand_y;
 	}
 }
\ No newline at end of file
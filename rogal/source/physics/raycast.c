@@ -3,72 +3,175 @@
 * determine if a sprite was hit by a ray casted from a screen point
 * and the second one checks if anything blocks the vision between two
 * sprites.
+* 
+* The vision check walks the map tiles crossed by the ray (a grid DDA)
+* and looks up their collision masks in collision_map, so its cost depends
+* only on the ray length and not on the amount of sprites.
+* 
+* Sprites that can be clicked are registered on pick lists: world sprites
+* on the list of the map tile under them and UI sprites on a separate UI
+* list. A click only checks the sprites of the tile under the mouse (and
+* the UI list), so it doesn't depend on the amount of sprites and particles.
+* Sprites that move must be registered again (register_pick_sprite() does
+* nothing if the tile didn't change).
 */
 
 #include "raycast.h"
 #include "shared.h"
+#include "game.h"
 #include "camera.h"
-#include <GL/glut.h>
 #include <float.h>
+#include <stdlib.h>
 
 static vec2_t mouse_world_pos;
 
+//world sprites registered on each map tile (as MapIndex)
+static sprite_t **pick_map;
+static int pick_map_size;
+
+//clickable UI sprites
+static sprite_t *ui_pick_list;
+
 /*
-* A simple check that determines if the mouse is inside a sprite.
+* Returns the pick list head for the given pick cell.
 */
-int is_mouse_pos_inside_sprite(sprite_t *s) {
+sprite_t **pick_list_head(int cell) {
 
-	//get the distance from mouse to sprite
-	float diff_x = mouse_world_pos[VEC_X] - s->position[VEC_X];
-	float diff_y = mouse_world_pos[VEC_Y] - s->position[VEC_Y];
+	if (cell == PICK_UI) {
 
-	//see if the distance fits inside that sprite
-	return (fabs(diff_x) < ((double)SPRITE_SIZE * fabs(s->scale_x)) && //cast to double to fix an arithmetic overflow warning
-			fabs(diff_y) < ((double)SPRITE_SIZE * fabs(s->scale_y)));  //and use fabs on scale to fix scales less than 0
+		return &ui_pick_list;
+	}
+
+	//world cells are tile indices + 1
+	return &pick_map[cell - 1];
+}
+
+/*
+* Reallocates the pick lists for the current map size. Sprites that are still
+* registered on the old map are dropped from picking until registered again.
+*/
+void resize_pick_map(void) {
+
+	sprite_t *s, *next;
+
+	for (int i = 0; i < pick_map_size * pick_map_size; i++) {
+
+		for (s = pick_map[i]; s; s = next) {
+
+			next = s->pick_next;
+			s->pick_next = NULL;
+			s->pick_cell = PICK_NONE;
+		}
+	}
+
+	free(pick_map);
+	pick_map = calloc((size_t)map_size * map_size, sizeof(sprite_t *));
+	pick_map_size = map_size;
+
+	if (!pick_map) {
+
+		out_of_memory_error(__func__);
+		pick_map_size = 0;
+	}
+}
+
+/*
+* Removes the sprite from its pick list.
+*/
+void unregister_pick_sprite(sprite_t *s) {
+
+	sprite_t **current;
+
+	if (s->pick_cell == PICK_NONE) {
+
+		return;
+	}
+
+	for (current = pick_list_head(s->pick_cell); *current; current = &(*current)->pick_next) {
+
+		if (*current == s) {
+
+			*current = s->pick_next;
+			break;
+		}
+	}
+
+	s->pick_next = NULL;
+	s->pick_cell = PICK_NONE;
+}
+
+/*
+* Adds the sprite to the given pick list.
+*/
+void add_to_pick_list(sprite_t *s, int cell) {
+
+	sprite_t **head;
+
+	if (s->pick_cell == cell) {
+
+		//already there
+		return;
+	}
+
+	unregister_pick_sprite(s);
+
+	head = pick_list_head(cell);
+	s->pick_next = *head;
+	s->pick_cell = cell;
+	*head = s;
 }
 
 /*
-* Projects mouse position from screen space to world space position.
+* Registers a world sprite on the map tile under its position.
 */
-void mouse_to_world_coordinates(int x, int y) {
+void register_pick_sprite(sprite_t *s) {
 
-	GLint viewport[4];
-	mat4_t modelview_mat, projection_mat;
-	GLfloat wx, wy;
-	GLdouble out_x, out_y, out_z;
+	int x = (int)floorf(s->position[VEC_X] + map_offset + 0.5f);
+	int y = (int)floorf(s->position[VEC_Y] + map_offset + 0.5f);
 
-	Vec2Zero(mouse_world_pos);
+	if (!is_inside_map(x, y)) {
 
-	//get viewport matrix
-	glGetIntegerv(GL_VIEWPORT, viewport);
-	y = viewport[3] - y;
+		//can't be clicked outside of the map
+		unregister_pick_sprite(s);
+		return;
+	}
 
-	wx = (GLfloat)x;
-	wy = (GLfloat)y;
+	add_to_pick_list(s, MapIndex(x, y) + 1);
+}
 
-	//get transformation matrices
-	glGetDoublev(GL_MODELVIEW_MATRIX, modelview_mat);
-	glGetDoublev(GL_PROJECTION_MATRIX, projection_mat);
+/*
+* Registers a UI sprite so it can be clicked.
+*/
+void register_ui_pick_sprite(sprite_t *s) {
+
+	add_to_pick_list(s, PICK_UI);
+}
+
+/*
+* A simple check that determines if the mouse is inside a sprite.
+*/
+int is_mouse_pos_inside_sprite(sprite_t *s) {
 
-	//unproject screen position to world position
-	gluUnProject(wx, wy, 0, modelview_mat, projection_mat, viewport, &out_x, &out_y, &out_z);
+	//get the distance from mouse to sprite
+	float diff_x = mouse_world_pos[VEC_X] - s->position[VEC_X];
+	float diff_y = mouse_world_pos[VEC_Y] - s->position[VEC_Y];
 
-	//copy output values into the vector
-	mouse_world_pos[VEC_X] = (vec_t)out_x;
-	mouse_world_pos[VEC_Y] = (vec_t)out_y;
+	//see if the distance fits inside that sprite
+	return (fabs(diff_x) < ((double)SPRITE_SIZE * fabs(s->scale_x)) && //cast to double to fix an arithmetic overflow warning
+			fabs(diff_y) < ((double)SPRITE_SIZE * fabs(s->scale_y)));  //and use fabs on scale to fix scales less than 0
 }
 
 /*
 * Performs screen to world raycast against UI layers using the raycast mask.
 * This is done before raycasting all other render layers.
 */
-sprite_t *screen_to_world_ui_raycast(sprite_t *first, int raycast_mask) {
+sprite_t *screen_to_world_ui_raycast(int raycast_mask) {
 
-	sprite_t *current = first;
+	sprite_t *current = ui_pick_list;
 	vec2_t original;
 	vec2_t *camera_offset = get_camera_offset();
 
-	//iterate over all sprites
+	//iterate over all clickable UI sprites
 	while (current) {
 
 		if (!current->skip_render &&						//skip inactive sprites
@@ -92,34 +195,62 @@ sprite_t *screen_to_world_ui_raycast(sprite_t *first, int raycast_mask) {
 
 			Vec2Copy(original, current->position);
 		}
-		current = current->next;
+		current = current->pick_next;
 	}
 	//hit nothing
 	return NULL;
 }
 
 /*
-* Performs screen to world raycast against all layers, for sprites with matching raycast mask.
-* Returns the first sprite that was hit.
+* Performs a raycast at the world position against the world layers (no UI), for sprites
+* with matching raycast mask. Returns the top-most sprite that was hit.
 */
-sprite_t *screen_to_world_raycast(int x, int y, int raycast_mask) {
+sprite_t *world_raycast(vec2_t position, int raycast_mask) {
+
+	sprite_t *current;
+	sprite_t *hit = NULL;
+	int tile_x, tile_y;
+
+	Vec2Copy(position, mouse_world_pos);
 
-	sprite_t *first = sprite_head();
-	sprite_t *current = first;
+	//find the tile under the mouse
+	tile_x = (int)floorf(mouse_world_pos[VEC_X] + map_offset + 0.5f);
+	tile_y = (int)floorf(mouse_world_pos[VEC_Y] + map_offset + 0.5f);
 
-	//nothing to raycast against
-	if (!first) {
+	if (!is_inside_map(tile_x, tile_y)) {
 
 		return NULL;
 	}
 
-	//transform mouse position to world coordinates
-	mouse_to_world_coordinates(x, y);
+	//take the top-most sprite of that tile
+	for (current = pick_map[MapIndex(tile_x, tile_y)]; current; current = current->pick_next) {
+
+		if (current->collision_mask != COLLISION_IGNORE &&	//skip collision ignores
+			current->collision_mask & raycast_mask &&		//check if collision mask is a match
+			!current->skip_render &&						//ignore inactive sprites
+			current->render_layer <= RENDER_LAYER_ONTOP &&	//world layers only
+			(!hit || current->render_layer > hit->render_layer) &&
+			is_mouse_pos_inside_sprite(current)) {
+
+			hit = current;
+		}
+	}
+
+	return hit;
+}
+
+/*
+* Performs a raycast at the world position against all layers (UI first), for sprites with
+* matching raycast mask. Returns the first sprite that was hit.
+*/
+sprite_t *position_raycast(vec2_t position, int raycast_mask) {
+
+	Vec2Copy(position, mouse_world_pos);
 
 	//try UI first
 	if (raycast_mask & COLLISION_UI) {
 
-		sprite_t *out = screen_to_world_ui_raycast(first, raycast_mask);
+		sprite_t *out = screen_to_world_ui_raycast(raycast_mask);
 
 		if (out) {
 
@@ -127,131 +258,150 @@ sprite_t *screen_to_world_raycast(int x, int y, int raycast_mask) {
 		}
 	}
 
-	//walk layers top to bottom
-	for (int i = RENDER_LAYER_ONTOP; i >= 0; i--) {
+	return world_raycast(mouse_world_pos, raycast_mask);
+}
 
-		//iterate over all sprites
-		while (current)
-		{
-			if (current->collision_mask != COLLISION_IGNORE &&	//skip collision ignores
-				current->render_layer == (unsigned)i &&			//check if this sprite is on the correct layer
-				current->collision_mask & raycast_mask &&		//check if collision mask is a match
-				!current->skip_render) {						//ignore inactive sprites
+/*
+* Performs screen to world raycast against all layers, for sprites with matching raycast mask.
+* Returns the first sprite that was hit.
+*/
+sprite_t *screen_to_world_raycast(int x, int y, int raycast_mask) {
 
-				//check this sprite
-				if (is_mouse_pos_inside_sprite(current)) {
+	vec2_t position;
 
-					//hit
-					return current;
-				}
-			}
-			current = current->next;
-		}
+	//transform mouse position to world coordinates
+	screen_to_world_coordinates(x, y, position);
 
-		current = first;
-	}
-	//hit nothing
-	return NULL;
+	return position_raycast(position, raycast_mask);
 }
 
 /*
-* Checks if two lines intersect. The point variable is set as their contact point if they do.
+* Checks if the map tile at the given map coordinates blocks the ray. The rules match
+* the old sprite edge tests: the tile center has to be inside the axis aligned rectangle
+* spanned by the ray, tiles at the ray ends are ignored and so is a ray that doesn't
+* leave the tile.
 */
-int line_line_intersection(vec2_t start1, vec2_t end1, vec2_t start2, vec2_t end2, vec2_t *point) {
+int is_tile_blocking_ray(int x, int y, vec2_t start, vec2_t end, int raycast_mask) {
 
-	//using the document found at http://www.cs.swan.ac.uk/~cssimon/line_intersection.html
+	vec2_t center;
 
-	float a1, a2, b, t1, t2;
+	if (!is_inside_map(x, y) ||
+		collision_map[MapIndex(x, y)] == COLLISION_IGNORE ||
+		!(collision_map[MapIndex(x, y)] & raycast_mask)) {
 
-	b = (end2[VEC_X] - start2[VEC_X]) * (start1[VEC_Y] - end1[VEC_Y]) - (end2[VEC_Y] - start2[VEC_Y]) * (start1[VEC_X] - end1[VEC_X]);
+		return 0;
+	}
 
-	if (b == 0) {
+	center[VEC_X] = (float)(x - map_offset);
+	center[VEC_Y] = (float)(y - map_offset);
+
+	//the tile has to fit in the axis aligned rectangle where the ray is its diagonal
+	if (center[VEC_X] > max(start[VEC_X], end[VEC_X]) || center[VEC_X] < min(start[VEC_X], end[VEC_X]) ||
+		center[VEC_Y] > max(start[VEC_Y], end[VEC_Y]) || center[VEC_Y] < min(start[VEC_Y], end[VEC_Y])) {
 
 		return 0;
 	}
 
-	a1 = (start2[VEC_Y] - end2[VEC_Y]) * (start1[VEC_X] - start2[VEC_X]) + (end2[VEC_X] - start2[VEC_X]) * (start1[VEC_Y] - start2[VEC_Y]);
-	a2 = (start1[VEC_Y] - end1[VEC_Y]) * (start1[VEC_X] - start2[VEC_X]) + (end1[VEC_X] - start1[VEC_X]) * (start1[VEC_Y] - start2[VEC_Y]);
+	//ignore the source tiles...
+	if (Vec2Distance(start, center) < SPRITE_SIZE || Vec2Distance(end, center) < SPRITE_SIZE) {
 
-	t1 = a1 / b;
-	t2 = a2 / b;
+		return 0;
+	}
 
-	if (t1 >= 0 && t1 <= 1 && t2 >= 0 && t2 <= 1) {
+	//a ray that is completely inside the tile never crosses its edges
+	if (fabsf(start[VEC_X] - center[VEC_X]) < SPRITE_SIZE && fabsf(start[VEC_Y] - center[VEC_Y]) < SPRITE_SIZE &&
+		fabsf(end[VEC_X] - center[VEC_X]) < SPRITE_SIZE && fabsf(end[VEC_Y] - center[VEC_Y]) < SPRITE_SIZE) {
 
-		Vec2Lerp(start1, end1, t1, *point);
-		return 1;
+		return 0;
 	}
-	return 0;
+
+	return 1;
 }
 
 /*
 * This function checks if two sprites can "see" each other (one placed at the "start" and the other at the "end" position).
-* Designed to be used with the visibility calculations.
+* Designed to be used with the visibility calculations. Only map tiles are checked (see collision_map).
 * parameter vec2_t *point: this is set as the point that was hit by the ray. If null is passed to the function then
 * the function returns true if _anything_ was hit
 */
 int sprite_ray_intersection(vec2_t start, vec2_t end, int raycast_mask, vec2_t *point) {
 
-	sprite_t *first = sprite_head();
-	sprite_t *current = first;
-	vec2_t v1, v2, out_p;
-	float dist;
-	float min_dist = FLT_MAX;
-
-	//nothing to test
-	if (!first) {
+	//ray start in map coordinates (tile x covers x - 0.5 to x + 0.5)
+	float start_x = start[VEC_X] + map_offset;
+	float start_y = start[VEC_Y] + map_offset;
 
-		return 0;
-	}
+	float dir_x = end[VEC_X] - start[VEC_X];
+	float dir_y = end[VEC_Y] - start[VEC_Y];
 
-	//an axis aligned rectangle where the ray is its diagonal
-	float x_max = max(start[VEC_X], end[VEC_X]);
-	float x_min = min(start[VEC_X], end[VEC_X]);
+	//the current tile (when the ray starts on a tile edge take the tile behind it, the loop will step over the edge)
+	int x = dir_x > 0 ? (int)ceilf(start_x + 0.5f) - 1 : (int)floorf(start_x + 0.5f);
+	int y = dir_y > 0 ? (int)ceilf(start_y + 0.5f) - 1 : (int)floorf(start_y + 0.5f);
 
-	float y_max = max(start[VEC_Y], end[VEC_Y]);
-	float y_min = min(start[VEC_Y], end[VEC_Y]);
+	int step_x = dir_x > 0 ? 1 : -1;
+	int step_y = dir_y > 0 ? 1 : -1;
 
-	while (current)
-	{
-		//the first condition checks if the sprite fits in the axis aligned rectangle
-		if ((current->position[VEC_X] <= x_max && current->position[VEC_X] >= x_min && current->position[VEC_Y] <= y_max && current->position[VEC_Y] >= y_min) &&
-			current->collision_mask != COLLISION_IGNORE &&
-			current->collision_mask & raycast_mask &&
-			!current->skip_render &&
-			!(Vec2Distance(start, current->position) < SPRITE_SIZE) && //ignore the source sprites...
-			!(Vec2Distance(end, current->position) < SPRITE_SIZE)) {
+	//ray fraction needed to cross a whole tile
+	float delta_x = dir_x != 0 ? fabsf(1.f / dir_x) : FLT_MAX;
+	float delta_y = dir_y != 0 ? fabsf(1.f / dir_y) : FLT_MAX;
 
-			//check each edge of the current sprite
-			for (int i = 0; i < 4; i++) {
+	//ray fraction at the next tile edge
+	float next_x = dir_x != 0 ? (x + 0.5f * step_x - start_x) / dir_x : FLT_MAX;
+	float next_y = dir_y != 0 ? (y + 0.5f * step_y - start_y) / dir_y : FLT_MAX;
 
-				//get start and end of the current edge
-				v1[VEC_X] = current->position[VEC_X] + current->scale_x * SPRITE_SIZE * ((i < 2) ? -1 : 1);
-				v1[VEC_Y] = current->position[VEC_Y] - current->scale_y * SPRITE_SIZE * ((i % 3) ? 1 : -1);
+	float t;
 
-				v2[VEC_X] = current->position[VEC_X] + current->scale_x * SPRITE_SIZE * ((i % 3) ? -1 : 1);
-				v2[VEC_Y] = current->position[VEC_Y] + current->scale_y * SPRITE_SIZE * ((i < 2) ? 1 : -1);
+	//the ray can start inside a blocking tile and hit it when leaving
+	if (is_tile_blocking_ray(x, y, start, end, raycast_mask)) {
 
-				//try intersecting the ray with this edge
-				if (line_line_intersection(start, end, v1, v2, &out_p)) {
+		t = min(next_x, next_y);
+		goto hit;
+	}
 
-					if (!point) {
+	//walk all tiles touched by the ray
+	while (next_x <= 1.f || next_y <= 1.f) {
 
-						return 1;
-					}
+		if (next_x == next_y) {
 
-					//take the closest ray hit point
-					dist = Vec2Distance(start, out_p);
+			//the ray goes exactly through a corner and touches both side tiles
+			t = next_x;
 
-					if (dist < min_dist) {
+			if (is_tile_blocking_ray(x + step_x, y, start, end, raycast_mask) ||
+				is_tile_blocking_ray(x, y + step_y, start, end, raycast_mask)) {
 
-						min_dist = dist;
-						Vec2Copy(out_p, *point);
-					}
-				}
+				goto hit;
 			}
+
+			x += step_x;
+			y += step_y;
+			next_x += delta_x;
+			next_y += delta_y;
+		}
+		else if (next_x < next_y) {
+
+			t = next_x;
+			x += step_x;
+			next_x += delta_x;
+		}
+		else
+		{
+			t = next_y;
+			y += step_y;
+			next_y += delta_y;
+		}
+
+		if (is_tile_blocking_ray(x, y, start, end, raycast_mask)) {
+
+			goto hit;
 		}
-		current = current->next;
 	}
 
-	return min_dist < FLT_MAX;
+	return 0;
+
+hit:
+	//tiles are visited in the ray order so this is the closest hit point
+	if (point) {
+
+		Vec2Lerp(start, end, t, *point);
+	}
+	return 1;
 }
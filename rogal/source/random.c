@@ -0,0 +1,88 @@
+/*
+* This file contains the seeded random number generator used by everything
+* that has to be reproducible (maps, map contents, mob and item statistics).
+*
+* The generator is xoshiro128**: a few shifts and rotations per number and
+* 16 bytes of state, so every generator context can own its own state and
+* nothing depends on the global rand() state. The state is filled from the
+* seed with splitmix32 so similar seeds give unrelated sequences.
+*/
+
+#include "shared.h"
+
+/*
+* Rotates the bits to the left.
+*/
+static inline unsigned int rotate_left(unsigned int x, int k) {
+
+	return (x << k) | (x >> (32 - k));
+}
+
+/*
+* Mixes two numbers into a well distributed 32 bit number (splitmix32 finalizer).
+*/
+unsigned int rng_hash(unsigned int a, unsigned int b) {
+
+	unsigned int z = a + 0x9e3779b9u * (b + 1);
+
+	z = (z ^ (z >> 16)) * 0x85ebca6bu;
+	z = (z ^ (z >> 13)) * 0xc2b2ae35u;
+	return z ^ (z >> 16);
+}
+
+/*
+* Initializes the generator state from a seed. Different streams of the same
+* seed give independent sequences.
+*/
+void rng_seed(rng_t *rng, unsigned int seed, unsigned int stream) {
+
+	unsigned int z = rng_hash(seed, stream);
+
+	for (int i = 0; i < 4; i++) {
+
+		z = rng_hash(z, (unsigned int)i);
+		rng->state[i] = z;
+	}
+
+	//the state must not be all zeros
+	if (!(rng->state[0] | rng->state[1] | rng->state[2] | rng->state[3])) {
+
+		rng->state[0] = 1;
+	}
+}
+
+/*
+* Returns the next random 32 bit number.
+*/
+unsigned int rng_next(rng_t *rng) {
+
+	unsigned int *s = rng->state;
+	unsigned int result = rotate_left(s[1] * 5, 7) * 9;
+	unsigned int t = s[1] << 9;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+
+	s[2] ^= t;
+	s[3] = rotate_left(s[3], 11);
+
+	return result;
+}
+
+/*
+* Returns a random number between min_val and max_val (both included).
+*/
+int rng_range(rng_t *rng, int min_val, int max_val) {
+
+	unsigned int range = (unsigned int)(max_val - min_val) + 1;
+
+	if (max_val <= min_val) {
+
+		return min_val;
+	}
+
+	//multiply-shift instead of modulo: no division and no bias towards small numbers worth mentioning
+	return min_val + (int)(((unsigned long long)rng_next(rng) * range) >> 32);
+}
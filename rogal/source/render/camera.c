@@ -1,32 +1,108 @@
 /*
 * This file allows an easier control over view projection transformation.
+* 
+* The modelview matrix is kept here (and the projection matrix in window.c)
+* so that projecting and unprojecting positions is done with plain math
+* instead of reading the matrices back from OpenGL. The matrices are
+* uploaded once per frame by load_camera_matrices().
+*
+* The headless build (HEADLESS) doesn't render, so it only keeps the camera
+* position and the projection math.
 */
 
 #include "camera.h"
+#include <string.h>
+
+#ifndef HEADLESS
 #include "renderer.h"
 #include <GL/glut.h>
+#endif // !HEADLESS
 
 static camera_t cam;
 static vec2_t view_to_world_vec;
 
+//world modelview matrix (column-major, uploaded once per frame)
+static mat4_t modelview_mat = {
+	1, 0, 0, 0,
+	0, 1, 0, 0,
+	0, 0, 1, 0,
+	0, 0, 0, 1
+};
+
+#ifndef HEADLESS
+//modelview matrix of the drawn frame (camera interpolated between simulation ticks)
+static mat4_t render_modelview_mat;
+#endif // !HEADLESS
+
+/*
+* Updates the modelview matrix after a camera position change.
+*/
+void update_modelview_matrix(void) {
+
+	modelview_mat[12] = cam.position[VEC_X];
+	modelview_mat[13] = cam.position[VEC_Y];
+}
+
+/*
+* Transforms a point with a matrix. The camera and projection matrices only
+* scale and translate, so only those parts of the matrix are used.
+*/
+void transform_point(const mat4_t m, const double in[2], double out[2]) {
+
+	out[VEC_X] = in[VEC_X] * m[0] + m[12];
+	out[VEC_Y] = in[VEC_Y] * m[5] + m[13];
+}
+
+/*
+* Reverses transform_point().
+*/
+void inverse_transform_point(const mat4_t m, const double in[2], double out[2]) {
+
+	out[VEC_X] = (in[VEC_X] - m[12]) / m[0];
+	out[VEC_Y] = (in[VEC_Y] - m[13]) / m[5];
+}
+
 /*
 * Projects world position into a screen position.
 */
 void world_to_screen_coordinates(vec2_t world_pos, int *x, int *y) {
 
-	GLint viewport[4];
-	mat4_t modelview_mat, projection_mat;
-	GLdouble out_x, out_y, out_z;
+	double point[2] = { world_pos[VEC_X], world_pos[VEC_Y] };
+	double view[2], ndc[2];
+
+	transform_point(modelview_mat, point, view);
+	transform_point(window_props.projection, view, ndc);
+
+	//normalized device coordinates to window coordinates
+	*x = (int)((ndc[VEC_X] + 1.0) * 0.5 * window_props.width);
+	*y = (int)((ndc[VEC_Y] + 1.0) * 0.5 * window_props.height);
+}
+
+/*
+* Unprojects window coordinates (where [0, 0] is bottom left corner of the window)
+* into a world position.
+*/
+void window_to_world_coordinates(double x, double y, vec2_t out) {
 
-	glGetIntegerv(GL_VIEWPORT, viewport);
+	double ndc[2], view[2], world[2];
 
-	glGetDoublev(GL_MODELVIEW_MATRIX, modelview_mat);
-	glGetDoublev(GL_PROJECTION_MATRIX, projection_mat);
+	//window coordinates to normalized device coordinates
+	ndc[VEC_X] = x / window_props.width * 2.0 - 1.0;
+	ndc[VEC_Y] = y / window_props.height * 2.0 - 1.0;
 
-	gluProject(world_pos[VEC_X], world_pos[VEC_Y], 0.0, modelview_mat, projection_mat, viewport, &out_x, &out_y, &out_z);
+	inverse_transform_point(window_props.projection, ndc, view);
+	inverse_transform_point(modelview_mat, view, world);
 
-	*x = (int)out_x;
-	*y = (int)out_y;
+	out[VEC_X] = (vec_t)world[VEC_X];
+	out[VEC_Y] = (vec_t)world[VEC_Y];
+}
+
+/*
+* Unprojects a mouse position (where [0, 0] is top left corner of the window) into a world position.
+*/
+void screen_to_world_coordinates(int x, int y, vec2_t out) {
+
+	window_to_world_coordinates(x, window_props.height - y, out);
 }
 
 /*
@@ -36,28 +112,14 @@ void world_to_screen_coordinates(vec2_t world_pos, int *x, int *y) {
 */
 vec2_t *viewport_to_world_pos(vec2_t view_pos, int is_ui_space) {
 
-	mat4_t modelview_mat, projection_mat;
-	GLdouble out_x, out_y, out_z;
-	GLint viewport[4];
-
 	view_pos[VEC_X] = r_clamp(view_pos[VEC_X], 0.f, 1.f) * window_props.width;
 	view_pos[VEC_Y] = r_clamp(view_pos[VEC_Y], 0.f, 1.f) * window_props.height;
 
-	Vec2Zero(view_to_world_vec);
-
-	//get matrices
-	glGetIntegerv(GL_VIEWPORT, viewport);
-
-	glGetDoublev(GL_MODELVIEW_MATRIX, modelview_mat);
-	glGetDoublev(GL_PROJECTION_MATRIX, projection_mat);
-
 	//unproject viewport position to world position
-	gluUnProject(view_pos[VEC_X], view_pos[VEC_Y], 1, modelview_mat, projection_mat, viewport, &out_x, &out_y, &out_z);
+	window_to_world_coordinates(view_pos[VEC_X], view_pos[VEC_Y], view_to_world_vec);
 
-	view_to_world_vec[VEC_X] = (float)out_x + (is_ui_space ? cam.position[VEC_X] : 0);
-	view_to_world_vec[VEC_Y] = (float)out_y + (is_ui_space ? cam.position[VEC_Y] : 0);
-
-	print_gl_errors(__func__);
+	view_to_world_vec[VEC_X] += (is_ui_space ? cam.position[VEC_X] : 0);
+	view_to_world_vec[VEC_Y] += (is_ui_space ? cam.position[VEC_Y] : 0);
 
 	return &view_to_world_vec;
 }
@@ -66,18 +128,11 @@ vec2_t *viewport_to_world_pos(vec2_t view_pos, int is_ui_space) {
 * Sets the camera position to the given vector.
 */
 void set_camera_position(vec2_t position) {
-	
-	//back to (0, 0)
-	glMatrixMode(GL_MODELVIEW);
-	glTranslatef(-cam.position[VEC_X], -cam.position[VEC_Y], 0.f);
 
 	Vec2Negative(position);
 	Vec2Copy(position, cam.position);
 
-	glMatrixMode(GL_MODELVIEW);
-	glTranslatef(position[VEC_X], position[VEC_Y], 0.f);
-
-	print_gl_errors(__func__);
+	update_modelview_matrix();
 }
 
 /*
@@ -88,10 +143,7 @@ void offset_camera_position(vec2_t offset) {
 	Vec2Negative(offset);
 	Vec2Add(cam.position, offset, cam.position);
 
-	glMatrixMode(GL_MODELVIEW);
-	glTranslatef(offset[VEC_X], offset[VEC_Y], 0.f);
-
-	print_gl_errors(__func__);
+	update_modelview_matrix();
 }
 
 /*
@@ -102,23 +154,42 @@ vec2_t *get_camera_offset(void) {
 	return &cam.position;
 }
 
+#ifndef HEADLESS
 /*
-* Sets modelview matrix for UI rendering.
+* Uploads the projection and world modelview matrices. Called once per frame before drawing.
 */
-void set_camera_for_ui(void) {
+void load_camera_matrices(void) {
+
+	float interpolation = get_render_interpolation();
+	float diff_x = cam.position[VEC_X] - cam.last_position[VEC_X];
+	float diff_y = cam.position[VEC_Y] - cam.last_position[VEC_Y];
+
+	memcpy(render_modelview_mat, modelview_mat, sizeof(mat4_t));
 
-	vec2_t negative;
+	//draw the camera between the last and the current tick (unless it jumped)
+	if (fabsf(diff_x) <= MAX_INTERPOLATION_DISTANCE && fabsf(diff_y) <= MAX_INTERPOLATION_DISTANCE) {
 
-	//find a vector negative to the current camera position
-	Vec2Copy(cam.position, negative);
-	Vec2Negative(negative);
+		render_modelview_mat[12] = cam.last_position[VEC_X] + diff_x * interpolation;
+		render_modelview_mat[13] = cam.last_position[VEC_Y] + diff_y * interpolation;
+	}
 
-	//push the current matrix
-	glPushMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixd(window_props.projection);
 
-	//translate the camera to [0, 0]
 	glMatrixMode(GL_MODELVIEW);
-	glTranslatef(negative[VEC_X], negative[VEC_Y], 0.f);
+	glLoadMatrixd(render_modelview_mat);
+
+	print_gl_errors(__func__);
+}
+
+/*
+* Sets modelview matrix for UI rendering.
+*/
+void set_camera_for_ui(void) {
+
+	//UI is drawn around the world center
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
 
 	print_gl_errors(__func__);
 }
@@ -128,12 +199,20 @@ void set_camera_for_ui(void) {
 */
 void unset_camera_for_ui(void) {
 
-	//pop back the old matrix
 	glMatrixMode(GL_MODELVIEW);
-	glPopMatrix();
+	glLoadMatrixd(render_modelview_mat);
 
 	print_gl_errors(__func__);
 }
+#endif // !HEADLESS
+
+/*
+* Saves the camera position at the start of a simulation tick.
+*/
+void store_camera_position(void) {
+
+	Vec2Copy(cam.position, cam.last_position);
+}
 
 /*
 * Initializes the camera.
@@ -141,4 +220,5 @@ void unset_camera_for_ui(void) {
 void init_camera(void) {
 
 	Vec2Zero(cam.position);
+	update_modelview_matrix();
 }
\ No newline at end of file
@@ -8,17 +8,58 @@
 * Culling is not implemented to keep the program as simple as
 * possible.
 * 
-* Drawing is always done using the immediate mode method. Sprites
-* are drawn using GL_QUADS mode and particles are drawn using
-* GL_POINTS mode.
+* Drawing is done in batches. At the start of each frame all
+* visible sprites and particles are written into one vertex buffer
+* (kept in the program's memory and sent to OpenGL as a vertex
+* array), layer by layer. Inside a layer the sprites are grouped by
+* their texture, so every layer needs only one draw call for each
+* texture used on it. All textures are packed on a single atlas page
+* (see textures.c), so usually this is a single draw call per layer.
+* Sprites are drawn using GL_QUADS mode and particles are drawn
+* using GL_POINTS mode.
 */
 
 #include "shared.h"
 #include "renderer.h"
+#include "textures.h"
 #include "camera.h"
 #include "particles.h"
 #include "window.h"
 
+//a single vertex sent to the GPU
+typedef struct {
+	GLfloat x, y;	//position
+	GLfloat u, v;	//texture coordinates
+	GLfloat r, g, b;	//color
+} vertex_t;
+
+//a range of vertices drawn with a single draw call
+typedef struct {
+	GLenum			mode;		//GL_QUADS or GL_POINTS
+	unsigned int	tex_id;		//texture used by the batch (quads only)
+	unsigned int	layer;		//render layer of the batch
+	GLint			first;		//first vertex
+	GLsizei			count;		//vertex count
+} batch_t;
+
+//frame vertex buffer
+static vertex_t *vertices;
+static int vertex_count;
+static int vertex_capacity;
+
+//frame draw calls
+static batch_t *batches;
+static int batch_count;
+static int batch_capacity;
+
+//sprites of the currently processed layer (for grouping by texture)
+static sprite_t **layer_sprites;
+static sprite_t **sorted_sprites;
+static int layer_sprites_capacity;
+
+//the amount of draw calls issued during the last frame
+static int frame_draw_calls;
+
 /*
 * Used to retrieve and print all errors from OpenGL API.
 */
@@ -34,56 +75,126 @@ void print_gl_errors(const char *caller_name) {
 }
 
 /*
-* Draws a single particle on the screen.
+* Returns the amount of draw calls issued during the last frame.
 */
-void draw_particle(particle_t *p) {
+int get_frame_draw_calls(void) {
+
+	return frame_draw_calls;
+}
+
+/*
+* Makes sure the frame vertex buffer can fit the given amount of additional vertices.
+*/
+void reserve_vertices(int count) {
+
+	vertex_t *v;
+
+	if (vertex_count + count <= vertex_capacity) {
+
+		return;
+	}
+
+	while (vertex_count + count > vertex_capacity) {
+
+		vertex_capacity = vertex_capacity ? vertex_capacity * 2 : 4096;
+	}
+
+	v = realloc(vertices, sizeof(vertex_t) * vertex_capacity);
+
+	if (!v) {
+
+		out_of_memory_error(__func__);
+		return;
+	}
+	vertices = v;
+}
+
+/*
+* Starts a new batch or extends the last one if it uses the same state.
+*/
+void add_batch(GLenum mode, unsigned int tex_id, unsigned int layer, int first, int count) {
+
+	batch_t *b;
+
+	if (batch_count) {
+
+		b = &batches[batch_count - 1];
+
+		if (b->mode == mode && b->layer == layer && (mode == GL_POINTS || b->tex_id == tex_id) && b->first + b->count == first) {
+
+			//same state, just draw more vertices
+			b->count += count;
+			return;
+		}
+	}
+
+	if (batch_count == batch_capacity) {
+
+		batch_capacity = batch_capacity ? batch_capacity * 2 : 64;
+		b = realloc(batches, sizeof(batch_t) * batch_capacity);
+
+		if (!b) {
 
-	glBegin(GL_POINTS);
+			out_of_memory_error(__func__);
+			return;
+		}
+		batches = b;
+	}
 
-	//set color
-	glColor4f(p->color[0], p->color[1], p->color[2], 1.f);
+	b = &batches[batch_count++];
+	b->mode = mode;
+	b->tex_id = tex_id;
+	b->layer = layer;
+	b->first = first;
+	b->count = count;
+}
 
-	//set position
-	glVertex2f(p->position[VEC_X], p->position[VEC_Y]);
+/*
+* Writes a vertex into the frame vertex buffer.
+*/
+static inline void push_vertex(float x, float y, float u, float v, color3_t color) {
 
-	glEnd();
+	vertex_t *vert = &vertices[vertex_count++];
+
+	vert->x = x;
+	vert->y = y;
+	vert->u = u;
+	vert->v = v;
+	vert->r = color[0];
+	vert->g = color[1];
+	vert->b = color[2];
 }
 
 /*
-* Orders drawing of all particles that belong to the passed layer.
+* Adds all particles that belong to the passed layer to the frame.
 */
-void draw_particles(int layer) {
+void batch_particles(unsigned layer) {
 
-	particle_t *first = head_particle();
-	particle_t *current = first;
+	particle_pool_t *pool = particles_pool();
+	int first = vertex_count;
 
 	//nothing to draw
-	if (!first) {
+	if (!pool->count) {
 
 		return;
 	}
 
-	//make sure the particle size is scaled when the screen is being scaled.
-	glPointSize(5.f * window_props.height / VIRTUAL_HEIGHT); //5.f is the particle size
-	
-	//disable texturing mode
-	glDisable(GL_TEXTURE_2D);
+	reserve_vertices(pool->count);
 
 	//loop over all particles
-	while (current) {
+	for (int i = 0; i < pool->count; i++) {
 
 		//check if the layer matches and if the particle is visible
-		if (current->render_layer == layer && current->visibility == VIS_VISIBLE) {
+		if (pool->render_layer[i] == (int)layer && pool->visibility[i] == VIS_VISIBLE) {
 
-			//draw it
-			draw_particle(current);
+			push_vertex(pool->position_x[i], pool->position_y[i], 0.f, 0.f, pool->color[i]);
 		}
-
-		//go to the next particle
-		current = current->next;
 	}
 
-	print_gl_errors(__func__);
+	if (vertex_count > first) {
+
+		add_batch(GL_POINTS, 0, layer, first, vertex_count - first);
+	}
 }
 
 /*
@@ -97,118 +208,244 @@ float uv_offset_for_sprite(float framestep, int current_frame) {
 }
 
 /*
-* Draws a sprite on the screen.
+* Writes four vertices of a sprite into the frame vertex buffer.
 */
-void draw_sprite(sprite_t *s) {
+void batch_sprite(sprite_t *s) {
 
-	//position
-	float x = s->position[VEC_X];
-	float y = s->position[VEC_Y];
+	vec2_t position;
+	float x, y;
 
 	//size
 	float sprite_size_x = SPRITE_SIZE * s->scale_x;
 	float sprite_size_y = SPRITE_SIZE * s->scale_y;
 
+	//the part of the atlas used by this sprite's texture
+	const texregion_t *region = get_texture_region(s->tex_id);
+
 	//UV X axis offset
-	float framestep = 1.f / s->framecount;
-	float uv_offset = uv_offset_for_sprite(framestep, s->current_frame);
+	float framestep = (region->u1 - region->u0) / s->framecount;
+	float uv_offset = region->u0 + uv_offset_for_sprite(framestep, s->current_frame);
 
 	vec2_t uvs[4];
 
+	//position (between the last and the current simulation tick)
+	get_sprite_render_position(s, get_render_interpolation(), position);
+	x = position[VEC_X];
+	y = position[VEC_Y];
+
 	//offset uvs to match the rotation
 	//if the sprite is rotated its texture coorinates move clockwise to match the rotation
 	for (int i = 0; i < 4; i++) {
 
 		uvs[(i + s->rotation) & 3][VEC_X] = uv_offset + (i > 1 ? framestep : 0.f);
-		uvs[(i + s->rotation) & 3][VEC_Y] = (!(i % 3) ? 1.f : 0.f);
+		uvs[(i + s->rotation) & 3][VEC_Y] = (!(i % 3) ? region->v1 : region->v0);
 	}
 
-	//draw using immediate mode
-	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, (GLuint)s->tex_id);
+	//four vertices of the quad
+	push_vertex(-sprite_size_x + x, -sprite_size_y + y, uvs[0][VEC_X], uvs[0][VEC_Y], s->color);
+	push_vertex(-sprite_size_x + x, sprite_size_y + y, uvs[1][VEC_X], uvs[1][VEC_Y], s->color);
+	push_vertex(sprite_size_x + x, sprite_size_y + y, uvs[2][VEC_X], uvs[2][VEC_Y], s->color);
+	push_vertex(sprite_size_x + x, -sprite_size_y + y, uvs[3][VEC_X], uvs[3][VEC_Y], s->color);
+}
 
-	glBegin(GL_QUADS);
+/*
+* Makes sure the layer sprite arrays can fit the given amount of sprites.
+*/
+void reserve_layer_sprites(int count) {
 
-	//set color
-	glColor3f(s->color[0], s->color[1], s->color[2]);
+	if (count <= layer_sprites_capacity) {
 
-	//send four vertices to the GPU
-	glTexCoord2f(uvs[0][VEC_X], uvs[0][VEC_Y]);
-	glVertex2f(-sprite_size_x + x, -sprite_size_y + y);
+		return;
+	}
 
-	glTexCoord2f(uvs[1][VEC_X], uvs[1][VEC_Y]);
-	glVertex2f(-sprite_size_x + x, sprite_size_y + y);
+	while (count > layer_sprites_capacity) {
 
-	glTexCoord2f(uvs[2][VEC_X], uvs[2][VEC_Y]);
-	glVertex2f(sprite_size_x + x, sprite_size_y + y);
+		layer_sprites_capacity = layer_sprites_capacity ? layer_sprites_capacity * 2 : 1024;
+	}
 
-	glTexCoord2f(uvs[3][VEC_X], uvs[3][VEC_Y]);
-	glVertex2f(sprite_size_x + x, -sprite_size_y + y);
+	free(layer_sprites);
+	free(sorted_sprites);
 
-	glEnd();
+	layer_sprites = malloc(sizeof(sprite_t *) * layer_sprites_capacity);
+	sorted_sprites = malloc(sizeof(sprite_t *) * layer_sprites_capacity);
 
-	print_gl_errors(__func__);
+	if (!layer_sprites || !sorted_sprites) {
+
+		out_of_memory_error(__func__);
+	}
 }
 
 /*
-* Draws all non-ui sprites as well as the particles.
+* Adds all drawable sprites from the given render layer to the frame. Sprites are
+* grouped by atlas page while keeping their order inside each group.
 */
-void draw_world_sprites(void) {
+void batch_layer_sprites(unsigned layer) {
 
-	sprite_t *first = sprite_head();
 	sprite_t *current;
+	unsigned int textures[MAX_BATCH_TEXTURES];
+	int offsets[MAX_BATCH_TEXTURES];
+	int texture_count = 0;
+	int count = 0;
+	int first, t, total;
 
-	//iterate over all but UI layers (bottom->top direction)
-	for (unsigned i = 0; i <= RENDER_LAYER_ONTOP; i++) {
+	//collect visible sprites
+	for (current = sprite_layer_head(layer); current; current = current->next) {
 
-		current = first;
+		if (!current->skip_render) {
 
-		//get all drawable sprites from this layer and draw them
-		while (current)
-		{
-			if (current->render_layer == i && !current->skip_render) {
+			count++;
+		}
+	}
+
+	if (!count) {
+
+		return;
+	}
+
+	reserve_layer_sprites(count);
+
+	count = 0;
+	for (current = sprite_layer_head(layer); current; current = current->next) {
+
+		if (current->skip_render) {
 
-				draw_sprite(current);
+			continue;
+		}
+
+		layer_sprites[count++] = current;
+
+		//count sprites of every texture
+		for (t = 0; t < texture_count; t++) {
+
+			if (textures[t] == get_texture_region(current->tex_id)->page) {
+
+				break;
 			}
-			current = current->next;
 		}
 
-		//particle layer?
-		if (i == RENDER_LAYER_FLOOR_PARTICLE || i == RENDER_LAYER_EFFECT) {
+		if (t == texture_count) {
 
-			draw_particles(i);
+			if (texture_count == MAX_BATCH_TEXTURES) {
+
+				//should never happen, just merge into the last group
+				t--;
+			}
+			else
+			{
+				textures[texture_count] = get_texture_region(current->tex_id)->page;
+				offsets[texture_count] = 0;
+				texture_count++;
+			}
 		}
+		offsets[t]++;
+	}
+
+	//turn texture sprite counts into group offsets
+	total = 0;
+	for (t = 0; t < texture_count; t++) {
+
+		int group_size = offsets[t];
+		offsets[t] = total;
+		total += group_size;
+	}
+
+	//sort sprites into groups (keeping the order)
+	for (int i = 0; i < count; i++) {
+
+		for (t = 0; t < texture_count - 1; t++) {
+
+			if (textures[t] == get_texture_region(layer_sprites[i]->tex_id)->page) {
+
+				break;
+			}
+		}
+		sorted_sprites[offsets[t]++] = layer_sprites[i];
+	}
+
+	//write the vertices and a batch for each group
+	reserve_vertices(count * 4);
+
+	for (int i = 0; i < count; i++) {
+
+		first = vertex_count;
+		batch_sprite(sorted_sprites[i]);
+		add_batch(GL_QUADS, get_texture_region(sorted_sprites[i]->tex_id)->page, layer, first, 4);
 	}
 }
 
 /*
-* Sets the camera to UI mode and draws the UI sprites on the screen.
-* Afterwards the camera is set back to world mode.
+* Issues draw calls for all batches collected during this frame.
 */
-void draw_ui_sprites(void) {
+void draw_batches(void) {
 
-	sprite_t *first = sprite_head();
-	sprite_t *current;
+	batch_t *b;
+	int is_ui = 0;
+	int is_textured = -1;
+	unsigned int bound_texture = 0;
+	int is_texture_bound = 0;
 
-	//set up the camera
-	set_camera_for_ui();
+	frame_draw_calls = 0;
+
+	if (!batch_count) {
+
+		return;
+	}
+
+	//point OpenGL to the frame buffer (pointers are set after the buffer stopped growing)
+	glVertexPointer(2, GL_FLOAT, sizeof(vertex_t), &vertices[0].x);
+	glTexCoordPointer(2, GL_FLOAT, sizeof(vertex_t), &vertices[0].u);
+	glColorPointer(3, GL_FLOAT, sizeof(vertex_t), &vertices[0].r);
+
+	//make sure the particle size is scaled when the screen is being scaled.
+	glPointSize(5.f * window_props.height / VIRTUAL_HEIGHT); //5.f is the particle size
 
-	for (unsigned i = RENDER_LAYER_UI_BG; i <= RENDER_LAYER_UI; i++) {
+	for (int i = 0; i < batch_count; i++) {
 
-		current = first;
+		b = &batches[i];
 
-		while (current)
+		//switch to the UI camera once the UI layers are reached
+		if (!is_ui && b->layer >= RENDER_LAYER_UI_BG) {
+
+			set_camera_for_ui();
+			is_ui = 1;
+		}
+
+		if (b->mode == GL_POINTS) {
+
+			//particles are not textured
+			if (is_textured != 0) {
+
+				glDisable(GL_TEXTURE_2D);
+				is_textured = 0;
+			}
+		}
+		else
 		{
-			if (current->render_layer == i && !current->skip_render) {
+			if (is_textured != 1) {
+
+				glEnable(GL_TEXTURE_2D);
+				is_textured = 1;
+			}
+
+			if (!is_texture_bound || bound_texture != b->tex_id) {
 
-				draw_sprite(current);
+				glBindTexture(GL_TEXTURE_2D, (GLuint)b->tex_id);
+				bound_texture = b->tex_id;
+				is_texture_bound = 1;
 			}
-			current = current->next;
 		}
+
+		glDrawArrays(b->mode, b->first, b->count);
+		frame_draw_calls++;
 	}
 
 	//reset the camera
-	unset_camera_for_ui();
+	if (is_ui) {
+
+		unset_camera_for_ui();
+	}
+
+	print_gl_errors(__func__);
 }
 
 /*
@@ -219,36 +456,42 @@ void display_frame(void) {
 
 	/*
 	Instead of using the depth buffer the application does all drawing from bottom to the
-	top. This is slower because the entire sprite list is iterated for each layer but it
-	also simplifies the entire drawing process: normally opaque geometry would be drawn
-	using the depth buffer and transparency is drawn from bottom to the top.
+	top. Sprites are kept in per-layer lists so every sprite is visited once per frame. This
+	simplifies the entire drawing process: normally opaque geometry would be drawn using the
+	depth buffer and transparency is drawn from bottom to the top.
 	*/
 
 	//clear the last frame data from color buffer
 	glClear(GL_COLOR_BUFFER_BIT);
-	
-	//draw everything but ui
-	draw_world_sprites();
 
-	//draw ui
-	draw_ui_sprites();
+	//upload the camera for this frame
+	load_camera_matrices();
 
-	glutSwapBuffers();
+	vertex_count = 0;
+	batch_count = 0;
 
-	print_gl_errors(__func__);
-}
+	//collect every layer (bottom->top direction)
+	for (unsigned i = 0; i < RENDER_LAYER_COUNT; i++) {
 
-/*
-* A callback to draw the frame on the screen using constant DISPLAY_FRAMERATE.
-*/
-void render_timer_callback(int value) {
+		batch_layer_sprites(i);
+
+		//particle layer?
+		if (i == RENDER_LAYER_FLOOR_PARTICLE || i == RENDER_LAYER_EFFECT) {
+
+			batch_particles(i);
+		}
+	}
+
+	//draw everything
+	draw_batches();
+
+	glutSwapBuffers();
 
-	glutPostRedisplay(); //force glut to execute display callback
-	glutTimerFunc((unsigned)(1000.f / DISPLAY_FRAMERATE), render_timer_callback, value); //set the next callback execution
+	print_gl_errors(__func__);
 }
 
 /*
-* Sets up the renderer (currently only blending mode).
+* Sets up the renderer (blending mode and vertex arrays).
 */
 void init_render(void) {
 
@@ -256,5 +499,10 @@ void init_render(void) {
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+	//all drawing is done using vertex arrays
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+
 	print_gl_errors(__func__);
-}
\ No newline at end of file
+}
@@ -3,8 +3,14 @@
 //the framerate that the display is refreshed at
 #define DISPLAY_FRAMERATE	60
 
-void render_timer_callback(int value);
+//real time of a frame spent on simulating a fast replay (the rest is left for drawing)
+#define FAST_REPLAY_FRAME_MSEC	(1000.0 / DISPLAY_FRAMERATE * 0.75)
+
+//the maximum amount of different textures grouped on a single layer
+#define MAX_BATCH_TEXTURES	64
+
 void display_frame(void);
 void init_render(void);
+int get_frame_draw_calls(void);
 
-void print_gl_errors(const char *caller_name);
\ No newline at end of file
+void print_gl_errors(const char *caller_name);
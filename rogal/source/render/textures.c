@@ -17,15 +17,40 @@
 * Each texture can be a set of frames or sub-images. In that case the UV
 * coordinates are recalculated so the rendered sprite shows only the correct
 * part of the texture (described in detail in renderer.c)
+* 
+* All images are packed into atlas pages (usually a single one) when they are
+* loaded, so that sprites using different images can be drawn without changing
+* the bound texture. Images are placed on horizontal shelves, tallest first, and
+* each image keeps its frames side by side. The texture id given to sprites is
+* an index of the image's atlas region (0 means no texture) and the renderer
+* maps sprite UVs into that region.
+*
+* The headless build (HEADLESS) doesn't load any images, it only uses the
+* texture properties (frame counts, frametimes and render layers).
 */
 
-#include "renderer.h"
 #include "textures.h"
+#include <string.h>
+
+#ifndef HEADLESS
+#include "renderer.h"
 #include "stb_image.h"
 #include <GL/glut.h>
+#endif // !HEADLESS
 
-//opengl indices for each loaded texture
-static GLuint textures[MAX_TEXTURES];
+//atlas regions for each loaded texture
+static texregion_t regions[MAX_TEXTURES];
+
+//region used by sprites without a texture
+static const texregion_t no_texture = { 0, 0.f, 0.f, 1.f, 1.f };
+
+//a loaded image waiting to be packed
+typedef struct {
+	unsigned char	*data;	//RGBA pixels
+	int				w, h;
+	int				page;	//atlas page index
+	int				x, y;	//position on the page (including padding)
+} atlas_image_t;
 
 //texture entries: all textures used by the game are listed here
 static const texentry_t texture_names[] = {
@@ -89,11 +114,25 @@ int tex_index_for_name(texname name) {
 }
 
 /*
-* Returns opengl texture index for the given texture type.
+* Returns texture id for the given texture type. The id is used to find the texture's
+* atlas region when the sprite is drawn.
 */
 unsigned int get_texture_id(texname name) {
 
-	return textures[tex_index_for_name(name)];
+	return tex_index_for_name(name) + 1; //0 means no texture
+}
+
+/*
+* Returns the atlas region for the given texture id.
+*/
+const texregion_t *get_texture_region(unsigned int tex_id) {
+
+	if (tex_id == 0 || tex_id > CountOf(texture_names)) {
+
+		return &no_texture;
+	}
+
+	return &regions[tex_id - 1];
 }
 
 /*
@@ -120,44 +159,149 @@ int get_texture_render_layer(texname name) {
 	return texture_names[tex_index_for_name(name)].render_layer;
 }
 
+#ifndef HEADLESS
 /*
-* Loads a png texture and returns the opengl index for that texture.
+* Loads a png image as RGBA pixels. Returns 0 if the image failed to load.
 */
-GLuint load_image(char *filename) {
+int load_image(char *filename, atlas_image_t *image) {
 
-	GLuint tex_id;
-	GLint format;
-	int w, h;
 	int components = 0;
 
-	//try to pull texture data from stb library
-	unsigned char *data = stbi_load(filename, &w, &h, &components, 0);
+	//try to pull texture data from stb library (always converted to RGBA)
+	image->data = stbi_load(filename, &image->w, &image->h, &components, 4);
 
 	//if the file failed to load then components = 0 - there is no need for explicit load success check
-	if(components != 4 && components != 3) { //4 = RGBA, 3 = RGB
+	if (!image->data || (components != 4 && components != 3)) { //4 = RGBA, 3 = RGB
 
 		d_printf(LOG_ERROR, "%s: failed to load texture: %s, reason: %s\n", __func__, filename, stbi_failure_reason());
+
+		if (image->data) {
+
+			stbi_image_free(image->data);
+			image->data = NULL;
+		}
 		return 0;
 	}
 
+	return 1;
+}
+
+/*
+* Places all images on atlas pages. Returns the amount of pages.
+*/
+int pack_images(atlas_image_t *images, int count, int *page_heights) {
+
+	int order[MAX_TEXTURES];
+	int i, j, tmp, w, h;
+	int page = 0;
+	int x = 0, y = 0;
+	int shelf_height = 0;
+
+	//sort images by height (tallest first)
+	for (i = 0; i < count; i++) {
+
+		order[i] = i;
+	}
+	for (i = 1; i < count; i++) {
+
+		for (j = i; j > 0 && images[order[j]].h > images[order[j - 1]].h; j--) {
+
+			tmp = order[j];
+			order[j] = order[j - 1];
+			order[j - 1] = tmp;
+		}
+	}
+
+	page_heights[0] = 0;
+
+	//put the images on shelves
+	for (i = 0; i < count; i++) {
+
+		atlas_image_t *image = &images[order[i]];
+
+		if (!image->data) {
+
+			continue;
+		}
+
+		w = image->w + ATLAS_PADDING * 2;
+		h = image->h + ATLAS_PADDING * 2;
+
+		if (w > ATLAS_PAGE_WIDTH || h > ATLAS_PAGE_MAX_HEIGHT) {
+
+			d_printf(LOG_ERROR, "%s: image too big for the atlas: %dx%d\n", __func__, image->w, image->h);
+			stbi_image_free(image->data);
+			image->data = NULL;
+			continue;
+		}
+
+		//start a new shelf
+		if (x + w > ATLAS_PAGE_WIDTH) {
+
+			x = 0;
+			y += shelf_height;
+			shelf_height = 0;
+		}
+
+		//start a new page
+		if (y + h > ATLAS_PAGE_MAX_HEIGHT) {
+
+			page++;
+			page_heights[page] = 0;
+			x = y = shelf_height = 0;
+		}
+
+		image->page = page;
+		image->x = x;
+		image->y = y;
+
+		x += w;
+		shelf_height = max(shelf_height, h);
+		page_heights[page] = max(page_heights[page], y + shelf_height);
+	}
+
+	return page + 1;
+}
+
+/*
+* Copies an image onto the page pixels and repeats its edge pixels in the padding.
+*/
+void blit_image(unsigned char *pixels, atlas_image_t *image) {
+
+	int src_x, src_y;
+
+	for (int y = 0; y < image->h + ATLAS_PADDING * 2; y++) {
+		for (int x = 0; x < image->w + ATLAS_PADDING * 2; x++) {
+
+			//padding takes the closest edge pixel
+			src_x = r_clamp(x - ATLAS_PADDING, 0, image->w - 1);
+			src_y = r_clamp(y - ATLAS_PADDING, 0, image->h - 1);
+
+			memcpy(&pixels[((image->y + y) * ATLAS_PAGE_WIDTH + image->x + x) * 4],
+				&image->data[(src_y * image->w + src_x) * 4], 4);
+		}
+	}
+}
+
+/*
+* Uploads atlas page pixels to the GPU and returns the opengl index for that page.
+*/
+GLuint upload_atlas_page(unsigned char *pixels, int height) {
+
+	GLuint tex_id;
+
 	//generate opengl texture
 	glGenTextures(1, &tex_id);
 	glBindTexture(GL_TEXTURE_2D, tex_id);
 
-	//decide if this is a transparent texture
-	format = components == 3 ? GL_RGB : GL_RGBA;
-
 	//set texture parameters
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST); //don't interpolate colors when sampling the texture
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, format, GL_UNSIGNED_BYTE, data);
-	
-	//the image was uploaded to the GPU, free it from the program's memory
-	stbi_image_free(data);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ATLAS_PAGE_WIDTH, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 
-	d_printf(LOG_TEXT, "%s: texture %s with id: %d\n", __func__, filename, tex_id);
+	d_printf(LOG_TEXT, "%s: atlas page %dx%d with id: %d\n", __func__, ATLAS_PAGE_WIDTH, height, tex_id);
 
 	print_gl_errors(__func__);
 
@@ -165,11 +309,15 @@ GLuint load_image(char *filename) {
 }
 
 /*
-* Loads all textures using definitions from texture_names
+* Loads all textures using definitions from texture_names and packs them into atlas pages.
 */
 void load_textures(void) {
 
-	int i;
+	atlas_image_t images[MAX_TEXTURES];
+	int page_heights[MAX_TEXTURES];
+	unsigned char *pixels;
+	GLuint page_id;
+	int i, page, page_count, height;
 	int texcount = CountOf(texture_names);
 
 	if (texcount > MAX_TEXTURES) {
@@ -178,9 +326,71 @@ void load_textures(void) {
 		return;
 	}
 
-	//load all texture images and assign texture ids
+	memset(images, 0, sizeof(images));
+
+	//load all texture images
 	for (i = 0; i < texcount; i++) {
-		
-		textures[i] = load_image(texture_names[i].name);
+
+		regions[i] = no_texture;
+		load_image(texture_names[i].name, &images[i]);
 	}
-}
\ No newline at end of file
+
+	page_count = pack_images(images, texcount, page_heights);
+
+	//build and upload the pages
+	for (page = 0; page < page_count; page++) {
+
+		//page height is the next power of two
+		height = 1;
+		while (height < page_heights[page]) {
+
+			height *= 2;
+		}
+
+		pixels = calloc((size_t)ATLAS_PAGE_WIDTH * height, 4);
+
+		if (!pixels) {
+
+			out_of_memory_error(__func__);
+			return;
+		}
+
+		for (i = 0; i < texcount; i++) {
+
+			if (images[i].data && images[i].page == page) {
+
+				blit_image(pixels, &images[i]);
+			}
+		}
+
+		page_id = upload_atlas_page(pixels, height);
+
+		//the pixels were uploaded to the GPU, free them from the program's memory
+		free(pixels);
+
+		//set regions of this page's textures
+		for (i = 0; i < texcount; i++) {
+
+			if (images[i].data && images[i].page == page) {
+
+				regions[i].page = page_id;
+				regions[i].u0 = (float)(images[i].x + ATLAS_PADDING) / ATLAS_PAGE_WIDTH;
+				regions[i].v0 = (float)(images[i].y + ATLAS_PADDING) / height;
+				regions[i].u1 = (float)(images[i].x + ATLAS_PADDING + images[i].w) / ATLAS_PAGE_WIDTH;
+				regions[i].v1 = (float)(images[i].y + ATLAS_PADDING + images[i].h) / height;
+
+				d_printf(LOG_TEXT, "%s: texture %s at [%d, %d] on page %d\n", __func__, texture_names[i].name, images[i].x, images[i].y, page);
+			}
+		}
+	}
+
+	//free the images
+	for (i = 0; i < texcount; i++) {
+
+		if (images[i].data) {
+
+			stbi_image_free(images[i].data);
+		}
+	}
+}
+#endif // !HEADLESS
@@ -7,6 +7,13 @@
 //maximum texture count
 #define MAX_TEXTURES 32
 
+//atlas page dimensions (power of two)
+#define ATLAS_PAGE_WIDTH		2048
+#define ATLAS_PAGE_MAX_HEIGHT	2048
+
+//empty space around each texture on the atlas (filled with the texture's edge pixels)
+#define ATLAS_PADDING			1
+
 //default texture properties
 #define DEFAULT_ANIM_MSEC 100
 #define PLAYER_MOVE_ANIM_MSEC 100
@@ -19,5 +26,15 @@ typedef struct {
 	int		render_layer;	//default render layer
 } texentry_t;
 
+//the part of an atlas page used by a texture
+typedef struct {
+	unsigned int	page;		//opengl texture id of the atlas page
+	float			u0, v0;		//top left corner UV
+	float			u1, v1;		//bottom right corner UV
+} texregion_t;
+
 //for initialization
-void load_textures(void);
\ No newline at end of file
+void load_textures(void);
+
+//for the renderer: atlas region of a texture id returned by get_texture_id()
+const texregion_t *get_texture_region(unsigned int tex_id);
\ No newline at end of file
@@ -1,10 +1,17 @@
 /*
 * This file manages the window creation process and handles
 * window resizing.
+*
+* The headless build (HEADLESS) doesn't create a window, only the window
+* properties are set so the projection math works the same way.
 */
 
 #include "window.h"
+#include <string.h>
+
+#ifndef HEADLESS
 #include <GL/glut.h>
+#endif // !HEADLESS
 
 window_t window_props;
 
@@ -15,17 +22,17 @@ window_t window_props;
 */
 void set_projection_from_props(void) {
 
+#ifndef HEADLESS
 	glViewport(0, 0, window_props.width, window_props.height);
-
-	glMatrixMode(GL_PROJECTION);
-
-	glLoadIdentity();
-
-	//orthographic projection
-	glOrtho(-window_props.ratio, window_props.ratio, -1.f, 1.f, -1.f, 1.f);
-	glScalef(window_props.scale, window_props.scale, 1.f);
-
-	glMatrixMode(GL_MODELVIEW);
+#endif // !HEADLESS
+
+	//orthographic projection (same as glOrtho(-ratio, ratio, -1, 1, -1, 1) scaled by the world scale)
+	//it is uploaded with the modelview matrix before each frame (see load_camera_matrices)
+	memset(window_props.projection, 0, sizeof(mat4_t));
+	window_props.projection[0] = window_props.scale / window_props.ratio;
+	window_props.projection[5] = window_props.scale;
+	window_props.projection[10] = -1.0;
+	window_props.projection[15] = 1.0;
 }
 
 /*
@@ -52,7 +59,9 @@ void glut_change_size(int w, int h) {
 */
 void destroy_window(void) {
 
+#ifndef HEADLESS
 	glutDestroyWindow(glutGetWindow());
+#endif // !HEADLESS
 }
 
 /*
@@ -62,9 +71,11 @@ void make_fullscreen(void) {
 
 	window_props.w_width = window_props.width;
 	window_props.w_height = window_props.height;
+#ifndef HEADLESS
 	window_props.w_pos_x = glutGet(GLUT_INIT_WINDOW_X);
 	window_props.w_pos_y = glutGet(GLUT_INIT_WINDOW_Y);
 	glutFullScreen();
+#endif // !HEADLESS
 }
 
 /*
@@ -72,8 +83,10 @@ void make_fullscreen(void) {
 */
 void restore_windowed(void) {
 
+#ifndef HEADLESS
 	glutPositionWindow(window_props.w_pos_x, window_props.w_pos_y);
 	glutReshapeWindow(window_props.w_width, window_props.w_height);
+#endif // !HEADLESS
 }
 
 /*
@@ -91,12 +104,20 @@ void create_window(int argc, char **argv) {
 	window_props.ratio = VIRTUAL_WIDTH / VIRTUAL_HEIGHT;
 	window_props.scale = 0.2f;
 
+#ifdef HEADLESS
+	UNUSED_VARIABLE(argc);
+	UNUSED_VARIABLE(argv);
+#else
 	//send commands to glut
 	glutInit(&argc, argv);
 	glutInitWindowPosition(500, 250);
 	glutInitWindowSize(window_props.width, window_props.height);
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
 	glutCreateWindow(name);
+#endif // HEADLESS
+
+	//initial projection (updated when glut reports the window size)
+	set_projection_from_props();
 
 	d_printf(LOG_INFO, "%s: Created window size: %dx%d\n", __func__, window_props.width, window_props.height);
 }
\ No newline at end of file
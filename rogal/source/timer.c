@@ -0,0 +1,90 @@
+/*
+* This file contains the platform specific high resolution clock used to
+* measure code that runs without GLUT (the map generator, benchmarks).
+*
+* It also contains a simple profiler that sums up the time spent in the main
+* game systems (PROFILE_...). It's disabled by default, so the measured code
+* only pays for a flag check.
+*/
+
+#include "shared.h"
+
+//profiler
+static int is_profiling;
+static double profile_msec[PROFILE_COUNT];
+
+#ifdef WIN32
+
+/*
+* Returns milliseconds from an arbitrary starting point.
+*/
+double get_time_msec(void) {
+
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	if (!frequency.QuadPart) {
+
+		QueryPerformanceFrequency(&frequency);
+	}
+
+	QueryPerformanceCounter(&counter);
+
+	return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
+}
+
+#else
+
+/*
+* Returns milliseconds from an arbitrary starting point.
+*/
+double get_time_msec(void) {
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+#endif // WIN32
+
+/*
+* Enables or disables the profiler. Enabling it clears the measured times.
+*/
+void enable_profiling(int enabled) {
+
+	is_profiling = enabled;
+
+	for (int i = 0; i < PROFILE_COUNT; i++) {
+
+		profile_msec[i] = 0.0;
+	}
+}
+
+/*
+* Returns the start time of a measured section (0 if the profiler is disabled).
+*/
+double profile_start(void) {
+
+	return is_profiling ? get_time_msec() : 0.0;
+}
+
+/*
+* Adds the time since start to the given PROFILE_... section.
+*/
+void profile_end(int section, double start) {
+
+	if (is_profiling) {
+
+		profile_msec[section] += get_time_msec() - start;
+	}
+}
+
+/*
+* Returns the time spent in the given PROFILE_... section.
+*/
+double get_profile_msec(int section) {
+
+	return profile_msec[section];
+}
@@ -7,16 +7,19 @@
 #include "options.h"
 #include "window.h"
 #include "particles.h"
+#include "game.h"
 
 void set_fullscreen(int value);
 void set_particles(int value);
+void set_instant_turns(int value);
 
 //options list
 static option_t options[] = {
 
 	//name			action			initial value	text_t
 	{ "fullscreen", set_fullscreen, 0,				NULL },
-	{ "particles",	set_particles,	1,				NULL }
+	{ "particles",	set_particles,	1,				NULL },
+	{ "instant turns", set_instant_turns, 0,		NULL }
 };
 
 //----------
@@ -31,6 +34,14 @@ void set_particles(int value) {
 	are_particles_enabled = value; //this variable toggles generation of new particles
 }
 
+/*
+* Action for instant turns toggle.
+*/
+void set_instant_turns(int value) {
+
+	is_instant_turns = value; //turns don't wait for the animations
+}
+
 /*
 * Action for fullscreen toggle.
 */
@@ -5,7 +5,6 @@
 #include "camera.h"
 #include "player.h"
 #include <string.h>
-#include <GL/glut.h>
 
 static text_t *main_menu[3];
 
@@ -15,7 +14,7 @@ static sprite_t *hud_sprites[3];
 static sprite_t *menu_background;
 
 static text_t *message_text;
-static int message_call_time;
+static int message_id; //changes with every message
 
 void toggle_hud(int enabled) {
 
@@ -79,7 +78,7 @@ void disable_message_text(void) {
 
 void disable_message_callback(int value) {
 
-	if (value != message_call_time) {
+	if (value != message_id) {
 
 		//message overwritten by a new message, don't disable using this callback
 		return;
@@ -95,11 +94,11 @@ void display_message(char *message, int msec, color3_t color) {
 	set_text(message_text, message);
 	enable_text(message_text);
 
-	message_call_time = glutGet(GLUT_ELAPSED_TIME);
+	message_id++;
 
 	if (msec > 0) {
 
-		glutTimerFunc(msec, disable_message_callback, message_call_time);
+		schedule_task(disable_message_callback, msec, message_id);
 	}
 }
 
@@ -186,7 +185,7 @@ void generate_menu_background(void) {
 	menu_background->scale_x = 100.f;
 	menu_background->scale_y = 100.f;
 
-	menu_background->render_layer = RENDER_LAYER_UI_BG;
+	set_sprite_render_layer(menu_background, RENDER_LAYER_UI_BG);
 	menu_background->collision_mask = COLLISION_UI;
 }
 
@@ -252,7 +251,7 @@ void refresh_hud(int value) {
 		}
 	}
 
-	glutTimerFunc(TICK_MSEC, refresh_hud, 0);
+	schedule_task(refresh_hud, TICK_MSEC, 0);
 }
 
 void generate_hud(void) {
@@ -288,7 +287,7 @@ void generate_hud(void) {
 
 		s = new_sprite();
 		s->tex_id = get_texture_id(tnames[i]);
-		s->render_layer = RENDER_LAYER_UI;
+		set_sprite_render_layer(s, RENDER_LAYER_UI);
 		s->collision_mask = COLLISION_IGNORE;
 		s->framecount = get_texture_framecount(tnames[i]);
 		s->skip_render = 1;
@@ -325,5 +324,5 @@ void generate_ui(void) {
 	toggle_options(0);
 
 	//set HUD refresh callback
-	glutTimerFunc(TICK_MSEC, refresh_hud, 0);
+	schedule_task(refresh_hud, TICK_MSEC, 0);
 }
\ No newline at end of file
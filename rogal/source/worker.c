@@ -0,0 +1,147 @@
+/*
+* This file contains the platform specific background threads.
+*
+* A worker runs a single job on its own thread. The job must not touch the game
+* state (sprites, GL, GLUT): the result is picked up by the main thread after
+* is_worker_done() or wait_worker().
+*/
+
+#include "shared.h"
+
+#ifdef WIN32
+
+/*
+* Thread entry point: runs the job of the worker.
+*/
+DWORD WINAPI worker_thread(LPVOID param) {
+
+	worker_t *w = param;
+
+	w->job(w->arg);
+	return 0;
+}
+
+/*
+* Starts the job on a new thread.
+*/
+int start_worker(worker_t *w, void (*job)(void *arg), void *arg) {
+
+	w->job = job;
+	w->arg = arg;
+	w->is_done = 0;
+
+	w->thread = CreateThread(NULL, 0, worker_thread, w, 0, NULL);
+	w->is_running = w->thread != NULL;
+
+	if (!w->is_running) {
+
+		d_printf(LOG_ERROR, "%s: failed to create a thread\n", __func__);
+	}
+	return w->is_running;
+}
+
+/*
+* Checks if the job has finished (without waiting).
+*/
+int is_worker_done(worker_t *w) {
+
+	if (w->is_running && !w->is_done) {
+
+		w->is_done = WaitForSingleObject(w->thread, 0) == WAIT_OBJECT_0;
+	}
+	return w->is_done;
+}
+
+/*
+* Waits for the job to finish and releases the thread.
+*/
+void wait_worker(worker_t *w) {
+
+	if (!w->is_running) {
+
+		return;
+	}
+
+	WaitForSingleObject(w->thread, INFINITE);
+	CloseHandle(w->thread);
+
+	w->is_running = 0;
+	w->is_done = 1;
+}
+
+#else
+
+/*
+* Thread entry point: runs the job of the worker and marks it as done.
+*/
+void *worker_thread(void *param) {
+
+	worker_t *w = param;
+
+	w->job(w->arg);
+
+	pthread_mutex_lock(&w->lock);
+	w->is_done = 1;
+	pthread_mutex_unlock(&w->lock);
+
+	return NULL;
+}
+
+/*
+* Starts the job on a new thread.
+*/
+int start_worker(worker_t *w, void (*job)(void *arg), void *arg) {
+
+	w->job = job;
+	w->arg = arg;
+	w->is_done = 0;
+
+	pthread_mutex_init(&w->lock, NULL);
+
+	w->is_running = pthread_create(&w->thread, NULL, worker_thread, w) == 0;
+
+	if (!w->is_running) {
+
+		d_printf(LOG_ERROR, "%s: failed to create a thread\n", __func__);
+		pthread_mutex_destroy(&w->lock);
+	}
+	return w->is_running;
+}
+
+/*
+* Checks if the job has finished (without waiting).
+*/
+int is_worker_done(worker_t *w) {
+
+	int is_done;
+
+	if (!w->is_running) {
+
+		return w->is_done;
+	}
+
+	pthread_mutex_lock(&w->lock);
+	is_done = w->is_done;
+	pthread_mutex_unlock(&w->lock);
+
+	return is_done;
+}
+
+/*
+* Waits for the job to finish and releases the thread.
+*/
+void wait_worker(worker_t *w) {
+
+	if (!w->is_running) {
+
+		return;
+	}
+
+	pthread_join(w->thread, NULL);
+	pthread_mutex_destroy(&w->lock);
+
+	w->is_running = 0;
+	w->is_done = 1;
+}
+
+#endif // WIN32
@@ -0,0 +1,310 @@
+/*
+* This file is the headless game runner (make headless).
+*
+* It links the game logic without GLUT/GL (the renderer isn't built, the window
+* and texture loader are stubbed with HEADLESS) and runs the game as fast as
+* possible in one of three modes:
+*	- random player actions through the simulation interface (see simulation.c),
+*	  a soak test of the turn logic: a run that gets stuck (the game never waits
+*	  for input again) is reported and can be reproduced with its seed
+*	- a replay of a session recorded by the game (rogal -record <file>), for
+*	  measuring the logic under a realistic input stream (see replay.c)
+*	- the autoplay bot (see bot.c) clearing levels, a turn throughput benchmark:
+*	  reports turns and levels per second and the time spent in the profiled
+*	  game systems (see profile_start)
+*
+* The random actions and the bot can play with instant turns (-i, see
+* is_instant_turns), then a turn isn't limited by the animations.
+*
+* Usage: headless [-n actions|levels] [-l level] [-s seed] [-r replay file] [-b] [-i]
+* Exits with 2 if the simulation got stuck or the bot can't clear a level.
+*/
+
+#include "game.h"
+#include "window.h"
+#include "camera.h"
+#include "particles.h"
+#include "ui.h"
+#include "headless.h"
+#include <string.h>
+
+//the most ticks a single action may take before the simulation counts as stuck
+#define MAX_ACTION_TICKS	10000
+
+//the most runs in a row the bot may die in without completing a level
+#define MAX_BOT_FAILED_RUNS	1000
+
+//runner settings
+static int action_count = 10000;
+static int level = 1;
+static unsigned int seed = 1;
+static char *replay_name;
+static int is_bot;
+
+/*
+* Reads the command line settings, returns 0 on invalid arguments.
+*/
+int parse_arguments(int argc, char **argv) {
+
+	for (int i = 1; i < argc; i++) {
+
+		if (!strcmp(argv[i], "-b")) {
+
+			is_bot = 1;
+			continue;
+		}
+
+		if (!strcmp(argv[i], "-i")) {
+
+			is_instant_turns = 1;
+			continue;
+		}
+
+		if (i + 1 >= argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+
+			return 0;
+		}
+
+		switch (argv[i][1])
+		{
+			case 'n':
+				action_count = atoi(argv[++i]);
+				break;
+			case 'l':
+				level = atoi(argv[++i]);
+				break;
+			case 's':
+				seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+				break;
+			case 'r':
+				replay_name = argv[++i];
+				break;
+			default:
+				return 0;
+		}
+	}
+
+	return action_count > 0 && level > 0;
+}
+
+/*
+* Runs the ticks of the turn started by the last action. Returns the amount of ticks, MAX_ACTION_TICKS if stuck.
+*/
+int play_turn(void) {
+
+	int ticks = run_simulation_until_idle(MAX_ACTION_TICKS);
+
+	//instant turns end right away, but the input arrives between ticks (and the scheduled tasks need to run)
+	if (!ticks) {
+
+		run_simulation_tick();
+		ticks = 1;
+	}
+
+	return ticks;
+}
+
+/*
+* Plays a recorded session as fast as possible.
+*/
+int play_replay(void) {
+
+	int ticks = 0, idle_ticks = 0;
+	double start, msec;
+
+	if (!start_replay(replay_name, 1)) {
+
+		printf("can't replay %s\n", replay_name);
+		return EXIT_FAILURE;
+	}
+
+	start = get_time_msec();
+
+	//play all events and the turn started by the last one
+	while (is_replaying() || !is_simulation_idle()) {
+
+		run_simulation_tick();
+		ticks++;
+
+		if (!is_replaying() && ++idle_ticks == MAX_ACTION_TICKS) {
+
+			printf("simulation stuck after the replay ended\n");
+			return 2;
+		}
+	}
+
+	msec = get_time_msec() - start;
+
+	printf("replay %s: %d events, %d turns, level %d\n", replay_name, get_replayed_event_count(), get_turn_count(), get_current_level());
+	printf("  simulated:     %.1f sec (%d ticks)\n", ticks * TICK_MSEC / 1000.0, ticks);
+	printf("  real:          %.1f msec (%.0f turns/sec, %.0fx real time)\n", msec,
+		msec > 0 ? get_turn_count() * 1000.0 / msec : 0.0, msec > 0 ? ticks * TICK_MSEC / msec : 0.0);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+* Plays seeded random player actions as fast as possible.
+*/
+int play_random_actions(void) {
+
+	rng_t rng;
+	unsigned int run_seed = seed;
+	int turns = 0, runs = 1, levels = 0, ticks = 0;
+	int last_level, action_ticks;
+	double start, msec;
+
+	srand(seed);
+	rng_seed(&rng, seed, 0);
+	start = get_time_msec();
+
+	start_simulation(run_seed, level);
+	last_level = level;
+
+	for (int i = 0; i < action_count; i++) {
+
+		//the player died, start a new run
+		if (is_player_dead) {
+
+			run_seed = rng_hash(seed, (unsigned int)runs++);
+			start_simulation(run_seed, level);
+			last_level = level;
+		}
+
+		//random direction and button
+		if (apply_player_action(rng_range(&rng, ACTION_HERE, ROTATION_270), RngBool(&rng) ? GLUT_LEFT_BUTTON : GLUT_RIGHT_BUTTON)) {
+
+			turns++;
+		}
+
+		//play the whole turn
+		action_ticks = play_turn();
+		ticks += action_ticks;
+
+		if (action_ticks == MAX_ACTION_TICKS) {
+
+			printf("simulation stuck: run seed %u, level %d, action %d\n", run_seed, get_current_level(), i);
+			return 2;
+		}
+
+		if (get_current_level() != last_level) {
+
+			levels++;
+			last_level = get_current_level();
+		}
+	}
+
+	msec = get_time_msec() - start;
+
+	printf("%d actions, %d turns, %d runs, %d levels completed\n", action_count, turns, runs, levels);
+	printf("  simulated:     %.1f sec (%d ticks)\n", ticks * TICK_MSEC / 1000.0, ticks);
+	printf("  real:          %.1f msec (%.0f turns/sec, %.0fx real time)\n", msec,
+		msec > 0 ? turns * 1000.0 / msec : 0.0, msec > 0 ? ticks * TICK_MSEC / msec : 0.0);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+* Lets the bot play the given amount of levels as fast as possible and reports the profile.
+*/
+int play_bot(void) {
+
+	const char *section_names[PROFILE_COUNT] = { "visibility", "ai", "generation", "particles" };
+	unsigned int run_seed = seed;
+	int runs = 1, levels = 0, skipped = 0, deaths = 0, failed_runs = 0, ticks = 0;
+	int last_level, deepest_level, action_ticks;
+	double start, msec;
+
+	srand(seed);
+	enable_profiling(1);
+	start = get_time_msec();
+
+	start_simulation(run_seed, level);
+	last_level = deepest_level = level;
+
+	while (levels < action_count) {
+
+		//the player died, start a new run
+		if (is_player_dead) {
+
+			deaths++;
+
+			//the starting level is too hard for the bot, it would never get through the levels
+			if (++failed_runs >= MAX_BOT_FAILED_RUNS) {
+
+				printf("bot can't clear level %d: %d runs in a row died without completing a level\n", level, failed_runs);
+				return 2;
+			}
+
+			run_seed = rng_hash(seed, (unsigned int)runs++);
+			start_simulation(run_seed, level);
+			last_level = level;
+		}
+
+		//the bot is stuck on the level, skip it
+		if (!bot_play_turn()) {
+
+			skipped++;
+			next_level_action(NULL);
+		}
+
+		//play the whole turn
+		action_ticks = play_turn();
+		ticks += action_ticks;
+
+		if (action_ticks == MAX_ACTION_TICKS) {
+
+			printf("simulation stuck: run seed %u, level %d, turn %d\n", run_seed, get_current_level(), get_turn_count());
+			return 2;
+		}
+
+		if (get_current_level() != last_level) {
+
+			levels++;
+			failed_runs = 0;
+			last_level = get_current_level();
+
+			if (last_level > deepest_level) {
+
+				deepest_level = last_level;
+			}
+		}
+	}
+
+	msec = get_time_msec() - start;
+
+	printf("bot: %d levels (%d skipped), %d deaths, %d turns, deepest level %d\n", levels, skipped, deaths, get_turn_count(), deepest_level);
+	printf("  simulated:     %.1f sec (%d ticks)\n", ticks * TICK_MSEC / 1000.0, ticks);
+	printf("  real:          %.1f msec (%.0f turns/sec, %.1f levels/sec)\n", msec,
+		msec > 0 ? get_turn_count() * 1000.0 / msec : 0.0, msec > 0 ? levels * 1000.0 / msec : 0.0);
+
+	for (int i = 0; i < PROFILE_COUNT; i++) {
+
+		printf("  %-14s %.1f msec (%.1f%%)\n", section_names[i], get_profile_msec(i), msec > 0 ? get_profile_msec(i) * 100.0 / msec : 0.0);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+
+	if (!parse_arguments(argc, argv)) {
+
+		printf("usage: %s [-n actions|levels] [-l level] [-s seed] [-r replay file] [-b] [-i]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	//same initialization as the windowed game (in the same order), without the renderer
+	create_window(argc, argv);
+	schedule_task(logic_frame, TICK_MSEC, 0);
+	init_camera();
+	init_particles();
+	generate_ui();
+
+	if (replay_name) {
+
+		return play_replay();
+	}
+
+	return is_bot ? play_bot() : play_random_actions();
+}
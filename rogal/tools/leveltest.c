@@ -0,0 +1,191 @@
+/*
+* This file is the level generation check (make leveltest).
+*
+* A level has to be the same no matter how it's reached. For every level from 2
+* up it starts a run on the level before and takes the exit (next_level_action),
+* then starts a run directly on the level with the same seed, and compares the
+* map size, the tiles, the map contents and the mob count of both. The exit is
+* taken once the map behind it is created in the background, so the pregenerated
+* map is compared with the map generated on demand.
+*
+* Usage: leveltest [-n levels] [-s seed]
+* Exits with 1 if any level differs.
+*/
+
+#include "game.h"
+#include "window.h"
+#include "camera.h"
+#include "particles.h"
+#include "ui.h"
+#include "headless.h"
+#include <string.h>
+
+//test settings
+static int level_count = 40;
+static unsigned int seed = 1;
+
+//the level reached through the exit
+static int *exit_tiles, *exit_contents;
+static int exit_capacity;
+
+/*
+* Reads the command line settings, returns 0 on invalid arguments.
+*/
+int parse_arguments(int argc, char **argv) {
+
+	for (int i = 1; i < argc; i++) {
+
+		if (i + 1 >= argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+
+			return 0;
+		}
+
+		switch (argv[i][1])
+		{
+			case 'n':
+				level_count = atoi(argv[++i]);
+				break;
+			case 's':
+				seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+				break;
+			default:
+				return 0;
+		}
+	}
+
+	return level_count > 1;
+}
+
+/*
+* Copies the tiles and contents of the current map. Returns 0 if out of memory.
+*/
+int store_exit_level(void) {
+
+	int count = map_size * map_size;
+
+	if (count > exit_capacity) {
+
+		free(exit_tiles);
+		free(exit_contents);
+
+		exit_tiles = malloc(sizeof(int) * count);
+		exit_contents = malloc(sizeof(int) * count);
+		exit_capacity = count;
+
+		if (!exit_tiles || !exit_contents) {
+
+			out_of_memory_error(__func__);
+			exit_capacity = 0;
+			return 0;
+		}
+	}
+
+	for (int x = 0; x < map_size; x++) {
+
+		for (int y = 0; y < map_size; y++) {
+
+			exit_tiles[MapIndex(x, y)] = get_map_tile(x, y);
+		}
+	}
+	memcpy(exit_contents, map_contents, sizeof(int) * count);
+	return 1;
+}
+
+/*
+* Returns 1 if the current map has the stored tiles.
+*/
+int is_same_tiles(void) {
+
+	for (int x = 0; x < map_size; x++) {
+
+		for (int y = 0; y < map_size; y++) {
+
+			if (exit_tiles[MapIndex(x, y)] != get_map_tile(x, y)) {
+
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/*
+* Compares the level reached through the exit with the level started directly.
+* Returns 0 if they differ.
+*/
+int compare_level(int level) {
+
+	int exit_size, exit_mobs;
+
+	//through the exit of the level before
+	start_simulation(seed, level - 1);
+	wait_pregenerated_map(level, get_level_seed(level));
+	next_level_action(NULL);
+	exit_size = map_size;
+	exit_mobs = alive_mobs_count();
+
+	if (!store_exit_level()) {
+
+		return 0;
+	}
+
+	//directly
+	start_simulation(seed, level);
+
+	if (exit_size != map_size) {
+
+		printf("level %d: map size %d through the exit, %d when started directly\n", level, exit_size, map_size);
+		return 0;
+	}
+
+	if (!is_same_tiles()) {
+
+		printf("level %d: the tiles differ\n", level);
+		return 0;
+	}
+
+	if (memcmp(exit_contents, map_contents, sizeof(int) * map_size * map_size)) {
+
+		printf("level %d: the map contents differ\n", level);
+		return 0;
+	}
+
+	if (exit_mobs != alive_mobs_count()) {
+
+		printf("level %d: %d mobs through the exit, %d when started directly\n", level, exit_mobs, alive_mobs_count());
+		return 0;
+	}
+
+	return 1;
+}
+
+int main(int argc, char **argv) {
+
+	int is_same = 1;
+
+	if (!parse_arguments(argc, argv)) {
+
+		printf("usage: %s [-n levels] [-s seed]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	//same initialization as the windowed game (see headless.c)
+	create_window(argc, argv);
+	schedule_task(logic_frame, TICK_MSEC, 0);
+	init_camera();
+	init_particles();
+	generate_ui();
+
+	for (int level = 2; level <= level_count; level++) {
+
+		is_same &= compare_level(level);
+	}
+
+	if (!is_same) {
+
+		return EXIT_FAILURE;
+	}
+
+	printf("levels 2 to %d match (seed %u)\n", level_count, seed);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,310 @@
+/*
+* This file is the map generator benchmark (make mapbench).
+*
+* It links only the map generator (no GLUT/GL), creates a range of seeded maps
+* and reports the generation speed, retry and failure rates, per-phase timings
+* and tile statistics. The same seed always creates the same map, so the numbers
+* of two builds can be compared directly and failed seeds can be reproduced.
+*
+* Usage: mapbench [-n maps] [-l level] [-s first seed] [-t threads (0 => all cores)]
+* Exits with 2 if any map failed to generate.
+*/
+
+#include "mapgen.h"
+#include <string.h>
+
+#ifdef LINUX
+#include <unistd.h>
+#endif
+
+//failed seeds listed per thread
+#define MAX_FAILED_SEEDS	32
+
+//results of a single benchmark thread
+typedef struct bench_stats {
+	int				maps;
+	int				failed;				//maps that failed all attempts
+	int				attempts;
+	int				budget_misses;
+
+	double			phase_msec[MAPGEN_PHASE_COUNT];
+	double			total_msec;			//time spent generating
+
+	long long		tile_counts[TILE_TYPE_COUNT];
+	long long		mobs;
+	long long		items;
+
+	unsigned int	failed_seeds[MAX_FAILED_SEEDS];
+	int				failed_seed_count;
+} bench_stats_t;
+
+//a benchmark thread: generates every seed with (index % thread_count == thread_index)
+typedef struct bench_thread {
+	worker_t		worker;
+	int				thread_index;
+	bench_stats_t	stats;
+} bench_thread_t;
+
+//benchmark settings
+static int map_count = 100;
+static int level = 1;
+static unsigned int first_seed = 1;
+static int thread_count = 1;
+
+static const char *phase_names[MAPGEN_PHASE_COUNT] = { "features", "locked room", "doors", "water", "exit", "contents" };
+static const char *tile_names[TILE_TYPE_COUNT] = { "empty", "floor", "wall", "water", "door", "exit", "locked door", "chest" };
+
+/*
+* Returns the amount of processor cores.
+*/
+int get_core_count(void) {
+
+#ifdef WIN32
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return count > 0 ? (int)count : 1;
+#endif // WIN32
+}
+
+/*
+* Adds the results of a generated map to the statistics.
+*/
+void add_map_stats(bench_stats_t *stats, map_generator_t *gen, int is_success, double msec) {
+
+	int contents;
+
+	stats->maps++;
+	stats->attempts += gen->attempts;
+	stats->budget_misses += gen->budget_misses;
+	stats->total_msec += msec;
+
+	for (int i = 0; i < MAPGEN_PHASE_COUNT; i++) {
+
+		stats->phase_msec[i] += gen->phase_msec[i];
+	}
+
+	for (int i = 0; i < TILE_TYPE_COUNT; i++) {
+
+		stats->tile_counts[i] += count_tiles_of_type(gen, i);
+	}
+
+	for (int i = 0; i < gen->size * gen->size; i++) {
+
+		contents = gen->contents[i];
+
+		if (contents == MAP_MOB_SLIME || contents == MAP_MOB_GOBLIN) {
+
+			stats->mobs++;
+		}
+		else if (contents && contents != MAP_ITEM_LOCK_ROOM)
+		{
+			stats->items++;
+		}
+	}
+
+	if (!is_success) {
+
+		stats->failed++;
+
+		if (stats->failed_seed_count < MAX_FAILED_SEEDS) {
+
+			stats->failed_seeds[stats->failed_seed_count++] = gen->seed;
+		}
+	}
+}
+
+/*
+* Worker job: generates the maps of a single thread.
+*/
+void bench_job(void *arg) {
+
+	bench_thread_t *thread = arg;
+	map_generator_t gen;
+	double start;
+	int is_success;
+
+	init_map_generator(&gen);
+
+	for (int i = thread->thread_index; i < map_count; i += thread_count) {
+
+		start = get_time_msec();
+
+		if (!prepare_map_generator(&gen, level)) {
+
+			break;
+		}
+		is_success = run_map_generator(&gen, first_seed + (unsigned int)i);
+
+		add_map_stats(&thread->stats, &gen, is_success, get_time_msec() - start);
+	}
+
+	free_map_generator(&gen);
+}
+
+/*
+* Adds the thread results to the total results.
+*/
+void merge_stats(bench_stats_t *total, bench_stats_t *stats) {
+
+	total->maps += stats->maps;
+	total->failed += stats->failed;
+	total->attempts += stats->attempts;
+	total->budget_misses += stats->budget_misses;
+	total->total_msec += stats->total_msec;
+	total->mobs += stats->mobs;
+	total->items += stats->items;
+
+	for (int i = 0; i < MAPGEN_PHASE_COUNT; i++) {
+
+		total->phase_msec[i] += stats->phase_msec[i];
+	}
+
+	for (int i = 0; i < TILE_TYPE_COUNT; i++) {
+
+		total->tile_counts[i] += stats->tile_counts[i];
+	}
+
+	for (int i = 0; i < stats->failed_seed_count && total->failed_seed_count < MAX_FAILED_SEEDS; i++) {
+
+		total->failed_seeds[total->failed_seed_count++] = stats->failed_seeds[i];
+	}
+}
+
+/*
+* Prints the benchmark results.
+*/
+void print_stats(bench_stats_t *stats, double wall_msec) {
+
+	int size = get_level_map_size(level);
+	long long tiles = (long long)stats->maps * size * size;
+
+	if (!stats->maps) {
+
+		printf("no maps generated\n");
+		return;
+	}
+
+	printf("level %d: %dx%d tiles, %d maps, %d thread(s)\n", level, size, size, stats->maps, thread_count);
+	printf("  speed:         %.2f maps/sec (%.3f msec per map on a thread)\n",
+		stats->maps * 1000.0 / wall_msec, stats->total_msec / stats->maps);
+	printf("  retries:       %.3f per map (%d attempts, %d budget misses)\n",
+		(double)(stats->attempts - stats->maps) / stats->maps, stats->attempts, stats->budget_misses);
+	printf("  failed:        %d maps (%.1f%%)\n", stats->failed, 100.0 * stats->failed / stats->maps);
+
+	printf("  phases (msec per map):\n");
+	for (int i = 0; i < MAPGEN_PHASE_COUNT; i++) {
+
+		printf("    %-12s %9.3f (%.1f%%)\n", phase_names[i], stats->phase_msec[i] / stats->maps,
+			stats->total_msec > 0 ? 100.0 * stats->phase_msec[i] / stats->total_msec : 0.0);
+	}
+
+	printf("  tiles (per map):\n");
+	for (int i = 0; i < TILE_TYPE_COUNT; i++) {
+
+		printf("    %-12s %9.1f (%.2f%%)\n", tile_names[i], (double)stats->tile_counts[i] / stats->maps,
+			100.0 * stats->tile_counts[i] / tiles);
+	}
+
+	printf("  contents (per map): %.1f mobs, %.1f items\n", (double)stats->mobs / stats->maps, (double)stats->items / stats->maps);
+
+	if (stats->failed_seed_count) {
+
+		printf("  failed seeds:");
+		for (int i = 0; i < stats->failed_seed_count; i++) {
+
+			printf(" %u", stats->failed_seeds[i]);
+		}
+		printf(stats->failed > stats->failed_seed_count ? " ...\n" : "\n");
+	}
+}
+
+/*
+* Reads the command line settings, returns 0 on invalid arguments.
+*/
+int parse_arguments(int argc, char **argv) {
+
+	for (int i = 1; i < argc; i++) {
+
+		if (i + 1 >= argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+
+			return 0;
+		}
+
+		switch (argv[i][1])
+		{
+			case 'n':
+				map_count = atoi(argv[++i]);
+				break;
+			case 'l':
+				level = atoi(argv[++i]);
+				break;
+			case 's':
+				first_seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+				break;
+			case 't':
+				thread_count = atoi(argv[++i]);
+				break;
+			default:
+				return 0;
+		}
+	}
+
+	if (thread_count <= 0) {
+
+		thread_count = get_core_count();
+	}
+
+	return map_count > 0 && level > 0;
+}
+
+int main(int argc, char **argv) {
+
+	bench_thread_t *threads;
+	bench_stats_t total;
+	double start;
+
+	if (!parse_arguments(argc, argv)) {
+
+		printf("usage: %s [-n maps] [-l level] [-s first seed] [-t threads (0 => all cores)]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	threads = calloc((size_t)thread_count, sizeof(bench_thread_t));
+
+	if (!threads) {
+
+		out_of_memory_error(__func__);
+	}
+
+	start = get_time_msec();
+
+	for (int i = 0; i < thread_count; i++) {
+
+		threads[i].thread_index = i;
+
+		if (thread_count == 1 || !start_worker(&threads[i].worker, bench_job, &threads[i])) {
+
+			//single thread or no threads available
+			bench_job(&threads[i]);
+		}
+	}
+
+	memset(&total, 0, sizeof(total));
+
+	for (int i = 0; i < thread_count; i++) {
+
+		wait_worker(&threads[i].worker);
+		merge_stats(&total, &threads[i].stats);
+	}
+
+	print_stats(&total, get_time_msec() - start);
+
+	free(threads);
+
+	return total.failed ? 2 : EXIT_SUCCESS;
+}
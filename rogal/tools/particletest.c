@@ -0,0 +1,287 @@
+/*
+* This file is the particle step bit-exactness check (make particletest).
+*
+* It seeds the same particles into the pool and runs the same steps three ways:
+*	- the SSE step (integrate_particles_sse, the remainder with the scalar step)
+*	  the way run_particles does it
+*	- the scalar step alone (what a PARTICLES_NO_SIMD build runs)
+*	- a copy of the old per particle loop (Vec2Add/Vec2Lerp on particle_t)
+* and compares the positions and velocities bit by bit. The particle counts
+* include ones that don't fill a full SSE register. Ground bounces take random
+* numbers, so every way starts from the same srand seed.
+*
+* Usage: particletest [-n steps] [-s seed]
+* Exits with 1 if any result differs.
+*/
+
+#include "particles.h"
+#include <string.h>
+
+//particle of the old implementation
+typedef struct {
+	vec2_t	position;
+	vec2_t	velocity;
+	float	gravity;
+	float	ground_height;
+} old_particle_t;
+
+//results of a single way
+typedef struct {
+	float	position_x[MAX_PARTICLES];
+	float	position_y[MAX_PARTICLES];
+	float	velocity_x[MAX_PARTICLES];
+	float	velocity_y[MAX_PARTICLES];
+} particle_state_t;
+
+//particle counts (odd ones leave a scalar remainder after the SSE loop)
+static const int counts[] = { 1, 2, 3, 4, 5, 7, 8, 13, 1000, 1001, 4099, MAX_PARTICLES - 1 };
+
+//step lengths in msec
+static const int step_msecs[] = { TICK_MSEC, 16, 33 };
+
+//test settings
+static int step_count = 500;
+static unsigned int seed = 1;
+
+static old_particle_t old_particles[MAX_PARTICLES];
+static particle_state_t expected, result;
+
+/*
+* Reads the command line settings, returns 0 on invalid arguments.
+*/
+int parse_arguments(int argc, char **argv) {
+
+	for (int i = 1; i < argc; i++) {
+
+		if (i + 1 >= argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+
+			return 0;
+		}
+
+		switch (argv[i][1])
+		{
+			case 'n':
+				step_count = atoi(argv[++i]);
+				break;
+			case 's':
+				seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+				break;
+			default:
+				return 0;
+		}
+	}
+
+	return step_count > 0;
+}
+
+/*
+* Returns a random float in [min_val, max_val] (in thousandths).
+*/
+float rng_float(rng_t *rng, float min_val, float max_val) {
+
+	return rng_range(rng, (int)(min_val * 1000), (int)(max_val * 1000)) / 1000.f;
+}
+
+/*
+* Fills the old particles with random values: particles in the air, on the ground,
+* falling fast enough to bounce and rising (negative gravity).
+*/
+void seed_particles(int count, unsigned int particles_seed) {
+
+	rng_t rng;
+	old_particle_t *p;
+
+	rng_seed(&rng, particles_seed, 0);
+
+	for (int i = 0; i < count; i++) {
+
+		p = &old_particles[i];
+
+		p->position[VEC_X] = rng_float(&rng, -20.f, 20.f);
+		p->position[VEC_Y] = rng_float(&rng, -20.f, 20.f);
+		p->velocity[VEC_X] = rng_float(&rng, -3.f, 3.f);
+		p->velocity[VEC_Y] = rng_float(&rng, -4.f, 3.f);
+		p->gravity = rng_range(&rng, 0, 3) ? PARTICLE_DEFAULT_GRAVITY : rng_float(&rng, -2.f, 8.f);
+		p->ground_height = p->position[VEC_Y] - rng_float(&rng, -0.5f, 1.5f);
+	}
+}
+
+/*
+* Copies the old particles into the pool.
+*/
+void fill_pool(int count) {
+
+	particle_pool_t *pool = particles_pool();
+	int p;
+
+	init_particles();
+
+	for (int i = 0; i < count; i++) {
+
+		p = new_particle();
+
+		pool->position_x[p] = old_particles[i].position[VEC_X];
+		pool->position_y[p] = old_particles[i].position[VEC_Y];
+		pool->velocity_x[p] = old_particles[i].velocity[VEC_X];
+		pool->velocity_y[p] = old_particles[i].velocity[VEC_Y];
+		pool->gravity[p] = old_particles[i].gravity;
+		pool->ground_height[p] = old_particles[i].ground_height;
+	}
+}
+
+/*
+* Runs the simulation loop of the old implementation and stores the results.
+*/
+void run_old_particles(int count) {
+
+	old_particle_t *current;
+	vec2_t end;
+	float time;
+
+	for (int step = 0; step < step_count; step++) {
+
+		time = step_msecs[step % CountOf(step_msecs)] * 0.001f;
+
+		for (int i = 0; i < count; i++) {
+
+			current = &old_particles[i];
+
+			//calculate velocity and position
+			if (current->position[VEC_Y] <= current->ground_height) {
+
+				if (current->velocity[VEC_Y] < -.8f) { //hit ground hard
+
+					//bounce
+					current->velocity[VEC_Y] *= -(0.3f + 0.03f * Random(1, 3));
+				}
+				else {
+
+					//stop falling
+					current->velocity[VEC_Y] = 0;
+				}
+				//add some ground friciton
+				current->velocity[VEC_X] *= r_clamp(1.f  - time * 5, 0, 1);
+			}
+			else {
+
+				//add gravity
+				current->velocity[VEC_Y] -= current->gravity * time;
+			}
+
+			//calculate new position using lerp
+			Vec2Add(current->position, current->velocity, end); //movement done in 1 sec (position + velocity vector)
+			Vec2Lerp(current->position, end, time, current->position); //move by time fraction
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+
+		expected.position_x[i] = old_particles[i].position[VEC_X];
+		expected.position_y[i] = old_particles[i].position[VEC_Y];
+		expected.velocity_x[i] = old_particles[i].velocity[VEC_X];
+		expected.velocity_y[i] = old_particles[i].velocity[VEC_Y];
+	}
+}
+
+/*
+* Runs the pool simulation steps and stores the results.
+*
+* Parameters:
+* use_sse - 1 => SSE step with the scalar remainder (as run_particles), 0 => scalar step only
+*/
+void run_pool_particles(int count, int use_sse) {
+
+	particle_pool_t *pool = particles_pool();
+	float time;
+	int start;
+
+	for (int step = 0; step < step_count; step++) {
+
+		time = step_msecs[step % CountOf(step_msecs)] * 0.001f;
+		start = 0;
+
+#ifdef PARTICLES_SSE
+		if (use_sse) {
+
+			start = integrate_particles_sse(count, time);
+		}
+#else
+		UNUSED_VARIABLE(use_sse);
+#endif // PARTICLES_SSE
+
+		integrate_particles_scalar(start, count, time);
+	}
+
+	memcpy(result.position_x, pool->position_x, sizeof(float) * count);
+	memcpy(result.position_y, pool->position_y, sizeof(float) * count);
+	memcpy(result.velocity_x, pool->velocity_x, sizeof(float) * count);
+	memcpy(result.velocity_y, pool->velocity_y, sizeof(float) * count);
+}
+
+/*
+* Compares the stored results with the old implementation. Returns 0 on any difference.
+*/
+int compare_results(int count, const char *name) {
+
+	size_t size = sizeof(float) * count;
+
+	if (memcmp(result.position_x, expected.position_x, size) || memcmp(result.position_y, expected.position_y, size) ||
+		memcmp(result.velocity_x, expected.velocity_x, size) || memcmp(result.velocity_y, expected.velocity_y, size)) {
+
+		printf("%s step differs from the old step with %d particles\n", name, count);
+		return 0;
+	}
+
+	return 1;
+}
+
+int main(int argc, char **argv) {
+
+	int count, is_exact = 1;
+	unsigned int particles_seed;
+
+	if (!parse_arguments(argc, argv)) {
+
+		printf("usage: %s [-n steps] [-s seed]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	for (unsigned i = 0; i < CountOf(counts); i++) {
+
+		count = counts[i];
+		particles_seed = rng_hash(seed, (unsigned int)count);
+
+		//old implementation
+		seed_particles(count, particles_seed);
+		fill_pool(count);
+		srand(particles_seed);
+		run_old_particles(count);
+
+		//scalar step
+		srand(particles_seed);
+		run_pool_particles(count, 0);
+		is_exact &= compare_results(count, "scalar");
+
+#ifdef PARTICLES_SSE
+		//SSE step
+		seed_particles(count, particles_seed);
+		fill_pool(count);
+		srand(particles_seed);
+		run_pool_particles(count, 1);
+		is_exact &= compare_results(count, "SSE");
+#endif // PARTICLES_SSE
+	}
+
+	if (!is_exact) {
+
+		return EXIT_FAILURE;
+	}
+
+#ifdef PARTICLES_SSE
+	printf("SSE and scalar particle steps match the old step (%d steps)\n", step_count);
+#else
+	printf("scalar particle step matches the old step (%d steps, no SSE)\n", step_count);
+#endif // PARTICLES_SSE
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,263 @@
+/*
+* This file is the replay round trip check (make replaytest).
+*
+* It records a headless session through the GLUT input callbacks (keys and mouse
+* clicks at random pixels around the player, so clicks near the tile edges are
+* included), then replays the file in a fresh process and compares the final
+* game state: turns played, level and player health. The recording and the
+* replay run in forked processes because the game state can't be reset.
+*
+* Usage: replaytest [-n events] [-s seed] [-f replay file]
+* Exits with 1 if the replay doesn't reproduce the recorded session.
+*/
+
+#include "game.h"
+#include "player.h"
+#include "window.h"
+#include "camera.h"
+#include "particles.h"
+#include "ui.h"
+#include "headless.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+//the longest wait between two recorded events
+#define MAX_EVENT_TICKS	40
+
+//final state of a session
+typedef struct session_state {
+	unsigned int	ticks;
+	int				turns;
+	int				level;
+	int				health;
+	int				is_dead;
+} session_state_t;
+
+//test settings
+static int event_count = 5000;
+static unsigned int seed = 1;
+static char *replay_name = "replaytest.rgrp";
+
+/*
+* Reads the command line settings, returns 0 on invalid arguments.
+*/
+int parse_arguments(int argc, char **argv) {
+
+	for (int i = 1; i < argc; i++) {
+
+		if (i + 1 >= argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+
+			return 0;
+		}
+
+		switch (argv[i][1])
+		{
+			case 'n':
+				event_count = atoi(argv[++i]);
+				break;
+			case 's':
+				seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+				break;
+			case 'f':
+				replay_name = argv[++i];
+				break;
+			default:
+				return 0;
+		}
+	}
+
+	return event_count > 0;
+}
+
+/*
+* Initializes the game the same way as the windowed game (see headless.c).
+*/
+void init_session(int argc, char **argv) {
+
+	create_window(argc, argv);
+	schedule_task(logic_frame, TICK_MSEC, 0);
+	init_camera();
+	init_particles();
+	generate_ui();
+}
+
+void get_session_state(session_state_t *state) {
+
+	state->ticks = get_simulation_msec() / TICK_MSEC;
+	state->turns = get_turn_count();
+	state->level = get_current_level();
+	state->health = player.stats.health;
+	state->is_dead = is_player_dead;
+}
+
+/*
+* Records a mouse click (button down and up) at the world position.
+*/
+void record_click(int button, vec2_t position) {
+
+	int x, y;
+
+	//window coordinates start at the bottom, mouse coordinates at the top
+	world_to_screen_coordinates(position, &x, &y);
+	y = window_props.height - y;
+
+	record_mouse_event(button, GLUT_DOWN, x, y);
+	record_mouse_event(button, GLUT_UP, x, y);
+}
+
+/*
+* Plays a random session through the input callbacks while recording it.
+*/
+int record_session(session_state_t *state) {
+
+	const char *keys = "wsade";
+	rng_t rng;
+	vec2_t position;
+
+	rng_seed(&rng, seed, 0);
+
+	if (!start_recording(replay_name)) {
+
+		return 0;
+	}
+
+	//click PLAY in the main menu
+	run_simulation_ticks(1);
+	position[VEC_X] = 0;
+	position[VEC_Y] = MMENU_SIZES + UI_SPACING;
+	record_click(GLUT_LEFT_BUTTON, position);
+
+	for (int i = 0; i < event_count; i++) {
+
+		run_simulation_ticks(rng_range(&rng, 0, MAX_EVENT_TICKS));
+
+		switch (rng_range(&rng, 0, 2))
+		{
+			case 0:
+				record_keyboard_event((unsigned char)keys[rng_range(&rng, 0, 4)], 0, 0);
+				break;
+			case 1:
+				record_special_event(rng_range(&rng, GLUT_KEY_LEFT, GLUT_KEY_DOWN), 0, 0);
+				break;
+			default:
+				//any pixel up to 1.5 tiles from the player
+				Vec2Copy(player.sprite[0]->position, position);
+				position[VEC_X] += rng_range(&rng, -1500, 1500) / 1000.f;
+				position[VEC_Y] += rng_range(&rng, -1500, 1500) / 1000.f;
+				record_click(RngBool(&rng) ? GLUT_LEFT_BUTTON : GLUT_RIGHT_BUTTON, position);
+				break;
+		}
+	}
+
+	//finish the last turn
+	run_simulation_ticks(MAX_EVENT_TICKS);
+	run_simulation_until_idle(MAX_EVENT_TICKS * 100);
+	stop_recording();
+
+	get_session_state(state);
+	return 1;
+}
+
+/*
+* Replays the recorded session up to the tick the recording ended at.
+*/
+int replay_session(unsigned int ticks, session_state_t *state) {
+
+	if (!start_replay(replay_name, 1)) {
+
+		return 0;
+	}
+
+	while (get_simulation_msec() / TICK_MSEC < ticks) {
+
+		run_simulation_tick();
+	}
+
+	get_session_state(state);
+	return !is_replaying();
+}
+
+/*
+* Runs one session in a forked process, the state is passed back through a pipe.
+* Returns 0 if the session failed.
+*/
+int run_session(int argc, char **argv, unsigned int ticks, session_state_t *state) {
+
+	int fd[2], status;
+	pid_t pid;
+
+	if (pipe(fd)) {
+
+		return 0;
+	}
+
+	//the child exits through exit(), don't let it flush the output twice
+	fflush(stdout);
+	pid = fork();
+
+	if (pid < 0) {
+
+		return 0;
+	}
+
+	if (!pid) {
+
+		close(fd[0]);
+		init_session(argc, argv);
+
+		if (!(ticks ? replay_session(ticks, state) : record_session(state)) ||
+			write(fd[1], state, sizeof(*state)) != sizeof(*state)) {
+
+			exit(EXIT_FAILURE);
+		}
+		exit(EXIT_SUCCESS);
+	}
+
+	close(fd[1]);
+	status = read(fd[0], state, sizeof(*state)) == sizeof(*state);
+	close(fd[0]);
+
+	return waitpid(pid, NULL, 0) == pid && status;
+}
+
+void print_state(const char *name, session_state_t *state) {
+
+	printf("%s: %u ticks, %d turns, level %d, health %d%s\n", name, state->ticks, state->turns, state->level,
+		state->health, state->is_dead ? " (dead)" : "");
+}
+
+int main(int argc, char **argv) {
+
+	session_state_t recorded, replayed;
+
+	if (!parse_arguments(argc, argv)) {
+
+		printf("usage: %s [-n events] [-s seed] [-f replay file]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!run_session(argc, argv, 0, &recorded)) {
+
+		printf("recording failed\n");
+		return EXIT_FAILURE;
+	}
+	print_state("recorded", &recorded);
+
+	if (!run_session(argc, argv, recorded.ticks, &replayed)) {
+
+		printf("replay failed\n");
+		return EXIT_FAILURE;
+	}
+	print_state("replayed", &replayed);
+
+	if (recorded.turns != replayed.turns || recorded.level != replayed.level ||
+		recorded.health != replayed.health || recorded.is_dead != replayed.is_dead) {
+
+		printf("the replay doesn't match the recording\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("replay matches\n");
+	return EXIT_SUCCESS;
+}